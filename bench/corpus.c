@@ -0,0 +1,288 @@
+//
+//  corpus.c
+//
+//  Deterministic synthetic inputs for the crackers
+//
+
+#include "corpus.h"
+#include "../common/aes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PATH_LENGTH 4096
+
+// common English words, most frequent first; none has a 'z' so the text
+// also passes the otp range check
+static const char *words[] =
+{
+    "the", "of", "and", "to", "a", "in", "is", "it", "you", "that",
+    "he", "was", "for", "on", "are", "with", "as", "his", "they", "be",
+    "at", "one", "have", "this", "from", "or", "had", "by", "hot", "word",
+    "but", "what", "some", "we", "can", "out", "other", "were", "all", "there",
+    "when", "up", "use", "your", "how", "said", "an", "each", "she", "which",
+    "do", "their", "time", "if", "will", "way", "about", "many", "then", "them",
+    "write", "would", "like", "so", "these", "her", "long", "make", "thing", "see",
+    "him", "two", "has", "look", "more", "day", "could", "go", "come", "did",
+    "number", "sound", "no", "most", "people", "my", "over", "know", "water", "than",
+    "call", "first", "who", "may", "down", "side", "been", "now", "find", "any",
+    "new", "work", "part", "take", "get", "place", "made", "live", "where", "after",
+    "back", "little", "only", "round", "man", "year", "came", "show", "every", "good",
+    "me", "give", "our", "under", "name", "very", "through", "just", "form", "sentence",
+    "great", "think", "say", "help", "low", "line", "differ", "turn", "cause", "much",
+    "mean", "before", "move", "right", "boy", "old", "too", "same", "tell", "does",
+    "set", "three", "want", "air", "well", "also", "play", "small", "end", "put",
+    "home", "read", "hand", "port", "large", "spell", "add", "even", "land", "here",
+    "must", "big", "high", "such", "follow", "act", "why", "ask", "men", "change",
+    "went", "light", "kind", "off", "need", "house", "picture", "try", "us", "again",
+    "animal", "point", "mother", "world", "near", "build", "self", "earth", "father", "head",
+    "stand", "own", "page", "should", "country", "found", "answer", "school", "grow", "study",
+    "still", "learn", "plant", "cover", "food", "sun", "four", "between", "state", "keep",
+    "eye", "never", "last", "let", "thought", "city", "tree", "cross", "farm", "hard",
+    "start", "might", "story", "saw", "far", "sea", "draw", "left", "late", "run",
+    "secret", "mission", "cipher", "message", "planning", "attack", "dawn", "key", "signal", "code"
+};
+
+static const int wordCount = sizeof(words) / sizeof(words[0]);
+
+void Corpus_Seed(corpusRandom *random, uint64_t seed)
+{
+    random->state = seed;
+}
+
+// splitmix64
+uint64_t Corpus_Next(corpusRandom *random)
+{
+    uint64_t z = (random->state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+void Corpus_Bytes(corpusRandom *random, unsigned char *out, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        out[i] = Corpus_Next(random);
+    }
+}
+
+void Corpus_Text(corpusRandom *random, char *out, size_t length, int lettersOnly)
+{
+    size_t position = 0;
+    int sentenceStart = 1, sentenceWords = 0;
+
+    while (position < length)
+    {
+        // squaring a uniform index skews the draw towards the frequent words
+        double u = (Corpus_Next(random) >> 11) * (1.0 / 9007199254740992.0);
+        const char *word = words[(int)(u * u * wordCount)];
+        size_t i;
+
+        if (position > 0)
+        {
+            if (!lettersOnly && sentenceWords > 4 && Corpus_Next(random) % 8 == 0)
+            {
+                out[position++] = '.';
+                sentenceStart = 1;
+                sentenceWords = 0;
+            }
+            else if (!lettersOnly && sentenceWords > 2 && Corpus_Next(random) % 16 == 0)
+            {
+                out[position++] = ',';
+            }
+
+            if (position < length)
+            {
+                out[position++] = ' ';
+            }
+        }
+
+        for (i = 0; word[i] != '\0' && position < length; i++)
+        {
+            out[position++] = (sentenceStart && i == 0) ? word[i] - 'a' + 'A' : word[i];
+        }
+
+        sentenceStart = 0;
+        sentenceWords++;
+    }
+}
+
+int Corpus_WriteFile(const char *path, const void *data, size_t length)
+{
+    FILE *fpOut = fopen(path, "wb");
+
+    if (fpOut == NULL || fwrite(data, 1, length, fpOut) != length)
+    {
+        perror(path);
+
+        if (fpOut != NULL)
+        {
+            fclose(fpOut);
+        }
+
+        return -1;
+    }
+
+    return fclose(fpOut) == 0 ? 0 : -1;
+}
+
+// uppercase hex without separators or a trailing newline, like the sample inputs
+int Corpus_WriteHex(const char *path, const unsigned char *data, size_t length)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char *hex = (char *)malloc(length * 2 + 1);
+    size_t i;
+    int ret;
+
+    for (i = 0; i < length; i++)
+    {
+        hex[i * 2] = digits[data[i] >> 4];
+        hex[i * 2 + 1] = digits[data[i] & 15];
+    }
+
+    ret = Corpus_WriteFile(path, hex, length * 2);
+    free(hex);
+
+    return ret;
+}
+
+static void xorWithKey(unsigned char *out, const unsigned char *in, size_t length,
+                       const unsigned char *key, size_t keyLength)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        out[i] = in[i] ^ key[i % keyLength];
+    }
+}
+
+int Corpus_Xor(const char *directory, size_t size, int keyLength, uint64_t seed)
+{
+    char path[PATH_LENGTH];
+    char *plainText = (char *)malloc(size);
+    unsigned char *cipherText = (unsigned char *)malloc(size);
+    unsigned char *key = (unsigned char *)malloc(keyLength);
+    corpusRandom random;
+    int ret = 0;
+
+    Corpus_Seed(&random, seed);
+    Corpus_Bytes(&random, key, keyLength);
+    Corpus_Text(&random, plainText, size, 0);
+
+    xorWithKey(cipherText, (unsigned char *)plainText, size, key, keyLength);
+
+    snprintf(path, sizeof(path), "%s/cipher.txt", directory);
+    ret |= Corpus_WriteHex(path, cipherText, size);
+    snprintf(path, sizeof(path), "%s/plain.txt", directory);
+    ret |= Corpus_WriteFile(path, plainText, size);
+    snprintf(path, sizeof(path), "%s/key.txt", directory);
+    ret |= Corpus_WriteHex(path, key, keyLength);
+
+    free(plainText);
+    free(cipherText);
+    free(key);
+
+    return ret ? -1 : 0;
+}
+
+int Corpus_Otp(const char *directory, int count, size_t length, uint64_t seed)
+{
+    char path[PATH_LENGTH];
+    char *plainText = (char *)malloc(length);
+    unsigned char *cipherText = (unsigned char *)malloc(length);
+    unsigned char *pad = (unsigned char *)malloc(length);
+    corpusRandom random;
+    size_t i;
+    int n, ret = 0;
+
+    Corpus_Seed(&random, seed);
+
+    // otp only tries pad bytes 1..254
+    for (i = 0; i < length; i++)
+    {
+        pad[i] = 1 + Corpus_Next(&random) % 254;
+    }
+
+    snprintf(path, sizeof(path), "%s/key.txt", directory);
+    ret |= Corpus_WriteHex(path, pad, length);
+
+    for (n = 1; n <= count; n++)
+    {
+        Corpus_Text(&random, plainText, length, 1);
+        xorWithKey(cipherText, (unsigned char *)plainText, length, pad, length);
+
+        snprintf(path, sizeof(path), "%s/in%d.txt", directory, n);
+        ret |= Corpus_WriteHex(path, cipherText, length);
+        snprintf(path, sizeof(path), "%s/plain%d.txt", directory, n);
+        ret |= Corpus_WriteFile(path, plainText, length);
+    }
+
+    free(plainText);
+    free(cipherText);
+    free(pad);
+
+    return ret ? -1 : 0;
+}
+
+int Corpus_Cbc(const char *directory, int count, size_t length, const unsigned char *key, uint64_t seed)
+{
+    char path[PATH_LENGTH];
+    size_t padding = AES_BLOCK - length % AES_BLOCK;
+    size_t padded = length + padding;
+    char *plainText = (char *)malloc(padded);
+    unsigned char *cipherText = (unsigned char *)malloc(AES_BLOCK + padded);
+    corpusRandom random;
+    aesKey schedule;
+    int n, ret = 0;
+
+    Corpus_Seed(&random, seed);
+    AES_SetKey(&schedule, key);
+
+    for (n = 1; n <= count; n++)
+    {
+        Corpus_Text(&random, plainText, length, 0);
+        memset(plainText + length, padding, padding);
+
+        Corpus_Bytes(&random, cipherText, AES_BLOCK);
+        AES_CbcEncrypt(&schedule, cipherText, (unsigned char *)plainText, cipherText + AES_BLOCK, padded / AES_BLOCK);
+
+        snprintf(path, sizeof(path), "%s/cipher%d.txt", directory, n);
+        ret |= Corpus_WriteHex(path, cipherText, AES_BLOCK + padded);
+        snprintf(path, sizeof(path), "%s/plain%d.txt", directory, n);
+        ret |= Corpus_WriteFile(path, plainText, length);
+    }
+
+    free(plainText);
+    free(cipherText);
+
+    return ret ? -1 : 0;
+}
+
+int Corpus_Mac(const char *directory, int count, size_t length, uint64_t seed)
+{
+    char path[PATH_LENGTH];
+    unsigned char *message = (unsigned char *)malloc(length);
+    corpusRandom random;
+    int n, ret = 0;
+
+    Corpus_Seed(&random, seed);
+
+    for (n = 1; n <= count; n++)
+    {
+        Corpus_Bytes(&random, message, length);
+
+        snprintf(path, sizeof(path), "%s/msg%d.bin", directory, n);
+        ret |= Corpus_WriteFile(path, message, length);
+    }
+
+    free(message);
+
+    return ret ? -1 : 0;
+}
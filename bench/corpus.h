@@ -0,0 +1,54 @@
+//
+//  corpus.h
+//
+//  Deterministic synthetic inputs for the crackers
+//
+//  Every workload is generated from a 64-bit seed, so the same seed always
+//  gives byte-identical corpora and benchmark runs can be compared with each
+//  other. Each generator writes its inputs in the format the matching tool
+//  reads, next to the plaintexts and keys needed to score the result:
+//
+//    xor  cipher.txt (hex), plain.txt, key.txt (hex)           -> vigenere
+//    otp  in1.txt ... inN.txt (hex), plain1.txt ..., key.txt   -> otp
+//    cbc  cipher1.txt ... (hex, IV first), plain1.txt ...      -> batch, forge
+//    mac  msg1.bin ... (binary)                                -> project 4 sample
+//
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct corpusRandom
+{
+    uint64_t state;
+} corpusRandom;
+
+void Corpus_Seed(corpusRandom *random, uint64_t seed);
+uint64_t Corpus_Next(corpusRandom *random);
+
+void Corpus_Bytes(corpusRandom *random, unsigned char *out, size_t length);
+
+// English-like text drawn from common words with a Zipf-like skew; with
+// lettersOnly set it is limited to the letters and spaces otp accepts
+void Corpus_Text(corpusRandom *random, char *out, size_t length, int lettersOnly);
+
+int Corpus_WriteFile(const char *path, const void *data, size_t length);
+int Corpus_WriteHex(const char *path, const unsigned char *data, size_t length);
+
+// the generators return 0, or -1 after reporting a write error
+int Corpus_Xor(const char *directory, size_t size, int keyLength, uint64_t seed);
+int Corpus_Otp(const char *directory, int count, size_t length, uint64_t seed);
+int Corpus_Cbc(const char *directory, int count, size_t length, const unsigned char *key, uint64_t seed);
+int Corpus_Mac(const char *directory, int count, size_t length, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
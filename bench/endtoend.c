@@ -0,0 +1,597 @@
+//
+//  endtoend.c
+//
+//  End-to-end benchmark runs of the crackers on generated corpora
+//
+//  Each workload generates a fresh corpus per run (seed, seed + 1, ...), runs
+//  the tool on it and scores the output against the known plaintexts, then
+//  reports the mean wall time, throughput, peak resident memory and success
+//  rate. Save the output and pass it back with -B to compare against it.
+//
+//  Workloads:
+//    vigenere:SIZE[:KEY_LENGTH]   repeating-key XOR, success is bytes recovered
+//    otp:COUNT[:LENGTH]           many-time pad, first candidate line per message
+//    batch:COUNT[:LENGTH]         padding oracle, plaintexts recovered
+//    mac:COUNT[:LENGTH]           CBC-MAC forgery, tags verified
+//  batch and mac need a local oracle_server with the default key (-K to
+//  change it), found through ORACLE_HOST and the port variables as usual.
+//
+
+#include "corpus.h"
+#include "../common/aes.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ARGS 1024
+#define PATH_LENGTH 4096
+#define MAX_BASELINE 64
+
+typedef struct workload
+{
+    char name[64];
+    char tool[16];
+    long size;              // bytes for vigenere, messages otherwise
+    long length;            // key length for vigenere, message length otherwise
+} workload;
+
+typedef struct runResult
+{
+    double seconds;
+    long peakKb;
+    double success;
+    int failed;
+} runResult;
+
+typedef struct baselineEntry
+{
+    char name[64];
+    double seconds;
+} baselineEntry;
+
+static const char *toolDirectory = ".";
+static const char *dictionary = NULL;
+static unsigned char aesKeyBytes[AES_BLOCK] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                                0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+static baselineEntry baseline[MAX_BASELINE];
+static int baselineCount = 0;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *readWhole(const char *path, long *length)
+{
+    FILE *fpIn = fopen(path, "rb");
+    char *data;
+
+    *length = 0;
+
+    if (fpIn == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(fpIn, 0, SEEK_END);
+    *length = ftell(fpIn);
+    fseek(fpIn, 0, SEEK_SET);
+
+    data = malloc(*length + 1);
+    *length = fread(data, 1, *length, fpIn);
+    data[*length] = '\0';
+    fclose(fpIn);
+
+    return data;
+}
+
+// fraction of the expected bytes found at the same position
+static double matchFraction(const char *expected, long expectedLength, const char *actual, long actualLength)
+{
+    long i, same = 0;
+
+    if (expectedLength == 0)
+    {
+        return 1.0;
+    }
+
+    for (i = 0; i < expectedLength && i < actualLength; i++)
+    {
+        same += expected[i] == actual[i];
+    }
+
+    return (double)same / expectedLength;
+}
+
+static void removeDirectory(const char *directory)
+{
+    char path[PATH_LENGTH];
+    struct dirent *entry;
+    DIR *dir = opendir(directory);
+
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+            unlink(path);
+        }
+    }
+
+    closedir(dir);
+    rmdir(directory);
+}
+
+// runs the tool with stdout captured in the corpus directory
+static int runTool(char **args, const char *directory, runResult *result)
+{
+    char path[PATH_LENGTH];
+    struct rusage usage;
+    double started = now();
+    int status;
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "%s/stdout.txt", directory);
+
+    if ((pid = fork()) == 0)
+    {
+        int out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(args[0], args);
+        _exit(127);
+    }
+
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid)
+    {
+        perror("fork");
+        return -1;
+    }
+
+    result->seconds = now() - started;
+    result->peakKb = usage.ru_maxrss;
+    result->failed = !WIFEXITED(status) || WEXITSTATUS(status) == 127;
+
+    if (result->failed)
+    {
+        fprintf(stderr, "%s did not run (status %d)\n", args[0], status);
+    }
+
+    return 0;
+}
+
+static void toolPath(char *path, const char *tool)
+{
+    snprintf(path, PATH_LENGTH, "%s/%s", toolDirectory, tool);
+}
+
+static int runVigenere(const workload *work, const char *directory, unsigned long long seed, runResult *result)
+{
+    char tool[PATH_LENGTH], cipher[PATH_LENGTH], out[PATH_LENGTH], plain[PATH_LENGTH], words[PATH_LENGTH];
+    char *args[] = { tool, cipher, out, words, NULL };
+    char *expected, *actual;
+    long expectedLength, actualLength;
+
+    if (Corpus_Xor(directory, work->size, work->length, seed) != 0)
+    {
+        return -1;
+    }
+
+    toolPath(tool, "vigenere");
+    snprintf(cipher, sizeof(cipher), "%s/cipher.txt", directory);
+    snprintf(out, sizeof(out), "%s/out.txt", directory);
+    snprintf(plain, sizeof(plain), "%s/plain.txt", directory);
+    snprintf(words, sizeof(words), "%s", dictionary ? dictionary : plain);
+
+    if (runTool(args, directory, result) != 0)
+    {
+        return -1;
+    }
+
+    expected = readWhole(plain, &expectedLength);
+    actual = readWhole(out, &actualLength);
+    result->success = actual ? matchFraction(expected, expectedLength, actual, actualLength) : 0.0;
+
+    free(expected);
+    free(actual);
+
+    return 0;
+}
+
+static int runOtp(const workload *work, const char *directory, unsigned long long seed, runResult *result)
+{
+    char tool[PATH_LENGTH], path[PATH_LENGTH];
+    char *args[MAX_ARGS];
+    char *output, *line;
+    long outputLength, i;
+    double total = 0.0;
+    int ret;
+
+    if (Corpus_Otp(directory, work->size, work->length, seed) != 0)
+    {
+        return -1;
+    }
+
+    toolPath(tool, "otp");
+    args[0] = tool;
+
+    for (i = 1; i <= work->size; i++)
+    {
+        snprintf(path, sizeof(path), "%s/in%ld.txt", directory, i);
+        args[i] = strdup(path);
+    }
+
+    args[work->size + 1] = NULL;
+
+    ret = runTool(args, directory, result);
+
+    for (i = 1; i <= work->size; i++)
+    {
+        free(args[i]);
+    }
+
+    if (ret != 0)
+    {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/stdout.txt", directory);
+    output = readWhole(path, &outputLength);
+
+    // the first candidate line after each "Ciphertext k" header
+    for (line = output; line != NULL && (line = strstr(line, "Ciphertext ")) != NULL; )
+    {
+        char *candidate = strchr(line, '\n'), *end, *expected;
+        long expectedLength;
+        int k = atoi(line + strlen("Ciphertext "));
+
+        if (candidate == NULL || k < 1 || k > work->size)
+        {
+            break;
+        }
+
+        candidate++;
+        end = strchr(candidate, '\n');
+
+        snprintf(path, sizeof(path), "%s/plain%d.txt", directory, k);
+        expected = readWhole(path, &expectedLength);
+        total += matchFraction(expected, expectedLength, candidate,
+                               end ? end - candidate : (long)strlen(candidate));
+        free(expected);
+
+        line = end;
+    }
+
+    result->success = total / work->size;
+    free(output);
+
+    return 0;
+}
+
+static int runBatch(const workload *work, const char *directory, unsigned long long seed, runResult *result)
+{
+    char tool[PATH_LENGTH], path[PATH_LENGTH];
+    char *args[MAX_ARGS];
+    char *output;
+    long outputLength, i;
+    double total = 0.0;
+
+    if (Corpus_Cbc(directory, work->size, work->length, aesKeyBytes, seed) != 0)
+    {
+        return -1;
+    }
+
+    toolPath(tool, "batch");
+    args[0] = tool;
+
+    for (i = 1; i <= work->size; i++)
+    {
+        snprintf(path, sizeof(path), "%s/cipher%ld.txt", directory, i);
+        args[i] = strdup(path);
+    }
+
+    args[work->size + 1] = NULL;
+
+    if (runTool(args, directory, result) != 0)
+    {
+        for (i = 1; i <= work->size; i++)
+        {
+            free(args[i]);
+        }
+
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/stdout.txt", directory);
+    output = readWhole(path, &outputLength);
+
+    // batch prints "<path>: <plaintext>" per ciphertext
+    for (i = 1; i <= work->size; i++)
+    {
+        char prefix[PATH_LENGTH + 2], *line, *expected;
+        long expectedLength;
+
+        snprintf(prefix, sizeof(prefix), "%s: ", args[i]);
+
+        if (output != NULL && (line = strstr(output, prefix)) != NULL)
+        {
+            line += strlen(prefix);
+
+            snprintf(path, sizeof(path), "%s/plain%ld.txt", directory, i);
+            expected = readWhole(path, &expectedLength);
+            total += matchFraction(expected, expectedLength, line, strcspn(line, "\n"));
+            free(expected);
+        }
+
+        free(args[i]);
+    }
+
+    result->success = total / work->size;
+    free(output);
+
+    return 0;
+}
+
+static int runMac(const workload *work, const char *directory, unsigned long long seed, runResult *result)
+{
+    char tool[PATH_LENGTH], path[PATH_LENGTH];
+    char *args[MAX_ARGS];
+    char *output, *line;
+    long outputLength, i;
+    int verified = 0, ret;
+
+    if (Corpus_Mac(directory, work->size, work->length, seed) != 0)
+    {
+        return -1;
+    }
+
+    toolPath(tool, "sample4");
+    args[0] = tool;
+
+    for (i = 1; i <= work->size; i++)
+    {
+        snprintf(path, sizeof(path), "%s/msg%ld.bin", directory, i);
+        args[i] = strdup(path);
+    }
+
+    args[work->size + 1] = NULL;
+
+    ret = runTool(args, directory, result);
+
+    for (i = 1; i <= work->size; i++)
+    {
+        free(args[i]);
+    }
+
+    if (ret != 0)
+    {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/stdout.txt", directory);
+    output = readWhole(path, &outputLength);
+
+    for (line = output; line != NULL && (line = strstr(line, "verified successfully")) != NULL; line++)
+    {
+        verified++;
+    }
+
+    result->success = (double)verified / work->size;
+    free(output);
+
+    return 0;
+}
+
+static int parseWorkload(const char *spec, workload *work)
+{
+    char tool[16];
+    long size = 0, length = 0;
+    int fields = sscanf(spec, "%15[^:]:%ld:%ld", tool, &size, &length);
+
+    if (fields < 2 || size < 1)
+    {
+        return -1;
+    }
+
+    snprintf(work->tool, sizeof(work->tool), "%s", tool);
+    snprintf(work->name, sizeof(work->name), "%s", spec);
+    work->size = size;
+
+    if (strcmp(tool, "vigenere") == 0)
+    {
+        work->length = fields == 3 ? length : 31;
+    }
+    else if (strcmp(tool, "otp") == 0)
+    {
+        work->length = fields == 3 ? length : 31;
+        return size >= 3 && size < MAX_ARGS - 3 ? 0 : -1;
+    }
+    else if (strcmp(tool, "batch") == 0 || strcmp(tool, "mac") == 0)
+    {
+        work->length = fields == 3 ? length : (tool[0] == 'm' ? 64 : 32);
+        return size < MAX_ARGS - 2 && (tool[0] != 'm' || work->length <= 255) ? 0 : -1;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return work->length > 0 ? 0 : -1;
+}
+
+static void loadBaseline(const char *path)
+{
+    char line[256];
+    FILE *fpIn = fopen(path, "r");
+
+    if (fpIn == NULL)
+    {
+        perror(path);
+        return;
+    }
+
+    while (baselineCount < MAX_BASELINE && fgets(line, sizeof(line), fpIn) != NULL)
+    {
+        baselineEntry *entry = &baseline[baselineCount];
+
+        if (sscanf(line, "%63s %*d runs %lf s/run", entry->name, &entry->seconds) == 2)
+        {
+            baselineCount++;
+        }
+    }
+
+    fclose(fpIn);
+}
+
+static void runWorkload(const workload *work, int runs, unsigned long long seed)
+{
+    char directory[] = "/tmp/endtoendXXXXXX";
+    double seconds = 0.0, success = 0.0, bytes;
+    long peakKb = 0;
+    int run, completed = 0, i;
+
+    for (run = 0; run < runs; run++)
+    {
+        runResult result;
+        int ret;
+
+        memset(&result, 0, sizeof(result));
+        strcpy(directory, "/tmp/endtoendXXXXXX");
+
+        if (mkdtemp(directory) == NULL)
+        {
+            perror("mkdtemp");
+            return;
+        }
+
+        switch (work->tool[0])
+        {
+            case 'v': ret = runVigenere(work, directory, seed + run, &result); break;
+            case 'o': ret = runOtp(work, directory, seed + run, &result); break;
+            case 'b': ret = runBatch(work, directory, seed + run, &result); break;
+            default: ret = runMac(work, directory, seed + run, &result); break;
+        }
+
+        removeDirectory(directory);
+
+        if (ret != 0 || result.failed)
+        {
+            continue;
+        }
+
+        completed++;
+        seconds += result.seconds;
+        success += result.success;
+
+        if (result.peakKb > peakKb)
+        {
+            peakKb = result.peakKb;
+        }
+    }
+
+    if (completed == 0)
+    {
+        printf("%-24s no successful runs\n", work->name);
+        return;
+    }
+
+    seconds /= completed;
+    bytes = work->tool[0] == 'v' ? work->size : (double)work->size * work->length;
+
+    printf("%-24s %3d runs %10.4f s/run %10.3f MB/s %8ld KB peak %6.1f%% success",
+           work->name, completed, seconds, bytes / seconds / 1e6, peakKb, success / completed * 100.0);
+
+    for (i = 0; i < baselineCount; i++)
+    {
+        if (strcmp(baseline[i].name, work->name) == 0)
+        {
+            printf("   %+6.1f%% vs baseline", (seconds / baseline[i].seconds - 1.0) * 100.0);
+        }
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+static void usage()
+{
+    printf("Usage: endtoend [-d tool_directory] [-n runs] [-w dictionary] [-S seed] [-K key] [-B baseline] [workload...]\n");
+    printf("       workloads: vigenere:SIZE[:KEY_LENGTH] otp:COUNT[:LENGTH] batch:COUNT[:LENGTH] mac:COUNT[:LENGTH]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *defaults[] = { "vigenere:4096", "vigenere:65536", "otp:16", "otp:256" };
+    unsigned long long seed = 1;
+    int opt, runs = 3, i;
+
+    while ((opt = getopt(argc, argv, "d:n:w:S:K:B:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': toolDirectory = optarg; break;
+            case 'n': runs = atoi(optarg); break;
+            case 'w': dictionary = optarg; break;
+            case 'S': seed = strtoull(optarg, NULL, 0); break;
+            case 'K':
+                for (i = 0; i < AES_BLOCK; i++)
+                {
+                    unsigned int tmp;
+
+                    if (strlen(optarg) != 2 * AES_BLOCK || sscanf(optarg + i * 2, "%02x", &tmp) != 1)
+                    {
+                        printf("Key must be %d hex bytes\n", AES_BLOCK);
+                        return -1;
+                    }
+
+                    aesKeyBytes[i] = tmp;
+                }
+                break;
+            case 'B': loadBaseline(optarg); break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (runs < 1)
+    {
+        usage();
+        return -1;
+    }
+
+    for (i = optind; i < argc || (optind == argc && i < optind + 4); i++)
+    {
+        workload work;
+        const char *spec = optind == argc ? defaults[i - optind] : argv[i];
+
+        if (parseWorkload(spec, &work) != 0)
+        {
+            printf("Bad workload \"%s\"\n", spec);
+            usage();
+            return -1;
+        }
+
+        runWorkload(&work, runs, seed);
+    }
+
+    return 0;
+}
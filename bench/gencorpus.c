@@ -0,0 +1,133 @@
+//
+//  gencorpus.c
+//
+//  Writes a deterministic benchmark corpus for one of the crackers
+//
+//  The AES key for cbc corpora defaults to the oracle_server default key, so
+//  the ciphertexts can be attacked against a local server straight away.
+//
+
+#include "corpus.h"
+#include "../common/aes.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage()
+{
+    printf("Usage: gencorpus xor [-s size] [-k key_length] [-S seed] <directory>\n");
+    printf("       gencorpus otp [-n messages] [-s length] [-S seed] <directory>\n");
+    printf("       gencorpus cbc [-n ciphertexts] [-s length] [-K key] [-S seed] <directory>\n");
+    printf("       gencorpus mac [-n messages] [-s length] [-S seed] <directory>\n");
+}
+
+static int parseKey(const char *hex, unsigned char *key)
+{
+    unsigned int tmp;
+    int i;
+
+    if (strlen(hex) != 2 * AES_BLOCK)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < AES_BLOCK; i++)
+    {
+        if (sscanf(hex + i * 2, "%02x", &tmp) != 1)
+        {
+            return -1;
+        }
+
+        key[i] = tmp;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char key[AES_BLOCK] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                     0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+    const char *workload, *directory;
+    unsigned long long seed = 1;
+    long size = -1;
+    int keyLength = 31, count = 8, opt, ret;
+
+    if (argc < 2)
+    {
+        usage();
+        return -1;
+    }
+
+    workload = argv[1];
+    optind = 2;
+
+    while ((opt = getopt(argc, argv, "s:k:n:S:K:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = atol(optarg); break;
+            case 'k': keyLength = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 'S': seed = strtoull(optarg, NULL, 0); break;
+            case 'K':
+                if (parseKey(optarg, key) != 0)
+                {
+                    printf("Key must be %d hex bytes\n", AES_BLOCK);
+                    return -1;
+                }
+                break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (optind != argc - 1 || keyLength < 1 || count < 1)
+    {
+        usage();
+        return -1;
+    }
+
+    directory = argv[optind];
+
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        perror(directory);
+        return -1;
+    }
+
+    if (strcmp(workload, "xor") == 0)
+    {
+        ret = Corpus_Xor(directory, size < 0 ? 4096 : size, keyLength, seed);
+    }
+    else if (strcmp(workload, "otp") == 0)
+    {
+        ret = Corpus_Otp(directory, count, size < 0 ? 31 : size, seed);
+    }
+    else if (strcmp(workload, "cbc") == 0)
+    {
+        ret = Corpus_Cbc(directory, count, size < 0 ? 32 : size, key, seed);
+    }
+    else if (strcmp(workload, "mac") == 0)
+    {
+        if (size > 255)
+        {
+            printf("Mac messages are limited to 255 bytes\n");
+            return -1;
+        }
+
+        ret = Corpus_Mac(directory, count, size < 0 ? 64 : size, seed);
+    }
+    else
+    {
+        usage();
+        return -1;
+    }
+
+    return ret;
+}
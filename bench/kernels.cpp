@@ -0,0 +1,347 @@
+//
+//  kernels.cpp
+//
+//  Microbenchmarks for the cracker kernels
+//
+//  vigenere and otp are single source files with their own main, so they are
+//  compiled in here inside namespaces with main renamed, and their kernels
+//  are timed directly on a generated corpus. Progress output is discarded
+//  while timing. Save the output and pass it back with -B to see the change
+//  against that baseline.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/metrics.h"
+#include "../common/hex.h"
+#include "../common/corpusfile.h"
+#include "../common/crackers.h"
+#include "../common/results.h"
+#include "corpus.h"
+
+namespace vigenere
+{
+#define main vigenereMain
+#include "../project 1/vigenere.cpp"
+#undef main
+}
+
+namespace otp
+{
+#define main otpMain
+#include "../project 2/otp.cpp"
+#undef main
+}
+
+using namespace std;
+
+typedef unordered_map<string, double> baselineMap;
+
+struct benchConfig
+{
+    size_t size;
+    int keyLength;
+    int messages;
+    double seconds;
+    string dictionary;
+    string baseline;
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static baselineMap loadBaseline(string path)
+{
+    baselineMap baseline;
+    ifstream file(path);
+    string line;
+
+    while (getline(file, line))
+    {
+        char name[64];
+        double microseconds;
+
+        if (sscanf(line.c_str(), "%63s %*d iters %lf us/iter", name, &microseconds) == 2)
+        {
+            baseline[name] = microseconds;
+        }
+    }
+
+    return baseline;
+}
+
+// runs the kernel until the time budget is spent and reports the mean time
+// per call and the throughput over the bytes it processes
+template <typename Kernel>
+static void run(const char *name, size_t bytes, const benchConfig &config, baselineMap &baseline, Kernel kernel)
+{
+    streambuf *saved = cout.rdbuf(nullptr);
+    double started = now(), elapsed;
+    long iterations = 0;
+
+    do
+    {
+        kernel();
+        iterations++;
+        elapsed = now() - started;
+    } while (elapsed < config.seconds);
+
+    cout.rdbuf(saved);
+    cout.clear();
+
+    double microseconds = elapsed / iterations * 1e6;
+
+    printf("%-20s %8ld iters %12.2f us/iter %10.2f MB/s", name, iterations, microseconds,
+           bytes / (microseconds / 1e6) / 1e6);
+
+    auto previous = baseline.find(name);
+
+    if (previous != baseline.end())
+    {
+        printf("   %+6.1f%% vs baseline", (microseconds / previous->second - 1.0) * 100.0);
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+static void removeCorpus(string directory, int messages)
+{
+    const char *files[] = { "cipher.txt", "plain.txt", "key.txt" };
+
+    for (auto file : files)
+    {
+        unlink((directory + "/" + file).c_str());
+    }
+
+    for (int i = 1; i <= messages; i++)
+    {
+        unlink((directory + "/in" + to_string(i) + ".txt").c_str());
+        unlink((directory + "/plain" + to_string(i) + ".txt").c_str());
+    }
+
+    rmdir(directory.c_str());
+}
+
+// the key length ranking must not depend on how the lengths were spread
+// over threads; each pool size is run several times to catch races
+static bool checkKeyLengths(const vector<uint8_t> &cipherText)
+{
+    const int poolSizes[] = { 1, 3, 7 };
+    const int repeats = 20;
+    size_t maxLength = min<size_t>(64, cipherText.size()), count = 0;
+    vector<crackers::keyLengthScore> serial(maxLength), threaded(maxLength);
+
+    if (crackers::findKeyLengths(cipherText, 1, maxLength, serial, &count, crackers::CONFIDENT_KEY_LENGTH) !=
+        crackers::CRACK_OK)
+    {
+        fprintf(stderr, "key_length: the search failed\n");
+        return false;
+    }
+
+    serial.resize(count);
+
+    for (int threads : poolSizes)
+    {
+        executor *pool = Executor_Create(threads);
+        crackers::options opts;
+
+        opts.pool = pool;
+
+        for (int i = 0; i < repeats; i++)
+        {
+            size_t found = 0;
+
+            threaded.resize(maxLength);
+
+            if (crackers::findKeyLengths(cipherText, 1, maxLength, threaded, &found, crackers::CONFIDENT_KEY_LENGTH,
+                                         &opts) != crackers::CRACK_OK)
+            {
+                found = 0;
+            }
+
+            threaded.resize(found);
+
+            if (found != serial.size() || !equal(serial.begin(), serial.end(), threaded.begin(),
+                       [](const crackers::keyLengthScore &a, const crackers::keyLengthScore &b)
+                       {
+                           return a.length == b.length && a.score == b.score;
+                       }))
+            {
+                fprintf(stderr, "key_length: %d threads ranked the lengths differently from 1\n", threads + 1);
+                Executor_Destroy(pool);
+                return false;
+            }
+        }
+
+        Executor_Destroy(pool);
+    }
+
+    return true;
+}
+
+static void usage()
+{
+    cerr << "Usage: kernels [-s size] [-k key_length] [-n messages] [-t seconds] [-w dictionary] [-B baseline]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    benchConfig config = { 65536, 31, 16, 0.5, "", "" };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:k:n:t:w:B:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': config.size = atol(optarg); break;
+            case 'k': config.keyLength = atoi(optarg); break;
+            case 'n': config.messages = atoi(optarg); break;
+            case 't': config.seconds = atof(optarg); break;
+            case 'w': config.dictionary = optarg; break;
+            case 'B': config.baseline = optarg; break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (config.size < 64 || config.keyLength < 1 || config.messages < 4)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    char directoryTemplate[] = "/tmp/kernelsXXXXXX";
+
+    if (mkdtemp(directoryTemplate) == nullptr)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    string directory = directoryTemplate;
+    baselineMap baseline = loadBaseline(config.baseline);
+
+    if (Corpus_Xor(directory.c_str(), config.size, config.keyLength, 1) != 0 ||
+        Corpus_Otp(directory.c_str(), config.messages, 31, 1) != 0)
+    {
+        removeCorpus(directory, config.messages);
+        return EXIT_FAILURE;
+    }
+
+    // without a dictionary the generated plaintext stands in for one
+    string dictionaryPath = config.dictionary.empty() ? directory + "/plain.txt" : config.dictionary;
+    string cipherPath = directory + "/cipher.txt";
+
+    streambuf *saved = cout.rdbuf(nullptr);
+    vigenere::byteVector inputBytes;
+    vigenere::stringVector dictionary;
+    crackers::languageModel letterFrequency;
+    bool loaded = vigenere::loadInputFile(cipherPath, &inputBytes) &&
+                  vigenere::loadLanguageFile(dictionaryPath, &dictionary);
+
+    if (loaded)
+    {
+        letterFrequency = vigenere::calculateLetterFrequency(&dictionary);
+    }
+
+    cout.rdbuf(saved);
+    cout.clear();
+
+    if (!loaded)
+    {
+        removeCorpus(directory, config.messages);
+        return EXIT_FAILURE;
+    }
+
+    size_t dictionaryBytes = 0;
+
+    for (auto it = dictionary.begin(); it != dictionary.end(); ++it)
+    {
+        dictionaryBytes += it->size();
+    }
+
+    string hexText;
+    {
+        ifstream file(cipherPath);
+        stringstream buffer;
+        buffer << file.rdbuf();
+        hexText = buffer.str();
+    }
+
+    printf("%zu byte ciphertext, key length %d, %d otp messages\n\n", config.size, config.keyLength, config.messages);
+
+    run("hex_decode", config.size, config, baseline, [&]()
+    {
+        vigenere::byteVector bytes;
+        vigenere::loadInputFile(cipherPath, &bytes);
+    });
+
+    vector<uint8_t> decoded(config.size);
+    vector<char> encoded(config.size * 2);
+
+    run("hex_codec_decode", config.size, config, baseline, [&]()
+    {
+        Hex_DecodeText(hexText.data(), hexText.size(), decoded.data());
+    });
+
+    run("hex_codec_encode", config.size, config, baseline, [&]()
+    {
+        Hex_Encode(decoded.data(), decoded.size(), encoded.data());
+    });
+
+    run("histogram", dictionaryBytes, config, baseline, [&]()
+    {
+        vigenere::calculateLetterFrequency(&dictionary);
+    });
+
+    if (!checkKeyLengths(inputBytes))
+    {
+        removeCorpus(directory, config.messages);
+        return EXIT_FAILURE;
+    }
+
+    run("key_length", config.size, config, baseline, [&]()
+    {
+        vigenere::calculateKeyLength(&inputBytes);
+    });
+
+    run("candidate_scoring", config.size, config, baseline, [&]()
+    {
+        vigenere::decrypt(&inputBytes, config.keyLength, &letterFrequency);
+    });
+
+    otp::byteVectorVector cipherTexts;
+
+    for (int i = 1; i <= config.messages; i++)
+    {
+        otp::loadInputFile(directory + "/in" + to_string(i) + ".txt", &cipherTexts);
+    }
+
+    run("column_solving", config.messages * 31, config, baseline, [&]()
+    {
+        otp::decrypt(&cipherTexts);
+    });
+
+    removeCorpus(directory, config.messages);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,665 @@
+//
+//  aes.c
+//
+//  AES-128 block cipher for offline verification
+//
+
+#include "aes.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_X86 1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#define AESNI __attribute__((target("aes,sse2")))
+#endif
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t invSbox[256];
+static int tablesReady = 0;
+
+static const uint8_t rcon[AES_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+static uint8_t xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b));
+}
+
+static uint8_t gmul(uint8_t a, uint8_t b)
+{
+    uint8_t product = 0;
+
+    while (b)
+    {
+        if (b & 1)
+        {
+            product ^= a;
+        }
+
+        a = xtime(a);
+        b >>= 1;
+    }
+
+    return product;
+}
+
+static void initTables(void)
+{
+    int i;
+
+    if (tablesReady)
+    {
+        return;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        invSbox[sbox[i]] = (uint8_t)i;
+    }
+
+    tablesReady = 1;
+}
+
+// portable rounds, the state is the 16 input bytes in column order
+
+static void addRoundKey(uint8_t *state, const uint8_t *roundKey)
+{
+    int i;
+
+    for (i = 0; i < AES_BLOCK; i++)
+    {
+        state[i] ^= roundKey[i];
+    }
+}
+
+static void subShiftRows(uint8_t *state)
+{
+    uint8_t tmp[AES_BLOCK];
+    int c, r;
+
+    for (c = 0; c < 4; c++)
+    {
+        for (r = 0; r < 4; r++)
+        {
+            tmp[c * 4 + r] = sbox[state[((c + r) % 4) * 4 + r]];
+        }
+    }
+
+    memcpy(state, tmp, AES_BLOCK);
+}
+
+static void invSubShiftRows(uint8_t *state)
+{
+    uint8_t tmp[AES_BLOCK];
+    int c, r;
+
+    for (c = 0; c < 4; c++)
+    {
+        for (r = 0; r < 4; r++)
+        {
+            tmp[((c + r) % 4) * 4 + r] = invSbox[state[c * 4 + r]];
+        }
+    }
+
+    memcpy(state, tmp, AES_BLOCK);
+}
+
+static void mixColumns(uint8_t *state)
+{
+    int c;
+
+    for (c = 0; c < 4; c++)
+    {
+        uint8_t *a = state + c * 4;
+        uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+        uint8_t first = a[0];
+
+        a[0] ^= all ^ xtime(a[0] ^ a[1]);
+        a[1] ^= all ^ xtime(a[1] ^ a[2]);
+        a[2] ^= all ^ xtime(a[2] ^ a[3]);
+        a[3] ^= all ^ xtime(a[3] ^ first);
+    }
+}
+
+static void invMixColumns(uint8_t *state)
+{
+    int c;
+
+    for (c = 0; c < 4; c++)
+    {
+        uint8_t *a = state + c * 4;
+        uint8_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+
+        a[0] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+        a[1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+        a[2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+        a[3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+    }
+}
+
+static void encryptPortable(const aesKey *key, const uint8_t *in, uint8_t *out)
+{
+    uint8_t state[AES_BLOCK];
+    int round;
+
+    memcpy(state, in, AES_BLOCK);
+    addRoundKey(state, key->enc[0]);
+
+    for (round = 1; round < AES_ROUNDS; round++)
+    {
+        subShiftRows(state);
+        mixColumns(state);
+        addRoundKey(state, key->enc[round]);
+    }
+
+    subShiftRows(state);
+    addRoundKey(state, key->enc[AES_ROUNDS]);
+
+    memcpy(out, state, AES_BLOCK);
+}
+
+static void decryptPortable(const aesKey *key, const uint8_t *in, uint8_t *out)
+{
+    uint8_t state[AES_BLOCK];
+    int round;
+
+    memcpy(state, in, AES_BLOCK);
+    addRoundKey(state, key->enc[AES_ROUNDS]);
+
+    for (round = AES_ROUNDS - 1; round > 0; round--)
+    {
+        invSubShiftRows(state);
+        addRoundKey(state, key->enc[round]);
+        invMixColumns(state);
+    }
+
+    invSubShiftRows(state);
+    addRoundKey(state, key->enc[0]);
+
+    memcpy(out, state, AES_BLOCK);
+}
+
+#ifdef AES_X86
+
+// every round is issued for all lanes before the next one, so up to
+// AES_LANES independent blocks are in the AES pipeline at the same time
+
+static AESNI void encryptLanes(const aesKey *key, __m128i *state, int lanes)
+{
+    __m128i roundKey = _mm_loadu_si128((const __m128i *)key->enc[0]);
+    int round, lane;
+
+    for (lane = 0; lane < lanes; lane++)
+    {
+        state[lane] = _mm_xor_si128(state[lane], roundKey);
+    }
+
+    for (round = 1; round < AES_ROUNDS; round++)
+    {
+        roundKey = _mm_loadu_si128((const __m128i *)key->enc[round]);
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            state[lane] = _mm_aesenc_si128(state[lane], roundKey);
+        }
+    }
+
+    roundKey = _mm_loadu_si128((const __m128i *)key->enc[AES_ROUNDS]);
+
+    for (lane = 0; lane < lanes; lane++)
+    {
+        state[lane] = _mm_aesenclast_si128(state[lane], roundKey);
+    }
+}
+
+static AESNI void decryptLanes(const aesKey *key, __m128i *state, int lanes)
+{
+    __m128i roundKey = _mm_loadu_si128((const __m128i *)key->dec[0]);
+    int round, lane;
+
+    for (lane = 0; lane < lanes; lane++)
+    {
+        state[lane] = _mm_xor_si128(state[lane], roundKey);
+    }
+
+    for (round = 1; round < AES_ROUNDS; round++)
+    {
+        roundKey = _mm_loadu_si128((const __m128i *)key->dec[round]);
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            state[lane] = _mm_aesdec_si128(state[lane], roundKey);
+        }
+    }
+
+    roundKey = _mm_loadu_si128((const __m128i *)key->dec[AES_ROUNDS]);
+
+    for (lane = 0; lane < lanes; lane++)
+    {
+        state[lane] = _mm_aesdeclast_si128(state[lane], roundKey);
+    }
+}
+
+static AESNI void cbcDecryptHardware(const aesKey *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks)
+{
+    __m128i previous = _mm_loadu_si128((const __m128i *)iv);
+    __m128i cipher[AES_LANES], state[AES_LANES];
+    size_t block;
+    int lane, lanes;
+
+    for (block = 0; block < blocks; block += lanes)
+    {
+        lanes = blocks - block < AES_LANES ? (int)(blocks - block) : AES_LANES;
+
+        // load everything first so in and out may overlap
+        for (lane = 0; lane < lanes; lane++)
+        {
+            cipher[lane] = _mm_loadu_si128((const __m128i *)(in + (block + lane) * AES_BLOCK));
+            state[lane] = cipher[lane];
+        }
+
+        decryptLanes(key, state, lanes);
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            _mm_storeu_si128((__m128i *)(out + (block + lane) * AES_BLOCK), _mm_xor_si128(state[lane], previous));
+            previous = cipher[lane];
+        }
+    }
+}
+
+static AESNI void cbcEncryptBatchHardware(const aesKey *key, const uint8_t *ivs, const uint8_t *in, uint8_t *out,
+                                          size_t blocks, size_t count)
+{
+    __m128i state[AES_LANES];
+    size_t first, block, stride = blocks * AES_BLOCK;
+    int lane, lanes;
+
+    for (first = 0; first < count; first += lanes)
+    {
+        lanes = count - first < AES_LANES ? (int)(count - first) : AES_LANES;
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            state[lane] = _mm_loadu_si128((const __m128i *)(ivs + (first + lane) * AES_BLOCK));
+        }
+
+        for (block = 0; block < blocks; block++)
+        {
+            for (lane = 0; lane < lanes; lane++)
+            {
+                const uint8_t *p = in + (first + lane) * stride + block * AES_BLOCK;
+                state[lane] = _mm_xor_si128(state[lane], _mm_loadu_si128((const __m128i *)p));
+            }
+
+            encryptLanes(key, state, lanes);
+
+            for (lane = 0; lane < lanes; lane++)
+            {
+                uint8_t *p = out + (first + lane) * stride + block * AES_BLOCK;
+                _mm_storeu_si128((__m128i *)p, state[lane]);
+            }
+        }
+    }
+}
+
+static AESNI void cbcMacBatchHardware(const aesKey *key, const uint8_t *messages, size_t mlength, size_t count, uint8_t *tags)
+{
+    __m128i state[AES_LANES];
+    size_t first, offset;
+    int lane, lanes;
+
+    for (first = 0; first < count; first += lanes)
+    {
+        lanes = count - first < AES_LANES ? (int)(count - first) : AES_LANES;
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            state[lane] = _mm_setzero_si128();
+        }
+
+        for (offset = 0; offset < mlength; offset += AES_BLOCK)
+        {
+            for (lane = 0; lane < lanes; lane++)
+            {
+                const uint8_t *p = messages + (first + lane) * mlength + offset;
+                __m128i block;
+
+                if (mlength - offset >= AES_BLOCK)
+                {
+                    block = _mm_loadu_si128((const __m128i *)p);
+                }
+                else
+                {
+                    uint8_t padded[AES_BLOCK] = {0};
+                    memcpy(padded, p, mlength - offset);
+                    block = _mm_loadu_si128((const __m128i *)padded);
+                }
+
+                state[lane] = _mm_xor_si128(state[lane], block);
+            }
+
+            encryptLanes(key, state, lanes);
+        }
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            _mm_storeu_si128((__m128i *)(tags + (first + lane) * AES_BLOCK), state[lane]);
+        }
+    }
+}
+
+static AESNI void lastBlocksHardware(const aesKey *key, const uint8_t *cipherTexts, size_t num_blocks,
+                                     size_t count, uint8_t *plain)
+{
+    __m128i state[AES_LANES];
+    size_t first, stride = num_blocks * AES_BLOCK;
+    int lane, lanes;
+
+    for (first = 0; first < count; first += lanes)
+    {
+        lanes = count - first < AES_LANES ? (int)(count - first) : AES_LANES;
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            const uint8_t *p = cipherTexts + (first + lane) * stride + stride - AES_BLOCK;
+            state[lane] = _mm_loadu_si128((const __m128i *)p);
+        }
+
+        decryptLanes(key, state, lanes);
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            const uint8_t *p = cipherTexts + (first + lane) * stride + stride - 2 * AES_BLOCK;
+            state[lane] = _mm_xor_si128(state[lane], _mm_loadu_si128((const __m128i *)p));
+            _mm_storeu_si128((__m128i *)(plain + (first + lane) * AES_BLOCK), state[lane]);
+        }
+    }
+}
+
+#endif
+
+int AES_HasHardware(void)
+{
+#ifdef AES_X86
+    static int hasHardware = -1;
+
+    if (hasHardware < 0)
+    {
+        __builtin_cpu_init();
+        hasHardware = __builtin_cpu_supports("aes") ? 1 : 0;
+    }
+
+    return hasHardware;
+#else
+    return 0;
+#endif
+}
+
+void AES_SetKey(aesKey *key, const uint8_t *bytes)
+{
+    uint8_t *w = &key->enc[0][0];
+    int i, round;
+
+    initTables();
+
+    memcpy(w, bytes, AES_BLOCK);
+
+    for (i = 4; i < 4 * (AES_ROUNDS + 1); i++)
+    {
+        uint8_t t[4];
+
+        memcpy(t, w + (i - 1) * 4, 4);
+
+        if (i % 4 == 0)
+        {
+            uint8_t first = t[0];
+
+            t[0] = sbox[t[1]] ^ rcon[i / 4 - 1];
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[first];
+        }
+
+        w[i * 4 + 0] = w[(i - 4) * 4 + 0] ^ t[0];
+        w[i * 4 + 1] = w[(i - 4) * 4 + 1] ^ t[1];
+        w[i * 4 + 2] = w[(i - 4) * 4 + 2] ^ t[2];
+        w[i * 4 + 3] = w[(i - 4) * 4 + 3] ^ t[3];
+    }
+
+    // equivalent inverse cipher schedule, as AESDEC expects it
+    memcpy(key->dec[0], key->enc[AES_ROUNDS], AES_BLOCK);
+
+    for (round = 1; round < AES_ROUNDS; round++)
+    {
+        memcpy(key->dec[round], key->enc[AES_ROUNDS - round], AES_BLOCK);
+        invMixColumns(key->dec[round]);
+    }
+
+    memcpy(key->dec[AES_ROUNDS], key->enc[0], AES_BLOCK);
+}
+
+void AES_EncryptBlock(const aesKey *key, const uint8_t *in, uint8_t *out)
+{
+#ifdef AES_X86
+    if (AES_HasHardware())
+    {
+        AES_CbcEncryptBatch(key, (const uint8_t[AES_BLOCK]){0}, in, out, 1, 1);
+        return;
+    }
+#endif
+
+    encryptPortable(key, in, out);
+}
+
+void AES_DecryptBlock(const aesKey *key, const uint8_t *in, uint8_t *out)
+{
+#ifdef AES_X86
+    if (AES_HasHardware())
+    {
+        cbcDecryptHardware(key, (const uint8_t[AES_BLOCK]){0}, in, out, 1);
+        return;
+    }
+#endif
+
+    decryptPortable(key, in, out);
+}
+
+void AES_CbcEncrypt(const aesKey *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks)
+{
+    AES_CbcEncryptBatch(key, iv, in, out, blocks, 1);
+}
+
+void AES_CbcDecrypt(const aesKey *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks)
+{
+    uint8_t previous[AES_BLOCK], cipher[AES_BLOCK];
+    size_t block;
+    int i;
+
+#ifdef AES_X86
+    if (AES_HasHardware())
+    {
+        cbcDecryptHardware(key, iv, in, out, blocks);
+        return;
+    }
+#endif
+
+    memcpy(previous, iv, AES_BLOCK);
+
+    for (block = 0; block < blocks; block++)
+    {
+        memcpy(cipher, in + block * AES_BLOCK, AES_BLOCK);
+        decryptPortable(key, cipher, out + block * AES_BLOCK);
+
+        for (i = 0; i < AES_BLOCK; i++)
+        {
+            out[block * AES_BLOCK + i] ^= previous[i];
+        }
+
+        memcpy(previous, cipher, AES_BLOCK);
+    }
+}
+
+void AES_CbcEncryptBatch(const aesKey *key, const uint8_t *ivs, const uint8_t *in, uint8_t *out,
+                         size_t blocks, size_t count)
+{
+    uint8_t state[AES_BLOCK];
+    size_t message, block;
+    int i;
+
+#ifdef AES_X86
+    if (AES_HasHardware())
+    {
+        cbcEncryptBatchHardware(key, ivs, in, out, blocks, count);
+        return;
+    }
+#endif
+
+    for (message = 0; message < count; message++)
+    {
+        const uint8_t *p = in + message * blocks * AES_BLOCK;
+        uint8_t *q = out + message * blocks * AES_BLOCK;
+
+        memcpy(state, ivs + message * AES_BLOCK, AES_BLOCK);
+
+        for (block = 0; block < blocks; block++)
+        {
+            for (i = 0; i < AES_BLOCK; i++)
+            {
+                state[i] ^= p[block * AES_BLOCK + i];
+            }
+
+            encryptPortable(key, state, state);
+            memcpy(q + block * AES_BLOCK, state, AES_BLOCK);
+        }
+    }
+}
+
+void AES_CbcMac(const aesKey *key, const uint8_t *message, size_t mlength, uint8_t *tag)
+{
+    AES_CbcMacBatch(key, message, mlength, 1, tag);
+}
+
+void AES_CbcMacBatch(const aesKey *key, const uint8_t *messages, size_t mlength, size_t count, uint8_t *tags)
+{
+    size_t message, offset;
+    int i;
+
+#ifdef AES_X86
+    if (AES_HasHardware())
+    {
+        cbcMacBatchHardware(key, messages, mlength, count, tags);
+        return;
+    }
+#endif
+
+    for (message = 0; message < count; message++)
+    {
+        const uint8_t *p = messages + message * mlength;
+        uint8_t *state = tags + message * AES_BLOCK;
+
+        memset(state, 0, AES_BLOCK);
+
+        for (offset = 0; offset < mlength; offset += AES_BLOCK)
+        {
+            for (i = 0; i < AES_BLOCK && offset + i < mlength; i++)
+            {
+                state[i] ^= p[offset + i];
+            }
+
+            encryptPortable(key, state, state);
+        }
+    }
+}
+
+static int validPadding(const uint8_t *plain)
+{
+    int padding = plain[AES_BLOCK - 1], i;
+
+    if (padding < 1 || padding > AES_BLOCK)
+    {
+        return 0;
+    }
+
+    for (i = AES_BLOCK - padding; i < AES_BLOCK; i++)
+    {
+        if (plain[i] != padding)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int AES_PaddingCheck(const aesKey *key, const uint8_t *cipherText, size_t num_blocks)
+{
+    int result;
+
+    AES_PaddingCheckBatch(key, cipherText, num_blocks, 1, &result);
+
+    return result;
+}
+
+void AES_PaddingCheckBatch(const aesKey *key, const uint8_t *cipherTexts, size_t num_blocks,
+                           size_t count, int *results)
+{
+    uint8_t plain[AES_LANES * AES_BLOCK];
+    size_t stride = num_blocks * AES_BLOCK, first, lane, lanes;
+
+    if (num_blocks < 2)
+    {
+        for (first = 0; first < count; first++)
+        {
+            results[first] = 0;
+        }
+
+        return;
+    }
+
+    // only the last block decides the padding
+    for (first = 0; first < count; first += lanes)
+    {
+        lanes = count - first < AES_LANES ? count - first : AES_LANES;
+
+#ifdef AES_X86
+        if (AES_HasHardware())
+        {
+            lastBlocksHardware(key, cipherTexts + first * stride, num_blocks, lanes, plain);
+        }
+        else
+#endif
+        {
+            for (lane = 0; lane < lanes; lane++)
+            {
+                AES_CbcDecrypt(key, cipherTexts + (first + lane) * stride + stride - 2 * AES_BLOCK,
+                               cipherTexts + (first + lane) * stride + stride - AES_BLOCK,
+                               plain + lane * AES_BLOCK, 1);
+            }
+        }
+
+        for (lane = 0; lane < lanes; lane++)
+        {
+            results[first + lane] = validPadding(plain + lane * AES_BLOCK);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  aes.h
+//
+//  AES-128 block cipher for offline verification
+//
+//  Uses AES-NI when the CPU has it and a portable byte-wise implementation
+//  otherwise. CBC encryption and CBC-MAC are serial within one message, so the
+//  batch functions run 8 independent messages side by side, keeping the AES
+//  unit busy while each chain waits for its previous block.
+//
+
+#ifndef AES_H
+#define AES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AES_BLOCK 16
+#define AES_ROUNDS 10
+#define AES_LANES 8
+
+typedef struct aesKey
+{
+    uint8_t enc[AES_ROUNDS + 1][AES_BLOCK];
+    uint8_t dec[AES_ROUNDS + 1][AES_BLOCK];    // InvMixColumns applied, for AES-NI
+} aesKey;
+
+int AES_HasHardware(void);
+
+void AES_SetKey(aesKey *key, const uint8_t *bytes);
+
+void AES_EncryptBlock(const aesKey *key, const uint8_t *in, uint8_t *out);
+void AES_DecryptBlock(const aesKey *key, const uint8_t *in, uint8_t *out);
+
+// in and out may be the same buffer
+void AES_CbcEncrypt(const aesKey *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks);
+void AES_CbcDecrypt(const aesKey *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks);
+
+// count messages of blocks blocks each, stored back to back, ivs holds one
+// IV per message
+void AES_CbcEncryptBatch(const aesKey *key, const uint8_t *ivs, const uint8_t *in, uint8_t *out,
+                         size_t blocks, size_t count);
+
+// CBC-MAC with a zero IV, a partial last block is padded with zeros (as the
+// Mac oracle does). count messages of mlength bytes each, stored back to back.
+void AES_CbcMac(const aesKey *key, const uint8_t *message, size_t mlength, uint8_t *tag);
+void AES_CbcMacBatch(const aesKey *key, const uint8_t *messages, size_t mlength, size_t count, uint8_t *tags);
+
+// padding oracle check on an IV-prefixed ciphertext of num_blocks blocks
+// (IV included), returns 1 when the plaintext ends in valid PKCS#7 padding
+int AES_PaddingCheck(const aesKey *key, const uint8_t *cipherText, size_t num_blocks);
+void AES_PaddingCheckBatch(const aesKey *key, const uint8_t *cipherTexts, size_t num_blocks,
+                           size_t count, int *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
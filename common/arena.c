@@ -0,0 +1,157 @@
+//
+//  arena.c
+//
+//  Monotonic per-job memory arena with a budget
+//
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALIGNMENT 16
+#define FIRST_CHUNK (64 << 10)
+#define MAX_CHUNK (64 << 20)
+
+typedef struct chunk
+{
+    struct chunk *next;
+    size_t size;
+    size_t used;
+    // the data follows, aligned by the padding of the header
+} chunk;
+
+#define HEADER_SIZE ((sizeof(chunk) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+struct arena
+{
+    chunk *first;
+    chunk *current;
+    size_t budget;
+    size_t used;
+    size_t peak;
+};
+
+static chunk *newChunk(size_t size)
+{
+    chunk *block = (chunk *)malloc(HEADER_SIZE + size);
+
+    if (block != NULL)
+    {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+
+    return block;
+}
+
+arena *Arena_Create(size_t budget)
+{
+    arena *memory = (arena *)calloc(1, sizeof(arena));
+
+    if (memory == NULL || (memory->first = newChunk(FIRST_CHUNK)) == NULL)
+    {
+        free(memory);
+        return NULL;
+    }
+
+    memory->current = memory->first;
+    memory->budget = budget;
+
+    return memory;
+}
+
+void Arena_Destroy(arena *memory)
+{
+    if (memory == NULL)
+    {
+        return;
+    }
+
+    Arena_Reset(memory);
+    free(memory->first);
+    free(memory);
+}
+
+void *Arena_Alloc(arena *memory, size_t size)
+{
+    chunk *block = memory->current;
+    void *data;
+
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+    if (size == 0 || size > Arena_Available(memory))
+    {
+        return NULL;
+    }
+
+    if (block->size - block->used < size)
+    {
+        // chunks double up to MAX_CHUNK, bigger requests get one of their own
+        size_t chunkSize = block->size < MAX_CHUNK ? block->size * 2 : MAX_CHUNK;
+
+        if ((block = newChunk(size > chunkSize ? size : chunkSize)) == NULL)
+        {
+            return NULL;
+        }
+
+        memory->current->next = block;
+        memory->current = block;
+    }
+
+    data = (uint8_t *)block + HEADER_SIZE + block->used;
+    block->used += size;
+    memory->used += size;
+
+    if (memory->used > memory->peak)
+    {
+        memory->peak = memory->used;
+    }
+
+    return data;
+}
+
+size_t Arena_Available(const arena *memory)
+{
+    if (memory->budget == 0)
+    {
+        return SIZE_MAX;
+    }
+
+    return memory->budget > memory->used ? memory->budget - memory->used : 0;
+}
+
+void Arena_Reset(arena *memory)
+{
+    chunk *block = memory->first->next;
+
+    while (block != NULL)
+    {
+        chunk *next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    memory->first->next = NULL;
+    memory->first->used = 0;
+    memory->current = memory->first;
+    memory->used = 0;
+    memory->peak = 0;
+}
+
+size_t Arena_Used(const arena *memory)
+{
+    return memory->used;
+}
+
+size_t Arena_Peak(const arena *memory)
+{
+    return memory->peak;
+}
+
+size_t Arena_Budget(const arena *memory)
+{
+    return memory->budget;
+}
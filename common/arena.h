@@ -0,0 +1,54 @@
+//
+//  arena.h
+//
+//  Monotonic per-job memory arena with a budget
+//
+//  Allocating bumps a pointer through chunks taken from malloc, and nothing
+//  is freed on its own: Arena_Reset gives back everything a job took at
+//  once and keeps the first chunk warm for the next job. An allocation that
+//  would take the arena past its budget fails instead, which callers use to
+//  switch to a way of working that needs less memory. The most a job had
+//  allocated is kept for reporting.
+//
+//      arena *memory = Arena_Create(64 << 20);
+//      padColumn *columns = (padColumn *)Arena_Alloc(memory, length * sizeof(padColumn));
+//      ...
+//      report(Arena_Peak(memory));
+//      Arena_Reset(memory);
+//
+//  An arena is used by one thread at a time.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct arena arena;
+
+// budget in bytes, 0 for none
+arena *Arena_Create(size_t budget);
+void Arena_Destroy(arena *memory);
+
+// 16-byte aligned, NULL past the budget or when malloc fails
+void *Arena_Alloc(arena *memory, size_t size);
+
+// what Arena_Alloc can still hand out under the budget
+size_t Arena_Available(const arena *memory);
+
+// releases every allocation and starts a new peak
+void Arena_Reset(arena *memory);
+
+size_t Arena_Used(const arena *memory);
+size_t Arena_Peak(const arena *memory);
+size_t Arena_Budget(const arena *memory);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
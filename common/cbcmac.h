@@ -0,0 +1,44 @@
+//
+//  cbcmac.h
+//
+//  Chunk splitting for CBC-MAC forgery, shared by crackers::forgeMac and
+//  the pipelined engine of project 4
+//
+//  The tag of a block-aligned prefix lets the rest of a message be MACed on
+//  its own with that tag xored into its first block, so a message is split
+//  into chunks the oracle accepts. Header only, as both C and C++ callers
+//  need it without another file to link.
+//
+
+#ifndef CBCMAC_H
+#define CBCMAC_H
+
+#include <stddef.h>
+
+#define CBCMAC_BLOCK 16
+
+// length of the next chunk of a length byte message starting at position, 0
+// when the rest of the message cannot be split into chunks of at most
+// maxChunk bytes
+static inline size_t CbcMac_NextChunk(size_t length, size_t position, size_t maxChunk)
+{
+    size_t remaining = length - position;
+    size_t chunk = remaining <= maxChunk ? remaining : maxChunk / CBCMAC_BLOCK * CBCMAC_BLOCK;
+
+    // never query the whole message, that would not be a forgery
+    if (position == 0 && chunk == length)
+    {
+        chunk = (length - 1) / CBCMAC_BLOCK * CBCMAC_BLOCK;
+    }
+
+    // the final chunk needs a whole first block to carry the chained tag,
+    // a partial block is padded by the oracle and cannot absorb it
+    if (chunk < remaining && remaining - chunk < CBCMAC_BLOCK)
+    {
+        chunk = chunk >= CBCMAC_BLOCK ? chunk - CBCMAC_BLOCK : 0;
+    }
+
+    return chunk < CBCMAC_BLOCK ? 0 : chunk;
+}
+
+#endif
@@ -0,0 +1,289 @@
+//
+//  corpusfile.c
+//
+//  Indexed binary container for many ciphertext records
+//
+
+#include "corpusfile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAGIC "CTCORPUS"
+#define VERSION 1
+#define HEADER_LENGTH 64
+#define ENTRY_LENGTH 24
+#define ALIGNMENT 16
+
+struct corpusFile
+{
+    const uint8_t *map;
+    size_t size;
+    uint64_t count;
+    const uint8_t *index;
+};
+
+struct corpusWriter
+{
+    FILE *fpOut;
+    const char *path;
+    uint64_t position;
+    uint8_t *index;
+    uint64_t count;
+    uint64_t capacity;
+    int failed;
+};
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static void put64(uint8_t *p, uint64_t v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+int CorpusFile_Is(const char *path)
+{
+    char magic[8];
+    FILE *fpIn = fopen(path, "rb");
+    int is;
+
+    if (fpIn == NULL)
+    {
+        return 0;
+    }
+
+    is = fread(magic, 1, sizeof(magic), fpIn) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(magic)) == 0;
+    fclose(fpIn);
+
+    return is;
+}
+
+corpusFile *CorpusFile_Open(const char *path)
+{
+    struct stat st;
+    corpusFile *file;
+    uint64_t indexOffset, count;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return NULL;
+    }
+
+    if ((size_t)st.st_size < HEADER_LENGTH)
+    {
+        fprintf(stderr, "%s: not a corpus file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    count = get64((const uint8_t *)map + 16);
+    indexOffset = get64((const uint8_t *)map + 24);
+
+    if (memcmp(map, MAGIC, 8) != 0 || get32((const uint8_t *)map + 8) != VERSION ||
+        indexOffset > (uint64_t)st.st_size || count > ((uint64_t)st.st_size - indexOffset) / ENTRY_LENGTH)
+    {
+        fprintf(stderr, "%s: not a corpus file or damaged\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    file = (corpusFile *)malloc(sizeof(corpusFile));
+    file->map = (const uint8_t *)map;
+    file->size = st.st_size;
+    file->count = count;
+    file->index = file->map + indexOffset;
+
+    return file;
+}
+
+void CorpusFile_Close(corpusFile *file)
+{
+    if (file != NULL)
+    {
+        munmap((void *)file->map, file->size);
+        free(file);
+    }
+}
+
+size_t CorpusFile_Count(const corpusFile *file)
+{
+    return file->count;
+}
+
+int CorpusFile_Record(const corpusFile *file, size_t index, corpusRecord *record)
+{
+    const uint8_t *entry;
+    uint64_t offset, length, metadataLength;
+
+    if (index >= file->count)
+    {
+        return -1;
+    }
+
+    entry = file->index + index * ENTRY_LENGTH;
+    offset = get64(entry);
+    length = get32(entry + 8);
+    metadataLength = get32(entry + 12);
+
+    if (offset < HEADER_LENGTH || offset > file->size || length + metadataLength > file->size - offset)
+    {
+        return -1;
+    }
+
+    record->data = file->map + offset;
+    record->length = length;
+    record->metadata = (const char *)file->map + offset + length;
+    record->metadataLength = metadataLength;
+    record->type = get32(entry + 16);
+
+    return 0;
+}
+
+corpusWriter *CorpusFile_Create(const char *path)
+{
+    uint8_t header[HEADER_LENGTH] = { 0 };
+    corpusWriter *writer;
+    FILE *fpOut = fopen(path, "wb");
+
+    if (fpOut == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    // the real header is written by CorpusFile_Finish
+    if (fwrite(header, 1, HEADER_LENGTH, fpOut) != HEADER_LENGTH)
+    {
+        perror(path);
+        fclose(fpOut);
+        return NULL;
+    }
+
+    writer = (corpusWriter *)calloc(1, sizeof(corpusWriter));
+    writer->fpOut = fpOut;
+    writer->path = path;
+    writer->position = HEADER_LENGTH;
+
+    return writer;
+}
+
+int CorpusFile_Append(corpusWriter *writer, const uint8_t *data, size_t length, int type,
+                      const char *metadata, size_t metadataLength)
+{
+    static const uint8_t zeros[ALIGNMENT] = { 0 };
+    size_t padding = (ALIGNMENT - writer->position % ALIGNMENT) % ALIGNMENT;
+    uint8_t *entry;
+
+    if (writer->failed || length > UINT32_MAX || metadataLength > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    if (writer->count == writer->capacity)
+    {
+        writer->capacity = writer->capacity ? writer->capacity * 2 : 1024;
+        writer->index = (uint8_t *)realloc(writer->index, writer->capacity * ENTRY_LENGTH);
+    }
+
+    if (fwrite(zeros, 1, padding, writer->fpOut) != padding ||
+        fwrite(data, 1, length, writer->fpOut) != length ||
+        fwrite(metadata, 1, metadataLength, writer->fpOut) != metadataLength)
+    {
+        perror(writer->path);
+        writer->failed = 1;
+        return -1;
+    }
+
+    writer->position += padding;
+
+    entry = writer->index + writer->count * ENTRY_LENGTH;
+    memset(entry, 0, ENTRY_LENGTH);
+    put64(entry, writer->position);
+    put32(entry + 8, length);
+    put32(entry + 12, metadataLength);
+    put32(entry + 16, type);
+
+    writer->position += length + metadataLength;
+    writer->count++;
+
+    return 0;
+}
+
+int CorpusFile_Finish(corpusWriter *writer)
+{
+    static const uint8_t zeros[8] = { 0 };
+    uint8_t header[HEADER_LENGTH] = { 0 };
+    size_t padding = (8 - writer->position % 8) % 8;
+    int failed = writer->failed;
+
+    memcpy(header, MAGIC, 8);
+    put32(header + 8, VERSION);
+    put64(header + 16, writer->count);
+    put64(header + 24, writer->position + padding);
+
+    if (!failed &&
+        (fwrite(zeros, 1, padding, writer->fpOut) != padding ||
+         fwrite(writer->index, ENTRY_LENGTH, writer->count, writer->fpOut) != writer->count ||
+         fseek(writer->fpOut, 0, SEEK_SET) != 0 ||
+         fwrite(header, 1, HEADER_LENGTH, writer->fpOut) != HEADER_LENGTH))
+    {
+        perror(writer->path);
+        failed = 1;
+    }
+
+    if (fclose(writer->fpOut) != 0)
+    {
+        failed = 1;
+    }
+
+    free(writer->index);
+    free(writer);
+
+    return failed ? -1 : 0;
+}
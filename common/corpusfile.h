@@ -0,0 +1,67 @@
+//
+//  corpusfile.h
+//
+//  Indexed binary container for many ciphertext records
+//
+//  Layout (little-endian):
+//    header   64 bytes: magic "CTCORPUS", version, record count, index offset
+//    records  raw bytes of each record followed by its metadata, every
+//             record starting on a 16-byte boundary
+//    index    one 24-byte entry per record: offset, length, metadata
+//             length, type
+//  The file is mapped read-only and records are handed out as pointers into
+//  the mapping, so opening a corpus costs one mmap whatever its size and any
+//  record can be reached directly through the index.
+//
+
+#ifndef CORPUSFILE_H
+#define CORPUSFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CORPUS_UNKNOWN 0
+#define CORPUS_XOR 1        // repeating-key XOR, for vigenere
+#define CORPUS_OTP 2        // one of a set under the same pad, for otp
+#define CORPUS_CBC 3        // IV-prefixed CBC ciphertext, for the padding oracle
+#define CORPUS_MAC 4        // message for the CBC-MAC forger
+
+typedef struct corpusRecord
+{
+    const uint8_t *data;
+    size_t length;
+    const char *metadata;   // not terminated, e.g. the source file name
+    size_t metadataLength;
+    int type;
+} corpusRecord;
+
+typedef struct corpusFile corpusFile;
+typedef struct corpusWriter corpusWriter;
+
+// 1 if the file starts with the corpus magic
+int CorpusFile_Is(const char *path);
+
+corpusFile *CorpusFile_Open(const char *path);
+void CorpusFile_Close(corpusFile *file);
+
+size_t CorpusFile_Count(const corpusFile *file);
+
+// 0, or -1 when the index is out of range or the entry points outside the file
+int CorpusFile_Record(const corpusFile *file, size_t index, corpusRecord *record);
+
+corpusWriter *CorpusFile_Create(const char *path);
+int CorpusFile_Append(corpusWriter *writer, const uint8_t *data, size_t length, int type,
+                      const char *metadata, size_t metadataLength);
+
+// writes the index and header and closes the file, 0 on success
+int CorpusFile_Finish(corpusWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,954 @@
+//
+//  crackers.cpp
+//
+//  In-process API for the crackers
+//
+
+#include "crackers.h"
+#include "cbcmac.h"
+#include "keystream.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+namespace crackers
+{
+
+static const size_t BLOCK_SIZE = 16;
+
+// scratch memory from the caller's allocator, or malloc, released on scope exit
+class scratch
+{
+public:
+    scratch(const options *opts, size_t size) : memory(opts ? opts->memory : nullptr), size(size)
+    {
+        data = memory ? memory->allocate(memory->context, size) : malloc(size);
+    }
+
+    ~scratch()
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+
+        if (memory)
+        {
+            memory->release(memory->context, data, size);
+        }
+        else
+        {
+            free(data);
+        }
+    }
+
+    template <typename T>
+    T *get() const { return static_cast<T *>(data); }
+
+private:
+    scratch(const scratch &);
+    scratch &operator=(const scratch &);
+
+    const allocator *memory;
+    size_t size;
+    void *data;
+};
+
+// progress of a call whose units of work may finish on several threads
+class progress
+{
+public:
+    progress(const options *opts, const char *phase, size_t total) : opts(opts), phase(phase), total(total), done(0) {}
+
+    // counts finished units, false once the caller has asked to stop
+    bool step(size_t units = 1)
+    {
+        if (opts == nullptr || opts->progress == nullptr)
+        {
+            return true;
+        }
+
+        std::lock_guard<std::mutex> hold(lock);
+        done += units;
+
+        return opts->progress(opts->progressContext, phase, done, total);
+    }
+
+private:
+    const options *opts;
+    const char *phase;
+    size_t total;
+    size_t done;
+    std::mutex lock;
+};
+
+// the first error of a call whose units run on several threads; it cancels
+// the units that have not finished
+class firstError
+{
+public:
+    firstError() : code(CRACK_OK) {}
+
+    void set(taskGroup *group, errorCode error)
+    {
+        int expected = CRACK_OK;
+
+        code.compare_exchange_strong(expected, error);
+        Executor_Cancel(group);
+    }
+
+    // for an Executor_For that returned cancelled
+    errorCode get(int cancelled) const
+    {
+        errorCode error = (errorCode)code.load();
+
+        return error != CRACK_OK ? error : cancelled ? CRACK_CANCELLED : CRACK_OK;
+    }
+
+private:
+    std::atomic<int> code;
+};
+
+static executor *poolOf(const options *opts)
+{
+    return opts ? opts->pool : nullptr;
+}
+
+static const taskGroup *parentOf(const options *opts)
+{
+    return opts ? opts->parent : nullptr;
+}
+
+static void *allocateFromArena(void *context, size_t size)
+{
+    return Arena_Alloc(static_cast<arena *>(context), size);
+}
+
+static void releaseToArena(void *, void *, size_t)
+{
+}
+
+// scratch is only ever taken on the calling thread, before any columns are
+// handed to the pool, so a single-threaded arena is enough
+allocator arenaAllocator(arena *memory)
+{
+    allocator result = { allocateFromArena, releaseToArena, memory };
+
+    return result;
+}
+
+const char *errorString(errorCode error)
+{
+    switch (error)
+    {
+        case CRACK_OK: return "success";
+        case CRACK_INVALID_ARGUMENT: return "invalid argument";
+        case CRACK_BUFFER_TOO_SMALL: return "output buffer too small";
+        case CRACK_NO_SOLUTION: return "no solution found";
+        case CRACK_OUT_OF_MEMORY: return "out of memory";
+        case CRACK_ORACLE_FAILED: return "oracle could not be asked";
+        case CRACK_CANCELLED: return "cancelled";
+    }
+
+    return "unknown error";
+}
+
+languageModel::languageModel() : total(0)
+{
+    memset(counts, 0, sizeof(counts));
+    memset(frequency, 0, sizeof(frequency));
+}
+
+void addLanguageSample(languageModel *model, span<const char> text)
+{
+    for (size_t i = 0; i < text.size; i++)
+    {
+        unsigned char c = text[i];
+
+        if (c == '\n' || c == '\r')
+        {
+            continue;
+        }
+
+        model->counts[tolower(c)]++;
+        model->total++;
+    }
+}
+
+errorCode finishLanguageModel(languageModel *model)
+{
+    if (model->total == 0)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    for (int c = 0; c < 256; c++)
+    {
+        model->frequency[c] = (double)model->counts[c] / model->total;
+    }
+
+    return CRACK_OK;
+}
+
+// lengths longer than a confident one are not scored, and sort last
+const double SKIPPED_LENGTH = -1.0;
+
+// bytes a column needs before its score is trusted to stop the search
+const size_t CONFIDENT_COLUMN = 8;
+
+struct keyLengthWork
+{
+    byteSpan cipherText;
+    size_t minLength;
+    double confident;
+    keyLengthScore *candidates;
+    progress *tracker;
+    std::atomic<size_t> stopAt;     // the shortest confident length so far
+};
+
+static void scoreKeyLengths(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    keyLengthWork *work = (keyLengthWork *)context;
+    byteSpan cipherText = work->cipherText;
+    uint32_t histogram[256] = { 0 };
+
+    for (size_t length = begin; length < end && !Executor_Cancelled(group); length++)
+    {
+        keyLengthScore *candidate = &work->candidates[length - work->minLength];
+        double sum = 0.0;
+        size_t columns = 0;
+
+        candidate->length = length;
+
+        if (length > work->stopAt.load(std::memory_order_relaxed))
+        {
+            candidate->score = SKIPPED_LENGTH;
+
+            if (!work->tracker->step())
+            {
+                Executor_Cancel(group);
+            }
+
+            continue;
+        }
+
+        for (size_t column = 0; column < length; column++)
+        {
+            // pairs of equal bytes, counted as each byte arrives; only the
+            // buckets the column touched are cleared afterwards
+            uint64_t pairs = 0;
+            size_t n = 0;
+
+            for (size_t i = column; i < cipherText.size; i += length, n++)
+            {
+                pairs += histogram[cipherText[i]]++;
+            }
+
+            for (size_t i = column; i < cipherText.size; i += length)
+            {
+                histogram[cipherText[i]] = 0;
+            }
+
+            if (n < 2)
+            {
+                continue;
+            }
+
+            sum += 2.0 * pairs / ((double)n * (n - 1));
+            columns++;
+        }
+
+        candidate->score = columns ? sum / columns : 0.0;
+
+        // its multiples would score about as well, so they are not worth scoring
+        if (work->confident > 0.0 && candidate->score >= work->confident &&
+            cipherText.size / length >= CONFIDENT_COLUMN)
+        {
+            size_t stopAt = work->stopAt.load(std::memory_order_relaxed);
+
+            while (length < stopAt && !work->stopAt.compare_exchange_weak(stopAt, length, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        if (!work->tracker->step())
+        {
+            Executor_Cancel(group);
+        }
+    }
+}
+
+errorCode findKeyLengths(byteSpan cipherText, size_t minLength, size_t maxLength,
+                         span<keyLengthScore> scores, size_t *count, double confident, const options *opts)
+{
+    if (minLength == 0 || maxLength < minLength || maxLength > cipherText.size || count == nullptr)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    size_t lengths = maxLength - minLength + 1;
+    scratch all(opts, lengths * sizeof(keyLengthScore));
+    keyLengthScore *candidates = all.get<keyLengthScore>();
+
+    if (candidates == nullptr)
+    {
+        return CRACK_OUT_OF_MEMORY;
+    }
+
+    progress tracker(opts, "key_length", lengths);
+    keyLengthWork work = { cipherText, minLength, confident, candidates, &tracker, { SIZE_MAX } };
+
+    if (Executor_For(poolOf(opts), parentOf(opts), minLength, maxLength + 1, 1, scoreKeyLengths, &work) != 0)
+    {
+        return CRACK_CANCELLED;
+    }
+
+    // lengths scored on other threads before the confident one was found
+    // are dropped too, so the answer does not depend on scheduling
+    size_t stopAt = work.stopAt.load();
+
+    for (size_t i = 0; i < lengths; i++)
+    {
+        if (candidates[i].length > stopAt)
+        {
+            candidates[i].score = SKIPPED_LENGTH;
+        }
+    }
+
+    // ties keep the shorter length first
+    std::stable_sort(candidates, candidates + lengths, [](const keyLengthScore &a, const keyLengthScore &b)
+    {
+        return a.score > b.score;
+    });
+
+    while (lengths > 0 && candidates[lengths - 1].score == SKIPPED_LENGTH)
+    {
+        lengths--;
+    }
+
+    *count = std::min(lengths, scores.size);
+    std::copy(candidates, candidates + *count, scores.begin());
+
+    return CRACK_OK;
+}
+
+struct keyWork
+{
+    byteSpan cipherText;
+    const languageModel *model;
+    span<uint8_t> key;
+    double *scores;
+    progress *tracker;
+    firstError error;
+};
+
+static void recoverColumns(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    keyWork *work = (keyWork *)context;
+    size_t keyLength = work->key.size;
+
+    for (size_t column = begin; column < end && !Executor_Cancelled(group); column++)
+    {
+        uint32_t histogram[256] = { 0 };
+        uint8_t present[256];
+        int distinct = 0;
+        size_t n = 0;
+
+        for (size_t i = column; i < work->cipherText.size; i += keyLength, n++)
+        {
+            histogram[work->cipherText[i]]++;
+        }
+
+        for (int c = 0; c < 256; c++)
+        {
+            if (histogram[c] > 0)
+            {
+                present[distinct++] = c;
+            }
+        }
+
+        // a candidate only counts when the whole column decrypts to printable
+        // ASCII, and is scored by how well its frequencies match the model
+        double best = 0.0;
+        int bestKey = -1;
+
+        for (int j = 0; j < 256; j++)
+        {
+            double sum = 0.0;
+            int k;
+
+            for (k = 0; k < distinct; k++)
+            {
+                int decrypted = present[k] ^ j;
+
+                if (decrypted < 32 || decrypted > 127)
+                {
+                    break;
+                }
+
+                sum += work->model->frequency[decrypted] * ((double)histogram[present[k]] / n);
+            }
+
+            if (k == distinct && sum > best)
+            {
+                best = sum;
+                bestKey = j;
+            }
+        }
+
+        // one column without a solution decides the call
+        if (bestKey < 0)
+        {
+            work->error.set(group, CRACK_NO_SOLUTION);
+            return;
+        }
+
+        work->key[column] = bestKey;
+        work->scores[column] = best;
+
+        if (!work->tracker->step())
+        {
+            Executor_Cancel(group);
+        }
+    }
+}
+
+errorCode recoverKey(byteSpan cipherText, const languageModel &model, span<uint8_t> key,
+                     double *score, const options *opts)
+{
+    if (key.size == 0 || cipherText.size < key.size)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    scratch columnScores(opts, key.size * sizeof(double));
+
+    if (columnScores.get<double>() == nullptr)
+    {
+        return CRACK_OUT_OF_MEMORY;
+    }
+
+    progress tracker(opts, "key_recovery", key.size);
+    keyWork work;
+    work.cipherText = cipherText;
+    work.model = &model;
+    work.key = key;
+    work.scores = columnScores.get<double>();
+    work.tracker = &tracker;
+
+    int cancelled = Executor_For(poolOf(opts), parentOf(opts), 0, key.size, 1, recoverColumns, &work);
+    errorCode error = work.error.get(cancelled);
+
+    if (error != CRACK_OK)
+    {
+        return error;
+    }
+
+    if (score)
+    {
+        double total = 0.0;
+
+        for (size_t column = 0; column < key.size; column++)
+        {
+            total += work.scores[column];
+        }
+
+        *score = total / key.size;
+    }
+
+    return CRACK_OK;
+}
+
+errorCode applyKey(byteSpan input, byteSpan key, span<uint8_t> output)
+{
+    if (key.size == 0)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    if (output.size < input.size)
+    {
+        return CRACK_BUFFER_TOO_SMALL;
+    }
+
+    // below a tile's worth, tiling the key costs more than it saves
+    if (input.size >= KEYSTREAM_TILE)
+    {
+        keystream stream;
+
+        if (Keystream_Init(&stream, key.data, key.size) != 0)
+        {
+            return CRACK_OUT_OF_MEMORY;
+        }
+
+        Keystream_Apply(&stream, 0, input.data, output.data, input.size);
+        Keystream_Free(&stream);
+
+        return CRACK_OK;
+    }
+
+    for (size_t i = 0, k = 0; i < input.size; i++)
+    {
+        output[i] = input[i] ^ key[k];
+
+        if (++k == key.size)
+        {
+            k = 0;
+        }
+    }
+
+    return CRACK_OK;
+}
+
+errorCode scoreKey(byteSpan cipherText, const languageModel &model, byteSpan key, double *score,
+                   const options *opts)
+{
+    if (key.size == 0 || cipherText.size < key.size || score == nullptr)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    scratch columnSums(opts, key.size * sizeof(double));
+    double *sums = columnSums.get<double>();
+
+    if (sums == nullptr)
+    {
+        return CRACK_OUT_OF_MEMORY;
+    }
+
+    std::fill(sums, sums + key.size, 0.0);
+
+    for (size_t i = 0, k = 0; i < cipherText.size; i++)
+    {
+        int decrypted = cipherText[i] ^ key[k];
+
+        if (decrypted < 32 || decrypted > 127)
+        {
+            return CRACK_NO_SOLUTION;
+        }
+
+        sums[k] += model.frequency[decrypted];
+
+        if (++k == key.size)
+        {
+            k = 0;
+        }
+    }
+
+    // the mean over columns of each column's mean, as recoverKey scores
+    double total = 0.0;
+
+    for (size_t column = 0; column < key.size; column++)
+    {
+        total += sums[column] / ((cipherText.size - column + key.size - 1) / key.size);
+    }
+
+    *score = total / key.size;
+
+    return CRACK_OK;
+}
+
+errorCode columnFingerprint(byteSpan cipherText, const languageModel &model, size_t keyLength,
+                            span<uint8_t> fingerprint)
+{
+    if (keyLength == 0 || cipherText.size < keyLength || fingerprint.size < keyLength * FINGERPRINT_GUESSES)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    // a space, which a word list never has, then the commonest characters
+    uint8_t likely[FINGERPRINT_GUESSES] = { ' ' };
+
+    for (int guess = 1; guess < FINGERPRINT_GUESSES; guess++)
+    {
+        int best = -1;
+
+        for (int c = 0; c < 256; c++)
+        {
+            if (std::find(likely, likely + guess, c) == likely + guess &&
+                (best < 0 || model.counts[c] > model.counts[best]))
+            {
+                best = c;
+            }
+        }
+
+        likely[guess] = best;
+    }
+
+    for (size_t column = 0; column < keyLength; column++)
+    {
+        uint32_t histogram[256] = { 0 };
+        int top = 0;
+
+        for (size_t i = column; i < cipherText.size; i += keyLength)
+        {
+            histogram[cipherText[i]]++;
+        }
+
+        for (int c = 1; c < 256; c++)
+        {
+            if (histogram[c] > histogram[top])
+            {
+                top = c;
+            }
+        }
+
+        for (int guess = 0; guess < FINGERPRINT_GUESSES; guess++)
+        {
+            fingerprint[column * FINGERPRINT_GUESSES + guess] = top ^ likely[guess];
+        }
+    }
+
+    return CRACK_OK;
+}
+
+struct padWork
+{
+    span<const byteSpan> cipherTexts;
+    padColumn *columns;
+    bool letter[256];
+    progress *tracker;
+};
+
+static void solveColumns(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    padWork *work = (padWork *)context;
+
+    for (size_t bytePos = begin; bytePos < end && !Executor_Cancelled(group); bytePos++)
+    {
+        bool seen[256] = { false };
+        uint8_t present[256];
+        int distinct = 0;
+
+        // whether a pad byte fits depends only on the distinct bytes of the
+        // column, which stops at the first ciphertext that is too short
+        for (size_t k = 0; k < work->cipherTexts.size && bytePos < work->cipherTexts[k].size; k++)
+        {
+            uint8_t byte = work->cipherTexts[k][bytePos];
+
+            if (!seen[byte])
+            {
+                seen[byte] = true;
+                present[distinct++] = byte;
+            }
+        }
+
+        padColumn &out = work->columns[bytePos];
+        out.count = 0;
+
+        for (int j = 1; j < 255; j++)
+        {
+            int k = 0;
+
+            while (k < distinct && work->letter[present[k] ^ j])
+            {
+                k++;
+            }
+
+            if (k == distinct)
+            {
+                out.candidates[out.count++] = j;
+            }
+        }
+    }
+
+    if (!work->tracker->step(end - begin))
+    {
+        Executor_Cancel(group);
+    }
+}
+
+errorCode solvePad(span<const byteSpan> cipherTexts, span<padColumn> columns, size_t *columnCount,
+                   const options *opts)
+{
+    if (cipherTexts.size == 0 || columnCount == nullptr)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    size_t length = cipherTexts[0].size;
+
+    if (columns.size < length)
+    {
+        return CRACK_BUFFER_TOO_SMALL;
+    }
+
+    progress tracker(opts, "pad_columns", length);
+    padWork work;
+    work.cipherTexts = cipherTexts;
+    work.columns = columns.data;
+    work.tracker = &tracker;
+
+    // upper case, lower case up to y, and space
+    for (int c = 0; c < 256; c++)
+    {
+        work.letter[c] = c == ' ' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c < 'z');
+    }
+
+    if (Executor_For(poolOf(opts), parentOf(opts), 0, length, 16, solveColumns, &work) != 0)
+    {
+        return CRACK_CANCELLED;
+    }
+
+    *columnCount = length;
+
+    return CRACK_OK;
+}
+
+errorCode padFingerprint(span<const byteSpan> cipherTexts, size_t columns, span<uint8_t> fingerprint)
+{
+    const uint8_t likely[FINGERPRINT_GUESSES] = { ' ', 'e', 't', 'a' };
+    size_t perColumn = cipherTexts.size * FINGERPRINT_GUESSES;
+
+    if (cipherTexts.size == 0 || fingerprint.size < columns * perColumn)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    for (size_t column = 0; column < columns; column++)
+    {
+        const byteSpan *reaching = std::find_if(cipherTexts.begin(), cipherTexts.end(),
+                                                [column](const byteSpan &text) { return text.size > column; });
+
+        if (reaching == cipherTexts.end())
+        {
+            return CRACK_INVALID_ARGUMENT;
+        }
+
+        uint8_t *guesses = &fingerprint[column * perColumn];
+
+        for (size_t i = 0; i < cipherTexts.size; i++)
+        {
+            uint8_t byte = cipherTexts[i].size > column ? cipherTexts[i][column] : (*reaching)[column];
+
+            for (int guess = 0; guess < FINGERPRINT_GUESSES; guess++)
+            {
+                guesses[i * FINGERPRINT_GUESSES + guess] = byte ^ likely[guess];
+            }
+        }
+    }
+
+    return CRACK_OK;
+}
+
+// byte-at-a-time recovery of D(block) against a crafted previous block
+static errorCode recoverIntermediate(const uint8_t *block, uint8_t *intermediate,
+                                     paddingOracle oracle, void *oracleContext, const taskGroup *group)
+{
+    uint8_t cipherConcat[2 * BLOCK_SIZE] = { 0 };
+    int padding = 1;
+
+    memcpy(cipherConcat + BLOCK_SIZE, block, BLOCK_SIZE);
+
+    for (int i = BLOCK_SIZE - 1; i >= 0; i--)
+    {
+        int j, ret = 0;
+
+        if (Executor_Cancelled(group))
+        {
+            return CRACK_CANCELLED;
+        }
+
+        for (j = 0; j < 256; j++)
+        {
+            cipherConcat[i] = j;
+            ret = oracle(oracleContext, cipherConcat, 2);
+
+            if (ret == 1 && i == BLOCK_SIZE - 1)
+            {
+                // the plaintext may have ended in 02 02 (or longer) instead
+                // of 01, changing the byte before it tells the two apart
+                cipherConcat[i - 1] ^= 1;
+                ret = oracle(oracleContext, cipherConcat, 2);
+                cipherConcat[i - 1] ^= 1;
+            }
+
+            if (ret < 0)
+            {
+                return CRACK_ORACLE_FAILED;
+            }
+
+            if (ret == 1)
+            {
+                break;
+            }
+        }
+
+        if (j == 256)
+        {
+            return CRACK_NO_SOLUTION;
+        }
+
+        intermediate[i] = j ^ padding;
+        padding++;
+
+        for (size_t k = i; k < BLOCK_SIZE; k++)
+        {
+            cipherConcat[k] = padding ^ intermediate[k];
+        }
+    }
+
+    return CRACK_OK;
+}
+
+struct paddingWork
+{
+    byteSpan cipherText;
+    paddingOracle oracle;
+    void *oracleContext;
+    span<uint8_t> plainText;
+    progress *tracker;
+    firstError error;
+};
+
+static void recoverBlocks(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    paddingWork *work = (paddingWork *)context;
+
+    for (size_t block = begin; block < end && !Executor_Cancelled(group); block++)
+    {
+        uint8_t intermediate[BLOCK_SIZE];
+        errorCode error = recoverIntermediate(work->cipherText.data + block * BLOCK_SIZE, intermediate,
+                                              work->oracle, work->oracleContext, group);
+
+        if (error != CRACK_OK)
+        {
+            if (error != CRACK_CANCELLED)
+            {
+                work->error.set(group, error);
+            }
+
+            return;
+        }
+
+        for (size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            work->plainText[(block - 1) * BLOCK_SIZE + i] = intermediate[i] ^ work->cipherText[(block - 1) * BLOCK_SIZE + i];
+        }
+
+        if (!work->tracker->step())
+        {
+            Executor_Cancel(group);
+        }
+    }
+}
+
+errorCode paddingOracleDecrypt(byteSpan cipherText, paddingOracle oracle, void *oracleContext,
+                               span<uint8_t> plainText, size_t *plainLength, const options *opts)
+{
+    if (oracle == nullptr || plainLength == nullptr ||
+        cipherText.size < 2 * BLOCK_SIZE || cipherText.size % BLOCK_SIZE != 0)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    size_t blocks = cipherText.size / BLOCK_SIZE - 1;
+
+    if (plainText.size < blocks * BLOCK_SIZE)
+    {
+        return CRACK_BUFFER_TOO_SMALL;
+    }
+
+    progress tracker(opts, "padding_oracle", blocks);
+    paddingWork work;
+    work.cipherText = cipherText;
+    work.oracle = oracle;
+    work.oracleContext = oracleContext;
+    work.plainText = plainText;
+    work.tracker = &tracker;
+
+    // every block only needs itself and the one before, so they are independent
+    int cancelled = Executor_For(poolOf(opts), parentOf(opts), 1, blocks + 1, 1, recoverBlocks, &work);
+    errorCode error = work.error.get(cancelled);
+
+    if (error != CRACK_OK)
+    {
+        return error;
+    }
+
+    size_t length = blocks * BLOCK_SIZE;
+    uint8_t padding = plainText[length - 1];
+    bool valid = padding >= 1 && padding <= BLOCK_SIZE;
+
+    for (size_t i = 1; valid && i <= padding; i++)
+    {
+        valid = plainText[length - i] == padding;
+    }
+
+    *plainLength = valid ? length - padding : length;
+
+    return CRACK_OK;
+}
+
+errorCode forgeMac(byteSpan message, size_t maxChunk, macOracle oracle, void *oracleContext,
+                   span<uint8_t> tag, size_t *calls, const options *opts)
+{
+    if (oracle == nullptr || message.size < 2 * BLOCK_SIZE || maxChunk < BLOCK_SIZE)
+    {
+        return CRACK_INVALID_ARGUMENT;
+    }
+
+    if (tag.size < BLOCK_SIZE)
+    {
+        return CRACK_BUFFER_TOO_SMALL;
+    }
+
+    scratch buffer(opts, std::min(maxChunk, message.size));
+    uint8_t *chunk = buffer.get<uint8_t>();
+    uint8_t chained[BLOCK_SIZE];
+    size_t position = 0, used = 0;
+    progress tracker(opts, "mac_chunks", message.size);
+
+    if (chunk == nullptr)
+    {
+        return CRACK_OUT_OF_MEMORY;
+    }
+
+    while (position < message.size)
+    {
+        size_t length = CbcMac_NextChunk(message.size, position, maxChunk);
+
+        if (length == 0)
+        {
+            return CRACK_INVALID_ARGUMENT;
+        }
+
+        // the tag so far is folded into the chunk's first block
+        memcpy(chunk, message.data + position, length);
+
+        for (size_t i = 0; position > 0 && i < BLOCK_SIZE; i++)
+        {
+            chunk[i] ^= chained[i];
+        }
+
+        used++;
+
+        if (oracle(oracleContext, chunk, length, chained) != 0)
+        {
+            return CRACK_ORACLE_FAILED;
+        }
+
+        position += length;
+
+        // each chunk needs the tag of the one before, so this stays serial
+        if (!tracker.step(length) || Executor_Cancelled(parentOf(opts)))
+        {
+            return CRACK_CANCELLED;
+        }
+    }
+
+    memcpy(tag.data, chained, BLOCK_SIZE);
+
+    if (calls)
+    {
+        *calls = used;
+    }
+
+    return CRACK_OK;
+}
+
+}
@@ -0,0 +1,204 @@
+//
+//  crackers.h
+//
+//  In-process API for the crackers
+//
+//  The cracking logic behind vigenere and otp, and the padding oracle and
+//  CBC-MAC attacks, as library calls on memory the caller already holds.
+//  Inputs are spans, results go to caller-provided buffers, scratch memory
+//  comes from the caller's allocator when one is given, every call returns an
+//  error code instead of exiting, and long calls report progress through a
+//  callback that can also cancel them. Nothing is printed or read from disk.
+//
+//      crackers::languageModel model;
+//      crackers::addLanguageSample(&model, crackers::span<const char>(text, textLength));
+//      crackers::finishLanguageModel(&model);
+//
+//      uint8_t key[31];
+//      double score;
+//      crackers::errorCode error = crackers::recoverKey(crackers::byteSpan(cipherText, length), model,
+//                                                       crackers::span<uint8_t>(key, sizeof(key)), &score);
+//
+
+#ifndef CRACKERS_H
+#define CRACKERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+#include "arena.h"
+#include "executor.h"
+
+namespace crackers
+{
+
+// a pointer and a length, like C++20 std::span
+template <typename T>
+struct span
+{
+    T *data;
+    size_t size;
+
+    span() : data(nullptr), size(0) {}
+    span(T *data, size_t size) : data(data), size(size) {}
+
+    template <size_t N>
+    span(T (&array)[N]) : data(array), size(N) {}
+
+    // any contiguous container with data() and size(), e.g. std::vector
+    template <typename Container, typename = decltype(static_cast<T *>(std::declval<Container &>().data()))>
+    span(Container &container) : data(container.data()), size(container.size()) {}
+
+    // span<T> to span<const T>
+    template <typename U>
+    span(const span<U> &other) : data(other.data), size(other.size) {}
+
+    T *begin() const { return data; }
+    T *end() const { return data + size; }
+    T &operator[](size_t index) const { return data[index]; }
+};
+
+typedef span<const uint8_t> byteSpan;
+
+enum errorCode
+{
+    CRACK_OK = 0,
+    CRACK_INVALID_ARGUMENT,
+    CRACK_BUFFER_TOO_SMALL,
+    CRACK_NO_SOLUTION,
+    CRACK_OUT_OF_MEMORY,
+    CRACK_ORACLE_FAILED,
+    CRACK_CANCELLED
+};
+
+const char *errorString(errorCode error);
+
+struct allocator
+{
+    void *(*allocate)(void *context, size_t size);
+    void (*release)(void *context, void *memory, size_t size);
+    void *context;
+};
+
+// scratch from a per-job arena (arena.h): releasing does nothing, it all goes
+// back when the arena is reset, and a call whose scratch would go past the
+// arena's budget returns CRACK_OUT_OF_MEMORY
+allocator arenaAllocator(arena *memory);
+
+// called after every unit of work (a key length, a column, a block), one
+// call at a time even when the units run on several threads; returning false
+// cancels the call, which then returns CRACK_CANCELLED
+typedef bool (*progressCallback)(void *context, const char *phase, size_t done, size_t total);
+
+struct options
+{
+    const allocator *memory;        // nullptr for malloc and free, only used on the calling thread
+    progressCallback progress;      // may be nullptr
+    void *progressContext;
+    executor *pool;                 // spreads the units of work over a pool, nullptr for the calling thread only
+    const taskGroup *parent;        // cancelling it cancels the call, may be nullptr
+
+    options() : memory(nullptr), progress(nullptr), progressContext(nullptr), pool(nullptr), parent(nullptr) {}
+};
+
+// character frequencies of a language, case folded, built from sample text
+// such as a word list
+struct languageModel
+{
+    uint64_t counts[256];
+    uint64_t total;
+    double frequency[256];
+
+    languageModel();
+};
+
+// line breaks are skipped, so a word list can be fed as is
+void addLanguageSample(languageModel *model, span<const char> text);
+
+// CRACK_INVALID_ARGUMENT if no characters were added
+errorCode finishLanguageModel(languageModel *model);
+
+struct keyLengthScore
+{
+    size_t length;
+    double score;       // mean index of coincidence of the key's columns
+};
+
+// mean index of coincidence above which a key length is taken as the real
+// one: text in a language scores 0.06 or more, wrong lengths near 1/256
+const double CONFIDENT_KEY_LENGTH = 0.05;
+
+// repeating-key XOR: scores the key lengths in [minLength, maxLength] and
+// writes up to scores.size of them, best first. Multiples of the real length
+// score about as well as the length itself, so once a length scores at least
+// confident (0 for never) the lengths longer than it are left out.
+errorCode findKeyLengths(byteSpan cipherText, size_t minLength, size_t maxLength,
+                         span<keyLengthScore> scores, size_t *count, double confident = 0.0,
+                         const options *opts = nullptr);
+
+// repeating-key XOR with key.size as the key length: picks for every column
+// the key byte that decrypts it to printable ASCII and whose character
+// frequencies best match the model. score is the mean match over columns.
+// CRACK_NO_SOLUTION if some column has no printable decryption.
+errorCode recoverKey(byteSpan cipherText, const languageModel &model, span<uint8_t> key,
+                     double *score, const options *opts = nullptr);
+
+// output[i] = input[i] ^ key[i % key.size]; output may be input
+errorCode applyKey(byteSpan input, byteSpan key, span<uint8_t> output);
+
+// repeating-key XOR: recoverKey's score of a known key, in one pass over the
+// ciphertext. CRACK_NO_SOLUTION at the first byte that does not decrypt to
+// printable ASCII, which drops most wrong keys within a few bytes.
+errorCode scoreKey(byteSpan cipherText, const languageModel &model, byteSpan key, double *score,
+                   const options *opts = nullptr);
+
+// likely key bytes of each column of a repeating-key XOR, for ranking known
+// keys (Results_Rank) before scoring them: the column's commonest byte
+// decrypted as a space or as one of the model's commonest characters, which
+// the right key matches in most columns and a wrong one in very few.
+// fingerprint holds FINGERPRINT_GUESSES bytes per column of keyLength.
+const int FINGERPRINT_GUESSES = 4;
+
+errorCode columnFingerprint(byteSpan cipherText, const languageModel &model, size_t keyLength,
+                            span<uint8_t> fingerprint);
+
+// pad bytes that decode one column of a many-time pad to letters or spaces
+struct padColumn
+{
+    uint8_t candidates[254];
+    uint16_t count;
+};
+
+// many-time pad: one column per byte of the first ciphertext, each using the
+// ciphertexts in order up to the first one that is too short
+errorCode solvePad(span<const byteSpan> cipherTexts, span<padColumn> columns, size_t *columnCount,
+                   const options *opts = nullptr);
+
+// likely pad bytes of each column of a many-time pad, for ranking known pads
+// (Results_Rank): each ciphertext's byte decrypted as a space or as one of
+// the commonest English letters. fingerprint holds FINGERPRINT_GUESSES bytes
+// per ciphertext for each of columns columns; a ciphertext too short for a
+// column repeats the guesses of the first one that reaches it.
+errorCode padFingerprint(span<const byteSpan> cipherTexts, size_t columns, span<uint8_t> fingerprint);
+
+// the padding oracle answers 1 for valid padding and 0 otherwise, the MAC
+// oracle 0 once it has written the 16-byte tag; -1 when they could not be asked
+typedef int (*paddingOracle)(void *context, const uint8_t *cipherText, size_t blocks);
+typedef int (*macOracle)(void *context, const uint8_t *message, size_t length, uint8_t *tag);
+
+// CBC with the IV as the first block and PKCS#7 padding; the padding is
+// stripped from plainLength when it is valid. With a pool the blocks are
+// recovered in parallel, so the oracle is called from several threads at once.
+errorCode paddingOracleDecrypt(byteSpan cipherText, paddingOracle oracle, void *oracleContext,
+                               span<uint8_t> plainText, size_t *plainLength, const options *opts = nullptr);
+
+// CBC-MAC tag of a message of two or more blocks, without ever asking the
+// oracle for the message itself: block-aligned chunks of at most maxChunk
+// bytes are chained through the tags of the ones before
+errorCode forgeMac(byteSpan message, size_t maxChunk, macOracle oracle, void *oracleContext,
+                   span<uint8_t> tag, size_t *calls, const options *opts = nullptr);
+
+}
+
+#endif
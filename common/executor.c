@@ -0,0 +1,477 @@
+//
+//  executor.c
+//
+//  Work-stealing thread pool with nested fork-join and cancellation
+//
+
+#include "executor.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// a task is either func(group, arg) or, with func NULL, the range
+// [begin, end) of the rangeContext in arg
+typedef struct task
+{
+    taskFunc func;
+    void *arg;
+    taskGroup *group;
+    size_t begin;
+    size_t end;
+} task;
+
+typedef struct rangeContext
+{
+    rangeFunc body;
+    void *context;
+    size_t grain;
+} rangeContext;
+
+// items[top..bottom), indices taken modulo capacity
+typedef struct taskDeque
+{
+    pthread_mutex_t lock;
+    task *items;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+} taskDeque;
+
+struct executor
+{
+    int threads;
+    pthread_t *ids;
+    taskDeque *deques;      // one per worker, then the one for outside threads
+
+    pthread_mutex_t sleepLock;
+    pthread_cond_t wake;
+    pthread_cond_t finished;    // for Executor_Wait: a group finished or a task was queued
+    int sleepers;
+    int waiters;
+    long queued;            // tasks in all deques
+    int stopping;
+};
+
+typedef struct workerStart
+{
+    executor *pool;
+    int index;
+} workerStart;
+
+static __thread executor *currentPool;
+static __thread int currentIndex;
+static __thread uint32_t stealSeed;
+
+static pthread_once_t defaultOnce = PTHREAD_ONCE_INIT;
+static executor *defaultPool;
+
+static void dequeInit(taskDeque *deque)
+{
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = 64;
+    deque->items = (task *)malloc(deque->capacity * sizeof(task));
+    deque->top = 0;
+    deque->bottom = 0;
+}
+
+static void dequePush(taskDeque *deque, const task *item)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom - deque->top == deque->capacity)
+    {
+        task *items = (task *)malloc(deque->capacity * 2 * sizeof(task));
+        size_t i;
+
+        for (i = 0; i < deque->capacity; i++)
+        {
+            items[i] = deque->items[(deque->top + i) % deque->capacity];
+        }
+
+        free(deque->items);
+        deque->items = items;
+        deque->top = 0;
+        deque->bottom = deque->capacity;
+        deque->capacity *= 2;
+    }
+
+    deque->items[deque->bottom++ % deque->capacity] = *item;
+
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// the owner's end: the newest task, still warm in its cache
+static int dequePop(taskDeque *deque, task *item)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom > deque->top)
+    {
+        *item = deque->items[--deque->bottom % deque->capacity];
+        found = 1;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+// the thieves' end: the oldest task, which is the biggest piece of a split range
+static int dequeSteal(taskDeque *deque, task *item)
+{
+    int found = 0;
+
+    if (__atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&deque->top, __ATOMIC_RELAXED) ||
+        pthread_mutex_trylock(&deque->lock) != 0)
+    {
+        return 0;
+    }
+
+    if (deque->bottom > deque->top)
+    {
+        *item = deque->items[deque->top++ % deque->capacity];
+        found = 1;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+// the deque of the calling thread: its own in a worker, the shared one outside
+static taskDeque *ownDeque(executor *pool)
+{
+    return &pool->deques[currentPool == pool ? currentIndex : pool->threads];
+}
+
+static int findTask(executor *pool, task *item)
+{
+    int count = pool->threads + 1, start, i;
+
+    if (dequePop(ownDeque(pool), item))
+    {
+        __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_SEQ_CST);
+        return 1;
+    }
+
+    // xorshift, so thieves spread over the victims
+    if (stealSeed == 0)
+    {
+        stealSeed = (uint32_t)(uintptr_t)&item | 1;
+    }
+
+    stealSeed ^= stealSeed << 13;
+    stealSeed ^= stealSeed >> 17;
+    stealSeed ^= stealSeed << 5;
+    start = stealSeed % count;
+
+    for (i = 0; i < count; i++)
+    {
+        if (dequeSteal(&pool->deques[(start + i) % count], item))
+        {
+            __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void pushTask(taskGroup *group, taskFunc func, void *arg, size_t begin, size_t end)
+{
+    executor *pool = group->pool;
+    task item = { func, arg, group, begin, end };
+
+    __atomic_fetch_add(&group->pending, 1, __ATOMIC_SEQ_CST);
+    dequePush(ownDeque(pool), &item);
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0 || __atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&pool->sleepLock);
+        pthread_cond_signal(&pool->wake);
+        pthread_cond_broadcast(&pool->finished);
+        pthread_mutex_unlock(&pool->sleepLock);
+    }
+}
+
+static void runRange(taskGroup *group, const rangeContext *range, size_t begin, size_t end)
+{
+    // keep the first half, offer the second to thieves
+    while (end - begin > range->grain && !Executor_Cancelled(group))
+    {
+        size_t middle = begin + (end - begin) / 2;
+
+        if (group->pool == NULL)
+        {
+            break;
+        }
+
+        pushTask(group, NULL, (void *)range, middle, end);
+        end = middle;
+    }
+
+    if (!Executor_Cancelled(group))
+    {
+        range->body(group, range->context, begin, end);
+    }
+}
+
+static void runTask(const task *item)
+{
+    taskGroup *group = item->group;
+    executor *pool = group->pool;
+
+    if (!Executor_Cancelled(group))
+    {
+        if (item->func != NULL)
+        {
+            item->func(group, item->arg);
+        }
+        else
+        {
+            runRange(group, (const rangeContext *)item->arg, item->begin, item->end);
+        }
+    }
+
+    // the group may be gone as soon as pending is 0, so only the pool is
+    // touched after it
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&pool->sleepLock);
+        pthread_cond_broadcast(&pool->finished);
+        pthread_mutex_unlock(&pool->sleepLock);
+    }
+}
+
+static void *work(void *arg)
+{
+    workerStart start = *(workerStart *)arg;
+    executor *pool = start.pool;
+    task item;
+
+    free(arg);
+    currentPool = pool;
+    currentIndex = start.index;
+
+    for (;;)
+    {
+        if (findTask(pool, &item))
+        {
+            runTask(&item);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->sleepLock);
+        __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0 && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->wake, &pool->sleepLock);
+        }
+
+        __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        if (pool->stopping)
+        {
+            pthread_mutex_unlock(&pool->sleepLock);
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->sleepLock);
+    }
+
+    return NULL;
+}
+
+executor *Executor_Create(int threads)
+{
+    executor *pool = (executor *)calloc(1, sizeof(executor));
+    int i;
+
+    if (pool == NULL || threads < 0)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pool->threads = threads;
+    pool->ids = (pthread_t *)calloc(threads + 1, sizeof(pthread_t));
+    pool->deques = (taskDeque *)calloc(threads + 1, sizeof(taskDeque));
+
+    pthread_mutex_init(&pool->sleepLock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for (i = 0; i <= threads; i++)
+    {
+        dequeInit(&pool->deques[i]);
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        workerStart *start = (workerStart *)malloc(sizeof(workerStart));
+
+        start->pool = pool;
+        start->index = i;
+        pthread_create(&pool->ids[i], NULL, work, start);
+    }
+
+    return pool;
+}
+
+void Executor_Destroy(executor *pool)
+{
+    int i;
+
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->sleepLock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (i = 0; i < pool->threads; i++)
+    {
+        pthread_join(pool->ids[i], NULL);
+    }
+
+    for (i = 0; i <= pool->threads; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+
+    pthread_mutex_destroy(&pool->sleepLock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->finished);
+    free(pool->deques);
+    free(pool->ids);
+    free(pool);
+}
+
+static void createDefault(void)
+{
+    const char *setting = getenv("CRYPTO_THREADS");
+    long threads = setting ? atol(setting) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    defaultPool = Executor_Create(threads > 1 ? (int)threads - 1 : 0);
+}
+
+executor *Executor_Default(void)
+{
+    pthread_once(&defaultOnce, createDefault);
+
+    return defaultPool;
+}
+
+int Executor_Threads(const executor *pool)
+{
+    return pool ? pool->threads : 0;
+}
+
+void Executor_Begin(taskGroup *group, executor *pool, const taskGroup *parent)
+{
+    group->pool = pool;
+    group->parent = parent;
+    group->pending = 0;
+    group->cancelled = 0;
+}
+
+void Executor_Spawn(taskGroup *group, taskFunc func, void *arg)
+{
+    if (group->pool == NULL)
+    {
+        if (!Executor_Cancelled(group))
+        {
+            func(group, arg);
+        }
+
+        return;
+    }
+
+    pushTask(group, func, arg, 0, 0);
+}
+
+int Executor_Wait(taskGroup *group)
+{
+    executor *pool = group->pool;
+    task item;
+
+    while (__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) > 0)
+    {
+        // help while there is anything to take, which also keeps nested
+        // waits from running out of threads
+        if (findTask(pool, &item))
+        {
+            runTask(&item);
+            continue;
+        }
+
+        // the rest of the group is running on other threads: sleep until a
+        // group finishes or more work is queued. waiters is raised before
+        // pending and queued are checked, and the other side changes them
+        // before checking waiters, so the wakeup is not lost
+        pthread_mutex_lock(&pool->sleepLock);
+        __atomic_fetch_add(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+
+        while (__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) > 0 &&
+               __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0)
+        {
+            pthread_cond_wait(&pool->finished, &pool->sleepLock);
+        }
+
+        __atomic_fetch_sub(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->sleepLock);
+    }
+
+    return Executor_Cancelled(group) ? -1 : 0;
+}
+
+void Executor_Cancel(taskGroup *group)
+{
+    __atomic_store_n(&group->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+int Executor_Cancelled(const taskGroup *group)
+{
+    for (; group != NULL; group = group->parent)
+    {
+        if (__atomic_load_n(&group->cancelled, __ATOMIC_RELAXED))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int Executor_For(executor *pool, const taskGroup *parent, size_t begin, size_t end, size_t grain,
+                 rangeFunc body, void *context)
+{
+    rangeContext range = { body, context, grain ? grain : 1 };
+    taskGroup group;
+
+    Executor_Begin(&group, pool, parent);
+
+    if (begin < end)
+    {
+        runRange(&group, &range, begin, end);
+    }
+
+    if (pool == NULL)
+    {
+        return Executor_Cancelled(&group) ? -1 : 0;
+    }
+
+    return Executor_Wait(&group);
+}
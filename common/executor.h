@@ -0,0 +1,76 @@
+//
+//  executor.h
+//
+//  Work-stealing thread pool with nested fork-join and cancellation
+//
+//  Every worker owns a deque: it pushes and pops its own tasks at the bottom,
+//  and idle workers steal from the top of the others, where the oldest and
+//  usually largest pieces of work are. Tasks spawned from threads outside
+//  the pool go to a shared deque that everyone steals from. Tasks are grouped
+//  for fork-join: Executor_Wait returns once every task of the group has
+//  run, and runs queued tasks itself in the meantime, so tasks can spawn and
+//  wait on groups of their own without tying up a thread. Cancelling a group
+//  skips its tasks that have not started and every group begun under it;
+//  running tasks check Executor_Cancelled between units of work.
+//
+//      taskGroup group;
+//      Executor_Begin(&group, Executor_Default(), NULL);
+//      Executor_Spawn(&group, scoreColumn, &columns[0]);
+//      Executor_Spawn(&group, scoreColumn, &columns[1]);
+//      Executor_Wait(&group);
+//
+//  A NULL pool runs every task on the spot, on the calling thread.
+//
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct executor executor;
+
+typedef struct taskGroup
+{
+    executor *pool;
+    const struct taskGroup *parent;
+    long pending;
+    int cancelled;
+} taskGroup;
+
+typedef void (*taskFunc)(taskGroup *group, void *arg);
+typedef void (*rangeFunc)(taskGroup *group, void *context, size_t begin, size_t end);
+
+// threads workers, which may be 0; the threads waiting on groups run tasks too
+executor *Executor_Create(int threads);
+void Executor_Destroy(executor *pool);
+
+// shared pool, started on first use with CRYPTO_THREADS threads in all (the
+// caller counts as one), one per online CPU by default
+executor *Executor_Default(void);
+
+int Executor_Threads(const executor *pool);
+
+void Executor_Begin(taskGroup *group, executor *pool, const taskGroup *parent);
+void Executor_Spawn(taskGroup *group, taskFunc func, void *arg);
+
+// 0 once every task of the group has run, -1 if the group was cancelled
+int Executor_Wait(taskGroup *group);
+
+void Executor_Cancel(taskGroup *group);
+int Executor_Cancelled(const taskGroup *group);
+
+// calls body in parallel on pieces of [begin, end) of at least grain items,
+// halving the range so thieves take the biggest pieces; returns like
+// Executor_Wait
+int Executor_For(executor *pool, const taskGroup *parent, size_t begin, size_t end, size_t grain,
+                 rangeFunc body, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+//
+//  hex.c
+//
+//  Validating hex codec shared by the tools
+//
+
+#include "hex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEX_X86 1
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+#define INVALID 0xff
+
+static const char digits[] = "0123456789ABCDEF";
+
+static uint8_t values[256];
+static int valuesReady = 0;
+
+static void initValues(void)
+{
+    int c;
+
+    for (c = 0; c < 256; c++)
+    {
+        if (c >= '0' && c <= '9') values[c] = c - '0';
+        else if (c >= 'a' && c <= 'f') values[c] = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') values[c] = c - 'A' + 10;
+        else values[c] = INVALID;
+    }
+
+    valuesReady = 1;
+}
+
+static int decodePortable(const char *in, size_t pairs, uint8_t *out)
+{
+    size_t i;
+
+    if (!valuesReady)
+    {
+        initValues();
+    }
+
+    for (i = 0; i < pairs; i++)
+    {
+        uint8_t high = values[(uint8_t)in[i * 2]];
+        uint8_t low = values[(uint8_t)in[i * 2 + 1]];
+
+        if ((high | low) > 15)
+        {
+            return -1;
+        }
+
+        out[i] = (high << 4) | low;
+    }
+
+    return 0;
+}
+
+static void encodePortable(const uint8_t *in, size_t length, char *out)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        out[i * 2] = digits[in[i] >> 4];
+        out[i * 2 + 1] = digits[in[i] & 15];
+    }
+}
+
+#ifdef HEX_X86
+
+// 32 characters to 16 bytes per step: classify each character as digit or
+// letter (case folded with | 0x20), map it to its nibble value, then fold the
+// pairs with a multiply-add (high * 16 + low) and pack the words to bytes
+static AVX2 size_t decodeAvx2(const char *in, size_t pairs, uint8_t *out)
+{
+    const __m256i zeroBelow = _mm256_set1_epi8('0' - 1);
+    const __m256i nineAbove = _mm256_set1_epi8('9' + 1);
+    const __m256i aBelow = _mm256_set1_epi8('a' - 1);
+    const __m256i fAbove = _mm256_set1_epi8('f' + 1);
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i digitBase = _mm256_set1_epi8('0');
+    const __m256i letterBase = _mm256_set1_epi8('a' - 10);
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t done = 0;
+
+    while (done + 16 <= pairs)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(in + done * 2));
+        __m256i lower = _mm256_or_si256(c, caseBit);
+        __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(c, zeroBelow), _mm256_cmpgt_epi8(nineAbove, c));
+        __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, aBelow), _mm256_cmpgt_epi8(fAbove, lower));
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) != -1)
+        {
+            break;
+        }
+
+        __m256i nibbles = _mm256_blendv_epi8(_mm256_sub_epi8(lower, letterBase), _mm256_sub_epi8(c, digitBase), isDigit);
+        __m256i words = _mm256_maddubs_epi16(nibbles, weights);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+
+        _mm_storeu_si128((__m128i *)(out + done), _mm256_castsi256_si128(packed));
+        done += 16;
+    }
+
+    return done;
+}
+
+// 32 bytes to 64 characters per step: split into nibbles, interleave them in
+// output order and look the digits up with a byte shuffle
+static AVX2 size_t encodeAvx2(const uint8_t *in, size_t length, char *out)
+{
+    const __m256i table = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+                                           '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t done = 0;
+
+    while (done + 32 <= length)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + done));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+        __m256i low = _mm256_and_si256(x, mask);
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+
+        first = _mm256_shuffle_epi8(table, first);
+        second = _mm256_shuffle_epi8(table, second);
+
+        _mm256_storeu_si256((__m256i *)(out + done * 2), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + done * 2 + 32), _mm256_permute2x128_si256(first, second, 0x31));
+        done += 32;
+    }
+
+    return done;
+}
+
+#endif
+
+int Hex_HasAvx2(void)
+{
+#ifdef HEX_X86
+    static int hasAvx2 = -1;
+
+    if (hasAvx2 < 0)
+    {
+        __builtin_cpu_init();
+        hasAvx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return hasAvx2;
+#else
+    return 0;
+#endif
+}
+
+long Hex_Decode(const char *in, size_t length, uint8_t *out)
+{
+    size_t pairs = length / 2, done = 0;
+
+    if (length % 2 != 0)
+    {
+        return -1;
+    }
+
+#ifdef HEX_X86
+    if (Hex_HasAvx2())
+    {
+        done = decodeAvx2(in, pairs, out);
+    }
+#endif
+
+    // the tail, or the whole remainder after an invalid character, which the
+    // portable path then pinpoints
+    if (decodePortable(in + done * 2, pairs - done, out + done) != 0)
+    {
+        return -1;
+    }
+
+    return pairs;
+}
+
+static int isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+long Hex_DecodeText(const char *in, size_t length, uint8_t *out)
+{
+    size_t position = 0, written = 0, trimmed = length;
+    char pending = 0;
+    int hasPending = 0;
+    long decoded;
+
+    // the usual file is one run of digits, maybe with a trailing newline
+    while (trimmed > 0 && isSpace(in[trimmed - 1]))
+    {
+        trimmed--;
+    }
+
+    if ((decoded = Hex_Decode(in, trimmed, out)) >= 0)
+    {
+        return decoded;
+    }
+
+    // decode each whitespace-free run with the strict decoder, carrying an
+    // odd digit over to the next run
+    while (position < length)
+    {
+        size_t start, end;
+
+        while (position < length && isSpace(in[position]))
+        {
+            position++;
+        }
+
+        start = position;
+
+        while (position < length && !isSpace(in[position]))
+        {
+            position++;
+        }
+
+        end = position;
+
+        if (start == end)
+        {
+            break;
+        }
+
+        if (hasPending)
+        {
+            char pair[2] = { pending, in[start++] };
+
+            if (Hex_Decode(pair, 2, out + written) != 1)
+            {
+                return -1;
+            }
+
+            written++;
+            hasPending = 0;
+        }
+
+        if ((end - start) % 2 != 0)
+        {
+            pending = in[--end];
+            hasPending = 1;
+        }
+
+        if ((decoded = Hex_Decode(in + start, end - start, out + written)) < 0)
+        {
+            return -1;
+        }
+
+        written += decoded;
+    }
+
+    return hasPending ? -1 : (long)written;
+}
+
+void Hex_Encode(const uint8_t *in, size_t length, char *out)
+{
+    size_t done = 0;
+
+#ifdef HEX_X86
+    if (Hex_HasAvx2())
+    {
+        done = encodeAvx2(in, length, out);
+    }
+#endif
+
+    encodePortable(in + done, length - done, out + done * 2);
+}
+
+uint8_t *Hex_LoadFile(const char *path, size_t *length)
+{
+    FILE *fpIn = fopen(path, "rb");
+    char *text;
+    uint8_t *data;
+    long size, decoded;
+
+    if (fpIn == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    // not a regular file (a pipe, a directory) when it cannot be sized
+    if (fseek(fpIn, 0, SEEK_END) != 0 || (size = ftell(fpIn)) < 0 || fseek(fpIn, 0, SEEK_SET) != 0)
+    {
+        perror(path);
+        fclose(fpIn);
+        return NULL;
+    }
+
+    text = (char *)malloc((size_t)size + 1);
+    data = (uint8_t *)malloc((size_t)size / 2 + 1);
+
+    if (text == NULL || data == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        free(text);
+        free(data);
+        fclose(fpIn);
+        return NULL;
+    }
+
+    if (fread(text, 1, size, fpIn) != (size_t)size)
+    {
+        perror(path);
+        size = -1;
+    }
+
+    fclose(fpIn);
+
+    decoded = size < 0 ? -1 : Hex_DecodeText(text, size, data);
+    free(text);
+
+    if (decoded < 0)
+    {
+        if (size >= 0)
+        {
+            fprintf(stderr, "%s: not a hex file\n", path);
+        }
+
+        free(data);
+        return NULL;
+    }
+
+    *length = decoded;
+
+    return data;
+}
@@ -0,0 +1,42 @@
+//
+//  hex.h
+//
+//  Validating hex codec shared by the tools
+//
+//  Decoding and encoding run 32 characters per step with AVX2 when the CPU
+//  has it and fall back to a table lookup otherwise; both paths reject any
+//  character that is not a hex digit.
+//
+
+#ifndef HEX_H
+#define HEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Hex_HasAvx2(void);
+
+// strict: an even number of hex digits and nothing else, returns the number
+// of bytes written to out (length / 2) or -1
+long Hex_Decode(const char *in, size_t length, uint8_t *out);
+
+// like Hex_Decode but skips whitespace anywhere, as the sample inputs may
+// end in a newline or be split over lines
+long Hex_DecodeText(const char *in, size_t length, uint8_t *out);
+
+// uppercase digits, 2 * length characters, no terminator
+void Hex_Encode(const uint8_t *in, size_t length, char *out);
+
+// reads and decodes a whole hex file, returns a malloc'd buffer or NULL after
+// printing the reason
+uint8_t *Hex_LoadFile(const char *path, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
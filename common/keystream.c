@@ -0,0 +1,175 @@
+//
+//  keystream.c
+//
+//  Repeating-key XOR and pad application shared by the tools
+//
+
+#include "keystream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEYSTREAM_X86 1
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+static size_t xorPortable(const uint8_t *in, const uint8_t *key, uint8_t *out, size_t length)
+{
+    size_t i = 0;
+    uint64_t a, b;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        memcpy(&a, in + i, 8);
+        memcpy(&b, key + i, 8);
+        a ^= b;
+        memcpy(out + i, &a, 8);
+    }
+
+    for (; i < length; i++)
+    {
+        out[i] = in[i] ^ key[i];
+    }
+
+    return length;
+}
+
+#ifdef KEYSTREAM_X86
+
+static int hasAvx2(void)
+{
+    static int supported = -1;
+
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return supported;
+}
+
+// bytes up to the first 32-byte boundary of out one at a time, so the stores
+// are aligned; the loads are not, as in and the tile are at other offsets
+static AVX2 size_t xorAvx2(const uint8_t *in, const uint8_t *key, uint8_t *out, size_t length)
+{
+    size_t i = 0, head = (32 - ((uintptr_t)out & 31)) & 31;
+
+    if (length < head + 128)
+    {
+        return 0;
+    }
+
+    for (; i < head; i++)
+    {
+        out[i] = in[i] ^ key[i];
+    }
+
+    for (; i + 128 <= length; i += 128)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(in + i + 32));
+        __m256i a2 = _mm256_loadu_si256((const __m256i *)(in + i + 64));
+        __m256i a3 = _mm256_loadu_si256((const __m256i *)(in + i + 96));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(key + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(key + i + 32));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(key + i + 64));
+        __m256i b3 = _mm256_loadu_si256((const __m256i *)(key + i + 96));
+
+        _mm256_store_si256((__m256i *)(out + i), _mm256_xor_si256(a0, b0));
+        _mm256_store_si256((__m256i *)(out + i + 32), _mm256_xor_si256(a1, b1));
+        _mm256_store_si256((__m256i *)(out + i + 64), _mm256_xor_si256(a2, b2));
+        _mm256_store_si256((__m256i *)(out + i + 96), _mm256_xor_si256(a3, b3));
+    }
+
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(key + i));
+
+        _mm256_store_si256((__m256i *)(out + i), _mm256_xor_si256(a, b));
+    }
+
+    return i;
+}
+
+#endif
+
+static void xorStreams(const uint8_t *in, const uint8_t *key, uint8_t *out, size_t length)
+{
+    size_t done = 0;
+
+#ifdef KEYSTREAM_X86
+    if (hasAvx2())
+    {
+        done = xorAvx2(in, key, out, length);
+    }
+#endif
+
+    xorPortable(in + done, key + done, out + done, length - done);
+}
+
+int Keystream_Init(keystream *stream, const uint8_t *key, size_t keyLength)
+{
+    size_t i;
+
+    memset(stream, 0, sizeof(keystream));
+
+    if (keyLength == 0)
+    {
+        return -1;
+    }
+
+    if (keyLength >= KEYSTREAM_TILE)
+    {
+        stream->tile = key;
+        stream->period = keyLength;
+        return 0;
+    }
+
+    stream->period = (KEYSTREAM_TILE + keyLength - 1) / keyLength * keyLength;
+    stream->owned = (uint8_t *)malloc(stream->period);
+
+    if (stream->owned == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < stream->period; i += keyLength)
+    {
+        memcpy(stream->owned + i, key, keyLength);
+    }
+
+    stream->tile = stream->owned;
+
+    return 0;
+}
+
+void Keystream_Free(keystream *stream)
+{
+    free(stream->owned);
+    memset(stream, 0, sizeof(keystream));
+}
+
+void Keystream_Apply(const keystream *stream, uint64_t position, const uint8_t *in, uint8_t *out, size_t length)
+{
+    size_t offset = position % stream->period, done = 0;
+
+    // the tile holds whole key periods, so each run ends where the key
+    // starts over
+    while (done < length)
+    {
+        size_t run = stream->period - offset;
+
+        if (run > length - done)
+        {
+            run = length - done;
+        }
+
+        xorStreams(in + done, stream->tile + offset, out + done, run);
+        done += run;
+        offset = 0;
+    }
+}
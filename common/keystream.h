@@ -0,0 +1,53 @@
+//
+//  keystream.h
+//
+//  Repeating-key XOR and pad application shared by the tools
+//
+//  The key is tiled once into a buffer of whole key periods at least
+//  KEYSTREAM_TILE bytes long, so applying it is a plain XOR of two streams
+//  that only wraps back to the start of the tile between runs. The XOR runs
+//  128 bytes per step on aligned AVX2 stores when the CPU has it and 8 bytes
+//  per step otherwise. Keys longer than the tile (pads) are used in place.
+//
+//      keystream stream;
+//      Keystream_Init(&stream, key, keyLength);
+//      Keystream_Apply(&stream, offset, in, out, length);
+//      Keystream_Free(&stream);
+//
+//  A keystream is read-only once made, so threads can apply disjoint ranges
+//  of the same input at once.
+//
+
+#ifndef KEYSTREAM_H
+#define KEYSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KEYSTREAM_TILE 4096
+
+typedef struct keystream
+{
+    const uint8_t *tile;    // period bytes: the key repeated, or the key itself
+    size_t period;          // a multiple of the key length
+    uint8_t *owned;         // the tile when it was allocated
+} keystream;
+
+// 0, or -1 for an empty key or when the tile cannot be allocated; the key
+// must outlive the keystream when it is longer than KEYSTREAM_TILE
+int Keystream_Init(keystream *stream, const uint8_t *key, size_t keyLength);
+void Keystream_Free(keystream *stream);
+
+// out[i] = in[i] ^ key[(position + i) % keyLength]; in and out may be the
+// same buffer
+void Keystream_Apply(const keystream *stream, uint64_t position, const uint8_t *in, uint8_t *out, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
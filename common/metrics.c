@@ -0,0 +1,364 @@
+//
+//  metrics.c
+//
+//  Hot-path instrumentation shared by the tools
+//
+
+#include "metrics.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// histogram bucket b counts observations up to 2^(b/4) microseconds
+#define BUCKETS 128
+#define BUCKET_GROWTH 1.189207115
+
+#define FORMAT_JSON 1
+#define FORMAT_PROMETHEUS 2
+
+typedef struct metricsHistogram
+{
+    uint64_t count;
+    double sum;
+    uint64_t buckets[BUCKETS];
+} metricsHistogram;
+
+int metricsEnabled = 0;
+
+static const char *toolName = "";
+static int format = FORMAT_JSON;
+static const char *outputPath = NULL;
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *counterNames[METRICS_MAX];
+static uint64_t counters[METRICS_MAX];
+static int counterCount = 0;
+
+static const char *phaseNames[METRICS_MAX];
+static double phaseSeconds[METRICS_MAX];
+static uint64_t phaseCalls[METRICS_MAX];
+static int phaseCount = 0;
+
+static const char *histogramNames[METRICS_MAX];
+static metricsHistogram histograms[METRICS_MAX];
+static int histogramCount = 0;
+
+static const char *peakNames[METRICS_MAX];
+static uint64_t peaks[METRICS_MAX];
+static int peakCount = 0;
+
+static double bucketLimits[BUCKETS];
+
+double Metrics_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int lookup(const char **names, int *count, const char *name)
+{
+    int i, id = -1;
+
+    pthread_mutex_lock(&registryLock);
+
+    for (i = 0; i < *count; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            id = i;
+            break;
+        }
+    }
+
+    if (id < 0 && *count < METRICS_MAX)
+    {
+        id = (*count)++;
+        names[id] = name;
+    }
+
+    pthread_mutex_unlock(&registryLock);
+
+    // out of slots: fold everything else into the last one
+    return id < 0 ? METRICS_MAX - 1 : id;
+}
+
+int Metrics_Counter(const char *name)
+{
+    return lookup(counterNames, &counterCount, name);
+}
+
+int Metrics_Phase(const char *name)
+{
+    return lookup(phaseNames, &phaseCount, name);
+}
+
+int Metrics_Histogram(const char *name)
+{
+    return lookup(histogramNames, &histogramCount, name);
+}
+
+int Metrics_Peak(const char *name)
+{
+    return lookup(peakNames, &peakCount, name);
+}
+
+void Metrics_Add(int id, uint64_t value)
+{
+    __atomic_fetch_add(&counters[id], value, __ATOMIC_RELAXED);
+}
+
+void Metrics_PhaseAdd(int id, double seconds)
+{
+    pthread_mutex_lock(&registryLock);
+    phaseSeconds[id] += seconds;
+    phaseCalls[id]++;
+    pthread_mutex_unlock(&registryLock);
+}
+
+void Metrics_Observe(int id, double seconds)
+{
+    metricsHistogram *histogram = &histograms[id];
+    int low = 0, high = BUCKETS - 1;
+
+    // first bucket whose limit is not below the observation
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+
+        if (bucketLimits[middle] < seconds)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    __atomic_fetch_add(&histogram->buckets[low], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&registryLock);
+    histogram->sum += seconds;
+    pthread_mutex_unlock(&registryLock);
+}
+
+void Metrics_Raise(int id, uint64_t value)
+{
+    uint64_t seen = __atomic_load_n(&peaks[id], __ATOMIC_RELAXED);
+
+    while (value > seen && !__atomic_compare_exchange_n(&peaks[id], &seen, value, 1,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void writeJson(FILE *out)
+{
+    int i, b;
+
+    fprintf(out, "{\"tool\":\"%s\",\"counters\":{", toolName);
+
+    for (i = 0; i < counterCount; i++)
+    {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", counterNames[i], (unsigned long long)counters[i]);
+    }
+
+    fprintf(out, "},\"phases\":{");
+
+    for (i = 0; i < phaseCount; i++)
+    {
+        fprintf(out, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.9f}", i ? "," : "",
+                phaseNames[i], (unsigned long long)phaseCalls[i], phaseSeconds[i]);
+    }
+
+    fprintf(out, "},\"histograms\":{");
+
+    for (i = 0; i < histogramCount; i++)
+    {
+        int first = 1;
+
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"sum\":%.9f,\"buckets\":[", i ? "," : "",
+                histogramNames[i], (unsigned long long)histograms[i].count, histograms[i].sum);
+
+        // only the buckets that were hit, as [upper bound in seconds, count]
+        for (b = 0; b < BUCKETS; b++)
+        {
+            if (histograms[i].buckets[b])
+            {
+                fprintf(out, "%s[%.9g,%llu]", first ? "" : ",", bucketLimits[b],
+                        (unsigned long long)histograms[i].buckets[b]);
+                first = 0;
+            }
+        }
+
+        fprintf(out, "]}");
+    }
+
+    fprintf(out, "},\"peaks\":{");
+
+    for (i = 0; i < peakCount; i++)
+    {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", peakNames[i], (unsigned long long)peaks[i]);
+    }
+
+    fprintf(out, "}}\n");
+}
+
+static void writePrometheus(FILE *out)
+{
+    int i, b;
+
+    for (i = 0; i < counterCount; i++)
+    {
+        fprintf(out, "# TYPE crypto_%s_total counter\n", counterNames[i]);
+        fprintf(out, "crypto_%s_total{tool=\"%s\"} %llu\n", counterNames[i], toolName,
+                (unsigned long long)counters[i]);
+    }
+
+    if (phaseCount > 0)
+    {
+        fprintf(out, "# TYPE crypto_phase_seconds_total counter\n");
+    }
+
+    for (i = 0; i < phaseCount; i++)
+    {
+        fprintf(out, "crypto_phase_seconds_total{tool=\"%s\",phase=\"%s\"} %.9f\n",
+                toolName, phaseNames[i], phaseSeconds[i]);
+        fprintf(out, "crypto_phase_calls_total{tool=\"%s\",phase=\"%s\"} %llu\n",
+                toolName, phaseNames[i], (unsigned long long)phaseCalls[i]);
+    }
+
+    for (i = 0; i < histogramCount; i++)
+    {
+        uint64_t cumulative = 0;
+        int last = 0;
+
+        for (b = 0; b < BUCKETS; b++)
+        {
+            if (histograms[i].buckets[b])
+            {
+                last = b;
+            }
+        }
+
+        fprintf(out, "# TYPE crypto_%s_seconds histogram\n", histogramNames[i]);
+
+        for (b = 0; b <= last; b++)
+        {
+            cumulative += histograms[i].buckets[b];
+            fprintf(out, "crypto_%s_seconds_bucket{tool=\"%s\",le=\"%.9g\"} %llu\n",
+                    histogramNames[i], toolName, bucketLimits[b], (unsigned long long)cumulative);
+        }
+
+        fprintf(out, "crypto_%s_seconds_bucket{tool=\"%s\",le=\"+Inf\"} %llu\n",
+                histogramNames[i], toolName, (unsigned long long)histograms[i].count);
+        fprintf(out, "crypto_%s_seconds_sum{tool=\"%s\"} %.9f\n", histogramNames[i], toolName, histograms[i].sum);
+        fprintf(out, "crypto_%s_seconds_count{tool=\"%s\"} %llu\n", histogramNames[i], toolName,
+                (unsigned long long)histograms[i].count);
+    }
+
+    for (i = 0; i < peakCount; i++)
+    {
+        fprintf(out, "# TYPE crypto_%s gauge\n", peakNames[i]);
+        fprintf(out, "crypto_%s{tool=\"%s\"} %llu\n", peakNames[i], toolName, (unsigned long long)peaks[i]);
+    }
+}
+
+void Metrics_Report(void)
+{
+    FILE *out = stderr;
+
+    if (!metricsEnabled)
+    {
+        return;
+    }
+
+    if (outputPath != NULL && (out = fopen(outputPath, "w")) == NULL)
+    {
+        perror(outputPath);
+        return;
+    }
+
+    pthread_mutex_lock(&registryLock);
+
+    if (format == FORMAT_PROMETHEUS)
+    {
+        writePrometheus(out);
+    }
+    else
+    {
+        writeJson(out);
+    }
+
+    pthread_mutex_unlock(&registryLock);
+
+    if (out != stderr)
+    {
+        fclose(out);
+    }
+    else
+    {
+        fflush(out);
+    }
+}
+
+// SIGUSR1 is blocked in every thread and taken here, so reports are written
+// from a normal thread instead of a signal handler
+static void *signalThread(void *arg)
+{
+    sigset_t *signals = (sigset_t *)arg;
+    int signal;
+
+    for (;;)
+    {
+        if (sigwait(signals, &signal) == 0)
+        {
+            Metrics_Report();
+        }
+    }
+
+    return NULL;
+}
+
+void Metrics_Init(const char *tool)
+{
+    static sigset_t signals;
+    const char *setting = getenv("CRYPTO_METRICS");
+    pthread_t thread;
+    double limit = 1e-6;
+    int b;
+
+    toolName = tool;
+
+    if (setting == NULL || setting[0] == '\0' || strcmp(setting, "0") == 0)
+    {
+        return;
+    }
+
+    format = strncmp(setting, "prom", 4) == 0 ? FORMAT_PROMETHEUS : FORMAT_JSON;
+    outputPath = getenv("CRYPTO_METRICS_FILE");
+
+    for (b = 0; b < BUCKETS; b++)
+    {
+        bucketLimits[b] = limit;
+        limit *= BUCKET_GROWTH;
+    }
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (pthread_create(&thread, NULL, signalThread, &signals) == 0)
+    {
+        pthread_detach(thread);
+    }
+
+    atexit(Metrics_Report);
+
+    metricsEnabled = 1;
+}
@@ -0,0 +1,153 @@
+//
+//  metrics.h
+//
+//  Hot-path instrumentation shared by the tools
+//
+//  Counters, phase timers, high-water marks and log-bucketed latency
+//  histograms, reported as JSON or Prometheus text when the process exits or
+//  receives SIGUSR1. Reporting is switched on at run time with
+//  CRYPTO_METRICS=json or CRYPTO_METRICS=prometheus (output goes to stderr, or
+//  to the file named by CRYPTO_METRICS_FILE). While it is off every macro
+//  costs one predictable branch, and building with -DNO_METRICS removes them
+//  entirely.
+//
+//  Metric ids are looked up once per call site and cached, so names only
+//  need to be string literals:
+//
+//      METRICS_COUNT("bytes_processed", n);
+//      METRICS_LATENCY("oracle_rtt", seconds);
+//      METRICS_PEAK("job_memory_bytes", used);
+//
+//      metricsTimer timer = METRICS_BEGIN("hex_parse");
+//      ...
+//      METRICS_END(timer);
+//
+//  C++ code can use METRICS_SCOPE("hex_parse") for the enclosing block.
+//
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAX 64
+
+typedef struct metricsTimer
+{
+    int id;
+    double started;
+} metricsTimer;
+
+extern int metricsEnabled;
+
+// reads CRYPTO_METRICS, call at the start of main before creating threads
+void Metrics_Init(const char *tool);
+
+int Metrics_Counter(const char *name);
+int Metrics_Phase(const char *name);
+int Metrics_Histogram(const char *name);
+int Metrics_Peak(const char *name);
+
+void Metrics_Add(int id, uint64_t value);
+void Metrics_PhaseAdd(int id, double seconds);
+void Metrics_Observe(int id, double seconds);
+void Metrics_Raise(int id, uint64_t value);
+
+double Metrics_Now(void);
+
+// writes the report now, also done at exit and on SIGUSR1
+void Metrics_Report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef NO_METRICS
+
+#define METRICS_COUNT(name, value) do { } while (0)
+#define METRICS_LATENCY(name, seconds) do { } while (0)
+#define METRICS_PEAK(name, value) do { } while (0)
+#define METRICS_BEGIN(name) ((metricsTimer){ -1, 0.0 })
+#define METRICS_END(timer) do { (void)(timer); } while (0)
+
+#else
+
+#define METRICS_ID(kind, name, id) \
+    static int id = -1; \
+    if (id < 0) id = Metrics_##kind(name)
+
+#define METRICS_COUNT(name, value) \
+    do { \
+        if (metricsEnabled) { \
+            METRICS_ID(Counter, name, metricsId_); \
+            Metrics_Add(metricsId_, (value)); \
+        } \
+    } while (0)
+
+#define METRICS_LATENCY(name, seconds) \
+    do { \
+        if (metricsEnabled) { \
+            METRICS_ID(Histogram, name, metricsId_); \
+            Metrics_Observe(metricsId_, (seconds)); \
+        } \
+    } while (0)
+
+#define METRICS_PEAK(name, value) \
+    do { \
+        if (metricsEnabled) { \
+            METRICS_ID(Peak, name, metricsId_); \
+            Metrics_Raise(metricsId_, (value)); \
+        } \
+    } while (0)
+
+static inline metricsTimer Metrics_Begin(int *id, const char *name)
+{
+    metricsTimer timer = { -1, 0.0 };
+
+    if (metricsEnabled)
+    {
+        if (*id < 0)
+        {
+            *id = Metrics_Phase(name);
+        }
+
+        timer.id = *id;
+        timer.started = Metrics_Now();
+    }
+
+    return timer;
+}
+
+#define METRICS_BEGIN(name) \
+    __extension__ ({ static int metricsId_ = -1; Metrics_Begin(&metricsId_, name); })
+
+#define METRICS_END(timer) \
+    do { \
+        if ((timer).id >= 0) Metrics_PhaseAdd((timer).id, Metrics_Now() - (timer).started); \
+    } while (0)
+
+#endif
+
+#ifdef __cplusplus
+
+class MetricsScope
+{
+public:
+    explicit MetricsScope(metricsTimer timer) : timer(timer) {}
+    ~MetricsScope() { METRICS_END(timer); }
+
+private:
+    metricsTimer timer;
+};
+
+#define METRICS_SCOPE_JOIN(a, b) a##b
+#define METRICS_SCOPE_NAME(line) METRICS_SCOPE_JOIN(metricsScope_, line)
+#define METRICS_SCOPE(name) MetricsScope METRICS_SCOPE_NAME(__LINE__)(METRICS_BEGIN(name))
+
+#endif
+
+#endif
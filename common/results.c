@@ -0,0 +1,600 @@
+//
+//  results.c
+//
+//  Persistent, content-addressed cache of recovered keys
+//
+
+#include "results.h"
+#include "hex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_PRIME 0x9E3779B97F4A7C15ULL
+#define KEY_BUCKETS 256
+#define TYPE_COUNT 3
+#define INDEXED_KEY_LENGTH 256      // longer keys (pads) are ranked by a scan
+
+typedef struct posting
+{
+    struct resultNode *node;
+    struct posting *next;
+} posting;
+
+typedef struct resultNode
+{
+    resultEntry entry;                  // first, so entries and nodes convert
+    struct resultNode *nextInput;       // same input bucket
+    struct resultNode *olderKey;        // previous distinct key of the same type and length
+    struct resultNode *olderAny;        // previous distinct key of the same type
+    posting *postings;                  // one per key byte, when its length is indexed
+    uint64_t order;                     // newer keys rank first among equals
+    uint64_t stamp;                     // Results_Rank call that last counted it
+    size_t matches;
+    size_t matchedColumn;               // the last column counted, plus one
+} resultNode;
+
+typedef struct keyHead
+{
+    int type;
+    size_t keyLength;
+    resultNode *newest;
+    posting **columns;                  // keyLength * 256 lists: the keys with byte b at column j
+    struct keyHead *next;
+} keyHead;
+
+struct resultCache
+{
+    FILE *file;
+    resultNode **inputs;
+    size_t capacity;
+    int size;
+    keyHead *keys[KEY_BUCKETS];
+    resultNode *newest[TYPE_COUNT];
+    uint64_t keyCount;
+    uint64_t stamp;
+    resultNode **touched;               // scratch of Results_Rank
+    size_t touchedCapacity;
+};
+
+static const char *typeNames[TYPE_COUNT] = { "", "xor", "pad" };
+
+static uint64_t mixWord(uint64_t lane, uint64_t word)
+{
+    lane = (lane ^ word) * HASH_PRIME;
+    return lane ^ (lane >> 32);
+}
+
+uint64_t Results_Hash(const void *data, size_t length, uint64_t seed)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t lanes[4] = { seed, seed + 1, seed + 2, seed + 3 }, word, hash;
+    size_t i = 0;
+    int lane;
+
+    // four chains of multiplies in flight instead of one
+    for (; i + 32 <= length; i += 32)
+    {
+        for (lane = 0; lane < 4; lane++)
+        {
+            memcpy(&word, bytes + i + 8 * lane, sizeof(word));
+            lanes[lane] = mixWord(lanes[lane], word);
+        }
+    }
+
+    for (; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, bytes + i, sizeof(word));
+        lanes[0] = mixWord(lanes[0], word);
+    }
+
+    if (i < length)
+    {
+        word = 0;
+        memcpy(&word, bytes + i, length - i);
+        lanes[1] = mixWord(lanes[1], word);
+    }
+
+    hash = mixWord(length * HASH_PRIME, lanes[0]);
+
+    for (lane = 1; lane < 4; lane++)
+    {
+        hash = mixWord(hash, lanes[lane]);
+    }
+
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+
+    return hash ^ (hash >> 32);
+}
+
+static size_t inputSlot(const resultCache *cache, uint64_t hash)
+{
+    return hash & (cache->capacity - 1);
+}
+
+static keyHead **keySlot(resultCache *cache, int type, size_t keyLength)
+{
+    keyHead **head = &cache->keys[(keyLength * TYPE_COUNT + type) % KEY_BUCKETS];
+
+    while (*head != NULL && ((*head)->type != type || (*head)->keyLength != keyLength))
+    {
+        head = &(*head)->next;
+    }
+
+    return head;
+}
+
+static int grow(resultCache *cache)
+{
+    size_t capacity = cache->capacity ? cache->capacity * 2 : 256, i;
+    resultNode **inputs = (resultNode **)calloc(capacity, sizeof(resultNode *));
+    resultNode **old = cache->inputs;
+    size_t oldCapacity = cache->capacity;
+
+    if (inputs == NULL)
+    {
+        return -1;
+    }
+
+    cache->inputs = inputs;
+    cache->capacity = capacity;
+
+    for (i = 0; i < oldCapacity; i++)
+    {
+        resultNode *node = old[i];
+
+        while (node != NULL)
+        {
+            resultNode *next = node->nextInput;
+            size_t slot = inputSlot(cache, node->entry.hash);
+
+            node->nextInput = inputs[slot];
+            inputs[slot] = node;
+            node = next;
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+// returns 1 when the result was new
+static int insert(resultCache *cache, int type, uint64_t hash, uint64_t length,
+                  const uint8_t *key, size_t keyLength, double confidence)
+{
+    resultNode *node, *same;
+    keyHead **head;
+    size_t slot;
+
+    if (type <= 0 || type >= TYPE_COUNT || keyLength == 0)
+    {
+        return -1;
+    }
+
+    for (node = cache->inputs ? cache->inputs[inputSlot(cache, hash)] : NULL; node != NULL; node = node->nextInput)
+    {
+        if (node->entry.type == type && node->entry.hash == hash && node->entry.length == length &&
+            node->entry.keyLength == keyLength && memcmp(node->entry.key, key, keyLength) == 0)
+        {
+            return 0;
+        }
+    }
+
+    if ((size_t)cache->size + 1 > cache->capacity && grow(cache) != 0)
+    {
+        return -1;
+    }
+
+    node = (resultNode *)calloc(1, sizeof(resultNode));
+
+    if (node == NULL || (node->entry.key = (uint8_t *)malloc(keyLength)) == NULL)
+    {
+        free(node);
+        return -1;
+    }
+
+    node->entry.type = type;
+    node->entry.hash = hash;
+    node->entry.length = length;
+    node->entry.keyLength = keyLength;
+    node->entry.confidence = confidence;
+    memcpy(node->entry.key, key, keyLength);
+
+    slot = inputSlot(cache, hash);
+    node->nextInput = cache->inputs[slot];
+    cache->inputs[slot] = node;
+    cache->size++;
+
+    // a key recovered again from another input is only listed once; when
+    // the length is indexed only the keys with the same first byte are checked
+    head = keySlot(cache, type, keyLength);
+
+    if (*head != NULL && (*head)->columns != NULL)
+    {
+        posting *match;
+
+        for (match = (*head)->columns[key[0]]; match != NULL; match = match->next)
+        {
+            if (memcmp(match->node->entry.key, key, keyLength) == 0)
+            {
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        for (same = *head ? (*head)->newest : NULL; same != NULL; same = same->olderKey)
+        {
+            if (memcmp(same->entry.key, key, keyLength) == 0)
+            {
+                return 1;
+            }
+        }
+    }
+
+    if (*head == NULL && (*head = (keyHead *)calloc(1, sizeof(keyHead))) != NULL)
+    {
+        (*head)->type = type;
+        (*head)->keyLength = keyLength;
+
+        if (keyLength <= INDEXED_KEY_LENGTH)
+        {
+            (*head)->columns = (posting **)calloc(keyLength * 256, sizeof(posting *));
+        }
+    }
+
+    if (*head != NULL)
+    {
+        node->olderKey = (*head)->newest;
+        (*head)->newest = node;
+        node->olderAny = cache->newest[type];
+        cache->newest[type] = node;
+        node->order = ++cache->keyCount;
+
+        // without its postings the key would be missed, so the length goes
+        // back to being scanned
+        if ((*head)->columns != NULL && (node->postings = (posting *)calloc(keyLength, sizeof(posting))) == NULL)
+        {
+            free((*head)->columns);
+            (*head)->columns = NULL;
+        }
+
+        if ((*head)->columns != NULL)
+        {
+            for (slot = 0; slot < keyLength; slot++)
+            {
+                posting **list = &(*head)->columns[slot * 256 + key[slot]];
+
+                node->postings[slot].node = node;
+                node->postings[slot].next = *list;
+                *list = &node->postings[slot];
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void parseLine(resultCache *cache, char *line)
+{
+    char typeName[8], *keyHex, *end;
+    unsigned long long hash, length;
+    double confidence;
+    uint8_t *key;
+    size_t hexLength;
+    int type, offset;
+
+    if (sscanf(line, "%7s %16llx %llu %n", typeName, &hash, &length, &offset) != 3)
+    {
+        return;
+    }
+
+    for (type = 1; type < TYPE_COUNT && strcmp(typeName, typeNames[type]) != 0; type++);
+
+    keyHex = line + offset;
+    end = strchr(keyHex, ' ');
+
+    if (type == TYPE_COUNT || end == NULL || sscanf(end, "%lf", &confidence) != 1)
+    {
+        return;
+    }
+
+    hexLength = end - keyHex;
+    key = (uint8_t *)malloc(hexLength / 2 + 1);
+
+    if (key != NULL && Hex_Decode(keyHex, hexLength, key) > 0)
+    {
+        insert(cache, type, hash, length, key, hexLength / 2, confidence);
+    }
+
+    free(key);
+}
+
+resultCache *Results_Open(const char *path)
+{
+    resultCache *cache = (resultCache *)calloc(1, sizeof(resultCache));
+    char *line = NULL;
+    size_t lineCapacity = 0;
+
+    if (cache == NULL || grow(cache) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    if (path == NULL)
+    {
+        return cache;
+    }
+
+    cache->file = fopen(path, "a+");
+
+    if (cache->file == NULL)
+    {
+        perror(path);
+        Results_Close(cache);
+        return NULL;
+    }
+
+    rewind(cache->file);
+
+    while (getline(&line, &lineCapacity, cache->file) > 0)
+    {
+        parseLine(cache, line);
+    }
+
+    free(line);
+
+    return cache;
+}
+
+void Results_Close(resultCache *cache)
+{
+    size_t i;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    if (cache->file != NULL)
+    {
+        fclose(cache->file);
+    }
+
+    for (i = 0; i < cache->capacity; i++)
+    {
+        resultNode *node = cache->inputs[i];
+
+        while (node != NULL)
+        {
+            resultNode *next = node->nextInput;
+
+            free(node->postings);
+            free(node->entry.key);
+            free(node);
+            node = next;
+        }
+    }
+
+    for (i = 0; i < KEY_BUCKETS; i++)
+    {
+        while (cache->keys[i] != NULL)
+        {
+            keyHead *next = cache->keys[i]->next;
+
+            free(cache->keys[i]->columns);
+            free(cache->keys[i]);
+            cache->keys[i] = next;
+        }
+    }
+
+    free(cache->inputs);
+    free(cache->touched);
+    free(cache);
+}
+
+const resultEntry *Results_Find(resultCache *cache, int type, uint64_t hash, uint64_t length,
+                                const resultEntry *after)
+{
+    const resultNode *node = after ? ((const resultNode *)after)->nextInput : cache->inputs[inputSlot(cache, hash)];
+
+    for (; node != NULL; node = node->nextInput)
+    {
+        if (node->entry.type == type && node->entry.hash == hash && node->entry.length == length)
+        {
+            return &node->entry;
+        }
+    }
+
+    return NULL;
+}
+
+const resultEntry *Results_Keys(resultCache *cache, int type, size_t keyLength, const resultEntry *after)
+{
+    const resultNode *node = (const resultNode *)after;
+
+    if (type <= 0 || type >= TYPE_COUNT)
+    {
+        return NULL;
+    }
+
+    if (keyLength == 0)
+    {
+        node = node ? node->olderAny : cache->newest[type];
+    }
+    else if (node != NULL)
+    {
+        node = node->olderKey;
+    }
+    else
+    {
+        keyHead *head = *keySlot(cache, type, keyLength);
+        node = head ? head->newest : NULL;
+    }
+
+    return node ? &node->entry : NULL;
+}
+
+int Results_KeyLengths(resultCache *cache, int type, size_t *lengths, int capacity)
+{
+    keyHead *head;
+    int count = 0, i;
+
+    for (i = 0; i < KEY_BUCKETS; i++)
+    {
+        for (head = cache->keys[i]; head != NULL; head = head->next)
+        {
+            if (head->type == type && head->newest != NULL)
+            {
+                if (count < capacity)
+                {
+                    lengths[count] = head->keyLength;
+                }
+
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+// counts a match for node in column, once however many guesses it matches,
+// remembering the node the first time in this call
+static int countMatch(resultCache *cache, resultNode *node, size_t column, size_t *touched)
+{
+    if (node->stamp != cache->stamp)
+    {
+        if (*touched == cache->touchedCapacity)
+        {
+            size_t capacity = cache->touchedCapacity ? cache->touchedCapacity * 2 : 64;
+            resultNode **grown = (resultNode **)realloc(cache->touched, capacity * sizeof(resultNode *));
+
+            if (grown == NULL)
+            {
+                return -1;
+            }
+
+            cache->touched = grown;
+            cache->touchedCapacity = capacity;
+        }
+
+        node->stamp = cache->stamp;
+        node->matches = 0;
+        node->matchedColumn = 0;
+        cache->touched[(*touched)++] = node;
+    }
+
+    if (node->matchedColumn != column + 1)
+    {
+        node->matches++;
+        node->matchedColumn = column + 1;
+    }
+
+    return 0;
+}
+
+static int byRank(const void *a, const void *b)
+{
+    const resultNode *x = *(const resultNode **)a, *y = *(const resultNode **)b;
+
+    if (x->matches != y->matches)
+    {
+        return x->matches > y->matches ? -1 : 1;
+    }
+
+    return x->order > y->order ? -1 : x->order < y->order;
+}
+
+int Results_Rank(resultCache *cache, int type, size_t keyLength, size_t columns, const uint8_t *guesses,
+                 int perColumn, size_t minMatches, const resultEntry **ranked, int capacity)
+{
+    keyHead *head;
+    size_t touched = 0, column, i;
+    int count = 0, guess;
+
+    if (type <= 0 || type >= TYPE_COUNT || keyLength == 0 || columns > keyLength ||
+        (head = *keySlot(cache, type, keyLength)) == NULL)
+    {
+        return 0;
+    }
+
+    cache->stamp++;
+
+    for (column = 0; column < columns; column++)
+    {
+        for (guess = 0; guess < perColumn; guess++)
+        {
+            uint8_t byte = guesses[column * perColumn + guess];
+
+            if (head->columns != NULL)
+            {
+                posting *match;
+
+                for (match = head->columns[column * 256 + byte]; match != NULL; match = match->next)
+                {
+                    if (countMatch(cache, match->node, column, &touched) != 0)
+                    {
+                        return -1;
+                    }
+                }
+            }
+            else
+            {
+                resultNode *node;
+
+                for (node = head->newest; node != NULL; node = node->olderKey)
+                {
+                    if (node->entry.key[column] == byte && countMatch(cache, node, column, &touched) != 0)
+                    {
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    qsort(cache->touched, touched, sizeof(resultNode *), byRank);
+
+    for (i = 0; i < touched && count < capacity && cache->touched[i]->matches >= minMatches; i++)
+    {
+        ranked[count++] = &cache->touched[i]->entry;
+    }
+
+    return count;
+}
+
+int Results_Store(resultCache *cache, int type, uint64_t hash, uint64_t length,
+                  const uint8_t *key, size_t keyLength, double confidence)
+{
+    int ret = insert(cache, type, hash, length, key, keyLength, confidence);
+    char *hex;
+
+    if (ret != 1 || cache->file == NULL)
+    {
+        return ret < 0 ? -1 : 0;
+    }
+
+    if ((hex = (char *)malloc(2 * keyLength + 1)) == NULL)
+    {
+        return -1;
+    }
+
+    Hex_Encode(key, keyLength, hex);
+    hex[2 * keyLength] = '\0';
+
+    fprintf(cache->file, "%s %016llX %llu %s %.6f\n", typeNames[type], (unsigned long long)hash,
+            (unsigned long long)length, hex, confidence);
+    fflush(cache->file);
+    free(hex);
+
+    return 0;
+}
+
+int Results_Size(resultCache *cache)
+{
+    return cache->size;
+}
@@ -0,0 +1,80 @@
+//
+//  results.h
+//
+//  Persistent, content-addressed cache of recovered keys
+//
+//  Results are found two ways: by a hash of the input they were recovered
+//  from, which answers an input seen before without any work, and by the
+//  type and length of the key, which gives the keys worth trying first on
+//  a new input before cracking it. Keys of one length are also indexed by
+//  their byte in each column, so a fingerprint of a new input (the likely
+//  key bytes of its columns) ranks them without decrypting anything, and
+//  only the best few need checking. The cache file holds one
+//  "<type> <input hash> <input length> <key hex> <confidence>" line per
+//  result and new results are appended as soon as they are stored.
+//
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RESULT_XOR 1        // repeating-key XOR key, from vigenere or crackd
+#define RESULT_PAD 2        // many-time pad, from otp
+
+typedef struct resultCache resultCache;
+
+typedef struct resultEntry
+{
+    int type;
+    uint64_t hash;          // of the input
+    uint64_t length;        // of the input
+    uint8_t *key;
+    size_t keyLength;
+    double confidence;
+} resultEntry;
+
+// 64-bit hash over four independent lanes, seed chains several buffers
+uint64_t Results_Hash(const void *data, size_t length, uint64_t seed);
+
+// opens (or creates) the cache file, NULL path gives an in-memory cache
+resultCache *Results_Open(const char *path);
+void Results_Close(resultCache *cache);
+
+// the results stored for an input, newest first: NULL after starts the walk,
+// the entry returned last continues it
+const resultEntry *Results_Find(resultCache *cache, int type, uint64_t hash, uint64_t length,
+                                const resultEntry *after);
+
+// every distinct key of a type and length (0 for any length), newest first,
+// walked like Results_Find
+const resultEntry *Results_Keys(resultCache *cache, int type, size_t keyLength, const resultEntry *after);
+
+// the distinct key lengths of a type, in no order; returns how many there
+// are and writes up to capacity of them
+int Results_KeyLengths(resultCache *cache, int type, size_t *lengths, int capacity);
+
+// the keys of a type and length that match the most columns of a
+// fingerprint, best then newest first: guesses holds perColumn likely bytes
+// for each of the first columns columns of the key, and a key matches a
+// column when its byte there is one of them. Keys matching fewer than
+// minMatches columns are left out. Returns how many entries went to ranked,
+// at most capacity, or -1.
+int Results_Rank(resultCache *cache, int type, size_t keyLength, size_t columns, const uint8_t *guesses,
+                 int perColumn, size_t minMatches, const resultEntry **ranked, int capacity);
+
+int Results_Store(resultCache *cache, int type, uint64_t hash, uint64_t length,
+                  const uint8_t *key, size_t keyLength, double confidence);
+
+int Results_Size(resultCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
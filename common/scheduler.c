@@ -0,0 +1,399 @@
+//
+//  scheduler.c
+//
+//  Rate-limited multi-job scheduler for oracle attacks
+//
+
+#include "scheduler.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct sched_job
+{
+    sched_step step;
+    void *job;
+    int busy;
+    int finished;
+    int retries;
+} sched_job;
+
+struct sched
+{
+    sched_config config;
+    sched_transport transport;
+
+    sched_job *jobs;
+    size_t job_count;
+    size_t job_capacity;
+    size_t next_job;
+    size_t remaining;
+
+    // AIMD congestion window
+    double window;
+    int inflight;
+    double last_decrease;
+
+    // token bucket
+    pthread_mutex_t bucket_lock;
+    double tokens;
+    double last_refill;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    sched_stats stats;
+    double started;
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepFor(double seconds)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+void Sched_DefaultConfig(sched_config *config)
+{
+    config->rate = 0.0;
+    config->burst = 8.0;
+    config->min_inflight = 1;
+    config->max_inflight = 8;
+    config->latency_target = 0.5;
+    config->max_retries = 8;
+}
+
+sched *Sched_Create(const sched_config *config, const sched_transport *transport)
+{
+    sched *scheduler = calloc(1, sizeof(sched));
+
+    if (scheduler == NULL)
+    {
+        return NULL;
+    }
+
+    scheduler->config = *config;
+    scheduler->transport = *transport;
+
+    if (scheduler->config.min_inflight < 1)
+    {
+        scheduler->config.min_inflight = 1;
+    }
+
+    if (scheduler->config.max_inflight < scheduler->config.min_inflight)
+    {
+        scheduler->config.max_inflight = scheduler->config.min_inflight;
+    }
+
+    if (scheduler->config.burst < 1.0)
+    {
+        scheduler->config.burst = 1.0;
+    }
+
+    // start slow and let additive increase find the server's limit
+    scheduler->window = scheduler->config.min_inflight;
+    scheduler->tokens = scheduler->config.burst;
+
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_mutex_init(&scheduler->bucket_lock, NULL);
+    pthread_cond_init(&scheduler->changed, NULL);
+
+    return scheduler;
+}
+
+void Sched_Destroy(sched *scheduler)
+{
+    if (scheduler == NULL)
+    {
+        return;
+    }
+
+    pthread_cond_destroy(&scheduler->changed);
+    pthread_mutex_destroy(&scheduler->bucket_lock);
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler->jobs);
+    free(scheduler);
+}
+
+int Sched_Add(sched *scheduler, sched_step step, void *job)
+{
+    if (scheduler->job_count == scheduler->job_capacity)
+    {
+        size_t capacity = scheduler->job_capacity ? scheduler->job_capacity * 2 : 64;
+        sched_job *jobs = realloc(scheduler->jobs, capacity * sizeof(sched_job));
+
+        if (jobs == NULL)
+        {
+            return -1;
+        }
+
+        scheduler->jobs = jobs;
+        scheduler->job_capacity = capacity;
+    }
+
+    sched_job *entry = &scheduler->jobs[scheduler->job_count++];
+    memset(entry, 0, sizeof(sched_job));
+    entry->step = step;
+    entry->job = job;
+
+    scheduler->remaining++;
+
+    return 0;
+}
+
+static void takeToken(sched *scheduler)
+{
+    if (scheduler->config.rate <= 0.0)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&scheduler->bucket_lock);
+
+        double t = now();
+        scheduler->tokens += (t - scheduler->last_refill) * scheduler->config.rate;
+        scheduler->last_refill = t;
+
+        if (scheduler->tokens > scheduler->config.burst)
+        {
+            scheduler->tokens = scheduler->config.burst;
+        }
+
+        if (scheduler->tokens >= 1.0)
+        {
+            scheduler->tokens -= 1.0;
+            pthread_mutex_unlock(&scheduler->bucket_lock);
+            return;
+        }
+
+        double wait = (1.0 - scheduler->tokens) / scheduler->config.rate;
+        pthread_mutex_unlock(&scheduler->bucket_lock);
+
+        sleepFor(wait);
+    }
+}
+
+// round-robin over the jobs so every job gets its share of the connections
+static sched_job *nextJob(sched *scheduler)
+{
+    size_t i;
+
+    for (i = 0; i < scheduler->job_count; i++)
+    {
+        sched_job *job = &scheduler->jobs[(scheduler->next_job + i) % scheduler->job_count];
+
+        if (!job->busy && !job->finished)
+        {
+            scheduler->next_job = (scheduler->next_job + i + 1) % scheduler->job_count;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static void congestion(sched *scheduler, double t)
+{
+    // halve at most once per round trip, a burst of slow answers is one event
+    if (t - scheduler->last_decrease < scheduler->stats.latency_avg)
+    {
+        return;
+    }
+
+    scheduler->window /= 2.0;
+
+    if (scheduler->window < scheduler->config.min_inflight)
+    {
+        scheduler->window = scheduler->config.min_inflight;
+    }
+
+    scheduler->last_decrease = t;
+}
+
+static void *worker(void *arg)
+{
+    sched *scheduler = arg;
+    int conn = -1;
+
+    pthread_mutex_lock(&scheduler->lock);
+
+    for (;;)
+    {
+        sched_job *job = NULL;
+
+        while (scheduler->remaining > 0 &&
+               (scheduler->inflight >= (int)scheduler->window ||
+                (job = nextJob(scheduler)) == NULL))
+        {
+            pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+        }
+
+        if (scheduler->remaining == 0)
+        {
+            break;
+        }
+
+        job->busy = 1;
+        scheduler->inflight++;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        if (conn < 0)
+        {
+            conn = scheduler->transport.connect(scheduler->transport.ctx);
+        }
+
+        int result = SCHED_STEP_ERROR;
+        size_t bytes = 0;
+        double sent = 0.0, latency = 0.0;
+
+        if (conn >= 0)
+        {
+            takeToken(scheduler);
+            sent = now();
+            result = job->step(job->job, conn, &bytes);
+            latency = now() - sent;
+        }
+
+        pthread_mutex_lock(&scheduler->lock);
+        scheduler->inflight--;
+        job->busy = 0;
+
+        if (conn >= 0)
+        {
+            scheduler->stats.queries++;
+
+            if (scheduler->stats.latency_avg == 0.0)
+            {
+                scheduler->stats.latency_avg = latency;
+            }
+            else
+            {
+                scheduler->stats.latency_avg = 0.875 * scheduler->stats.latency_avg + 0.125 * latency;
+            }
+        }
+
+        scheduler->stats.bytes += bytes;
+
+        if (result == SCHED_STEP_ERROR)
+        {
+            scheduler->stats.errors++;
+            congestion(scheduler, now());
+
+            if (conn >= 0)
+            {
+                scheduler->transport.disconnect(scheduler->transport.ctx, conn);
+                conn = -1;
+            }
+
+            if (++job->retries > scheduler->config.max_retries)
+            {
+                result = SCHED_STEP_FAIL;
+            }
+        }
+        else
+        {
+            job->retries = 0;
+
+            if (latency > scheduler->config.latency_target)
+            {
+                congestion(scheduler, sent + latency);
+            }
+            else if (scheduler->window < scheduler->config.max_inflight)
+            {
+                scheduler->window += 1.0 / scheduler->window;
+
+                if (scheduler->window > scheduler->config.max_inflight)
+                {
+                    scheduler->window = scheduler->config.max_inflight;
+                }
+            }
+        }
+
+        if (result == SCHED_STEP_DONE || result == SCHED_STEP_FAIL)
+        {
+            job->finished = 1;
+            scheduler->remaining--;
+
+            if (result == SCHED_STEP_DONE)
+            {
+                scheduler->stats.jobs_done++;
+            }
+            else
+            {
+                scheduler->stats.jobs_failed++;
+            }
+        }
+
+        pthread_cond_broadcast(&scheduler->changed);
+    }
+
+    pthread_cond_broadcast(&scheduler->changed);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    if (conn >= 0)
+    {
+        scheduler->transport.disconnect(scheduler->transport.ctx, conn);
+    }
+
+    return NULL;
+}
+
+int Sched_Run(sched *scheduler)
+{
+    int count = scheduler->config.max_inflight;
+    pthread_t *threads = calloc(count, sizeof(pthread_t));
+    int i, started = 0;
+
+    if (threads == NULL)
+    {
+        return -1;
+    }
+
+    scheduler->started = now();
+    scheduler->last_refill = scheduler->started;
+
+    for (i = 0; i < count; i++)
+    {
+        if (pthread_create(&threads[i], NULL, worker, scheduler) == 0)
+        {
+            started++;
+        }
+    }
+
+    if (started == 0)
+    {
+        free(threads);
+        return -1;
+    }
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+
+    scheduler->stats.elapsed = now() - scheduler->started;
+
+    return (int)scheduler->stats.jobs_failed;
+}
+
+void Sched_Stats(sched *scheduler, sched_stats *stats)
+{
+    pthread_mutex_lock(&scheduler->lock);
+    *stats = scheduler->stats;
+    stats->inflight = scheduler->window;
+    pthread_mutex_unlock(&scheduler->lock);
+}
@@ -0,0 +1,80 @@
+//
+//  scheduler.h
+//
+//  Rate-limited multi-job scheduler for oracle attacks
+//
+//  Jobs are advanced one oracle query at a time. Queries are drawn from a
+//  global token bucket and the number of queries in flight is tuned with
+//  AIMD (additive increase, multiplicative decrease) from the observed
+//  round-trip latency and errors. Every worker owns one oracle connection
+//  and picks jobs round-robin, so connections are shared fairly.
+//
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// return values of a job step
+#define SCHED_STEP_MORE   1    // query answered, job needs more queries
+#define SCHED_STEP_DONE   0    // query answered, job finished
+#define SCHED_STEP_ERROR -1    // connection problem, query will be retried
+#define SCHED_STEP_FAIL  -2    // job cannot finish, give up on it
+
+// performs exactly one oracle query for the job over the given connection
+// and adds the number of recovered bytes to *bytes
+typedef int (*sched_step)(void *job, int conn, size_t *bytes);
+
+typedef struct sched_transport
+{
+    int (*connect)(void *ctx);              // returns a connection or -1
+    void (*disconnect)(void *ctx, int conn);
+    void *ctx;
+} sched_transport;
+
+typedef struct sched_config
+{
+    double rate;            // queries per second, 0 for unlimited
+    double burst;           // token bucket capacity
+    int min_inflight;
+    int max_inflight;       // also the number of connections opened
+    double latency_target;  // seconds, slower answers count as congestion
+    int max_retries;        // per job, consecutive connection errors
+} sched_config;
+
+typedef struct sched_stats
+{
+    size_t queries;
+    size_t errors;
+    size_t bytes;
+    size_t jobs_done;
+    size_t jobs_failed;
+    double elapsed;         // seconds spent in Sched_Run
+    double inflight;        // current congestion window
+    double latency_avg;     // smoothed round trip in seconds
+} sched_stats;
+
+typedef struct sched sched;
+
+void Sched_DefaultConfig(sched_config *config);
+
+sched *Sched_Create(const sched_config *config, const sched_transport *transport);
+void Sched_Destroy(sched *scheduler);
+
+// jobs must be added before Sched_Run, the scheduler does not own them
+int Sched_Add(sched *scheduler, sched_step step, void *job);
+
+// runs until every job is done or failed, returns the number of failed jobs
+int Sched_Run(sched *scheduler);
+
+void Sched_Stats(sched *scheduler, sched_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 //
 
 #include <cstdlib>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -15,6 +16,12 @@
 #include <iomanip>
 #include <math.h>
 
+#include "../common/metrics.h"
+#include "../common/hex.h"
+#include "../common/corpusfile.h"
+#include "../common/crackers.h"
+#include "../common/results.h"
+
 using namespace std;
 
 const int ARGUMENT_COUNT = 4;
@@ -22,181 +29,162 @@ const int MIN_KEY_LEN = 1;
 const int MAX_KEY_LEN = 13;
 const int INVALID_KEY = -1;
 
+// a known key is taken when it scores at least this share of what it scored
+// on the ciphertext it was recovered from
+const double VERIFY_SHARE = 0.9;
+
+// known keys scored after ranking them by fingerprint, and the share of
+// columns a key must match to be scored at all
+const int RANKED_KEYS = 8;
+const int MATCH_SHARE = 4;
+
 typedef vector<string> stringVector;
-typedef vector<int> intVector;
-typedef unordered_map<int, double> intDoubleMap;
+typedef vector<uint8_t> byteVector;
 
-fstream openFile(string path, ios_base::openmode mode)
+// key lengths and columns are spread over the shared thread pool
+crackers::options parallelOptions()
 {
-    fstream stream;
-    
-    stream.open(path, mode);
+    crackers::options opts;
+    opts.pool = Executor_Default();
+    return opts;
+}
+
+bool openFile(fstream *stream, string path, ios_base::openmode mode)
+{
+    stream->open(path, mode);
     
-    if (!stream.is_open())
+    if (!stream->is_open())
     {
         cerr << "Could not open file \"" << path << "\"\n";
-        exit(EXIT_FAILURE);
+        return false;
     }
     
-    return stream;
+    return true;
 }
 
-intVector loadInputFile(string path)
+bool loadInputFile(string path, byteVector *bytes)
 {
     cout << "Trying to load input file \"" << path << "\"";
     cout.flush();
     
-    fstream inputFile = openFile(path, ios_base::in);
-    
-    stringstream buffer;
-    buffer << inputFile.rdbuf();
-    
-    intVector bytes;
+    METRICS_SCOPE("hex_parse");
     
-    string word;
-    
-    while(buffer >> setw(2) >> word)
+    if (CorpusFile_Is(path.c_str()))
     {
-        stringstream converter;
+        // packed corpus, the first record is the ciphertext
+        corpusFile *corpus = CorpusFile_Open(path.c_str());
+        corpusRecord record;
         
-        unsigned int temp;
-        converter << hex << word;
-        converter >> temp;
-        bytes.push_back(temp);
-    }
-    
-    cout << "\t\tDone\n";
-    cout << bytes.size() << " total bytes\n\n";
-    cout.flush();
-    
-    inputFile.close();
-    return bytes;
-}
-
-void updateFrequencyDistribution(intDoubleMap *frequencyDistribution, int value)
-{
-    auto character = frequencyDistribution->find(value);
-    
-    if (character == frequencyDistribution->end())
-    {
-        // new character
-        frequencyDistribution->insert(make_pair(value, 1.0));
+        if (corpus == NULL || CorpusFile_Record(corpus, 0, &record) != 0)
+        {
+            cerr << "Could not read a record from \"" << path << "\"\n";
+            CorpusFile_Close(corpus);
+            return false;
+        }
+        
+        bytes->assign(record.data, record.data + record.length);
+        CorpusFile_Close(corpus);
     }
     else
     {
-        character->second++;
-    }
-}
-
-double calculateFrequencyDistribution(intDoubleMap *frequency)
-{
-    double frequencyDistribution = 0.0;
-    
-    for (auto it = frequency->begin(); it != frequency->end(); ++it)
-    {
-        frequencyDistribution += pow(it->second, 2.0);
+        size_t length;
+        uint8_t *data = Hex_LoadFile(path.c_str(), &length);
+        
+        if (data == NULL)
+        {
+            return false;
+        }
+        
+        bytes->assign(data, data + length);
+        free(data);
     }
     
-    return frequencyDistribution;
-}
-
-int calculatePercentileDistribution(intDoubleMap *frequency)
-{
-    int totalLetterFrequencies = 0;
-    
-    for (auto it = frequency->begin(); it != frequency->end(); ++it)
-    {
-        totalLetterFrequencies += it->second;
-    }
+    METRICS_COUNT("bytes_processed", bytes->size());
     
-    for (auto it = frequency->begin(); it != frequency->end(); ++it)
-    {
-        it->second /= totalLetterFrequencies;
-    }
+    cout << "\t\tDone\n";
+    cout << bytes->size() << " total bytes\n\n";
+    cout.flush();
     
-    return totalLetterFrequencies;
+    return true;
 }
 
-intDoubleMap calculateLetterFrequency(stringVector *dictionary)
+crackers::languageModel calculateLetterFrequency(stringVector *dictionary)
 {
     cout << "Importing and calculating letter frequency";
     cout.flush();
     
-    intDoubleMap letterFrequencies;
+    METRICS_SCOPE("histogram");
+    
+    crackers::languageModel letterFrequencies;
     
     for (auto it = dictionary->begin(); it != dictionary->end(); ++it)
     {
-        string line = *it;
-        
-        for (auto its = line.begin(); its != line.end(); ++its)
-        {
-            updateFrequencyDistribution(&letterFrequencies, *its);
-        }
+        crackers::addLanguageSample(&letterFrequencies, *it);
     }
     
-    int totalLetterFrequencies = calculatePercentileDistribution(&letterFrequencies);
+    crackers::finishLanguageModel(&letterFrequencies);
+    
+    int uniqueCharacters = count_if(begin(letterFrequencies.counts), end(letterFrequencies.counts),
+                                    [](uint64_t count) { return count > 0; });
     
     cout << "\t\tDone\n";
-    cout << letterFrequencies.size() << " unique characters, " << totalLetterFrequencies << " total characters\n\n";
+    cout << uniqueCharacters << " unique characters, " << letterFrequencies.total << " total characters\n\n";
     cout.flush();
     
     return letterFrequencies;
 }
 
-stringVector loadLanguageFile(string path)
+bool loadLanguageFile(string path, stringVector *dictionary)
 {
     cout << "Trying to load dictionary \"" << path << "\"";
     cout.flush();
     
     // open language dictionary
-    fstream languageFile = openFile(path, ios_base::in);
+    fstream languageFile;
+    
+    if (!openFile(&languageFile, path, ios_base::in))
+    {
+        return false;
+    }
+    
+    METRICS_SCOPE("dictionary_load");
     
-    intDoubleMap letterFrequencies;
-    stringVector dictionary;
     string line;
     
     while (getline(languageFile, line))
     {
         // lower case all characters to ensure that we get a proper distribution for letters
         transform(line.begin(), line.end(), line.begin(), ::tolower);
-        dictionary.push_back(line);
+        dictionary->push_back(line);
     }
     
     cout << "\t\tDone\n";
-    cout << dictionary.size() << " words\n\n";
+    cout << dictionary->size() << " words\n\n";
     cout.flush();
     
     languageFile.close();
-    return dictionary;
+    return true;
 }
 
-int calculateKeyLength(intVector *inputBytes)
+int calculateKeyLength(byteVector *inputBytes)
 {
     cout << "Calculating key length";
     cout.flush();
     
+    METRICS_SCOPE("key_length");
+    
     // determine distribution for key lengths MIN_KEY_LENGTH to MAX_KEY_LENGTH
-    double maxFrequencyDistribution = 0.0;
+    crackers::options opts = parallelOptions();
+    crackers::keyLengthScore best;
+    size_t found = 0;
     int length = 0;
     
-    for (int i = MIN_KEY_LEN; i <= MAX_KEY_LEN; ++i)
+    if (crackers::findKeyLengths(*inputBytes, MIN_KEY_LEN, min<size_t>(MAX_KEY_LEN, inputBytes->size()),
+                                 crackers::span<crackers::keyLengthScore>(&best, 1), &found,
+                                 crackers::CONFIDENT_KEY_LENGTH, &opts) == crackers::CRACK_OK &&
+        found > 0)
     {
-        intDoubleMap frequencies;
-        
-        for (auto it = inputBytes->begin(); it <= inputBytes->end(); it += i)
-        {
-            updateFrequencyDistribution(&frequencies, *it);
-        }
-        
-        calculatePercentileDistribution(&frequencies);
-        
-        double frequencyDistribution = calculateFrequencyDistribution(&frequencies);
-        
-        if (frequencyDistribution > maxFrequencyDistribution)
-        {
-            maxFrequencyDistribution = frequencyDistribution;
-            length = i;
-        }
+        length = best.length;
     }
     
     cout << "\t\tDone\n";
@@ -206,134 +194,120 @@ int calculateKeyLength(intVector *inputBytes)
     return length;
 }
 
-string decrypt(intVector *inputBytes, int keyLength, intDoubleMap *letterFrequency)
+// results are cached in the file named by CRYPTO_RESULTS, when it is set
+resultCache *openResults()
 {
-    cout << "Attempting to find cipher key and decrypt text";
+    const char *path = getenv("CRYPTO_RESULTS");
+    
+    return path ? Results_Open(path) : NULL;
+}
+
+bool findKnownKey(resultCache *results, uint64_t inputHash, byteVector *inputBytes, int keyLength,
+                  crackers::languageModel *letterFrequency, byteVector *key, double *score)
+{
+    cout << "Looking for a known key";
     cout.flush();
     
-    string decrypted;
-    vector<vector<intVector> > decryptedItems;
+    METRICS_SCOPE("result_cache");
     
-    for (int i = 0; i < keyLength; ++i)
+    // the same ciphertext, cracked before
+    for (const resultEntry *entry = Results_Find(results, RESULT_XOR, inputHash, inputBytes->size(), NULL);
+         entry != NULL; entry = Results_Find(results, RESULT_XOR, inputHash, inputBytes->size(), entry))
     {
-        vector<intVector> decryptedStream;
-        
-        for (int j = 0; j < 256; ++j)
+        if (entry->keyLength == (size_t)keyLength)
         {
-            intVector decryptedValues;
+            key->assign(entry->key, entry->key + entry->keyLength);
+            *score = entry->confidence;
             
-            for (auto it = inputBytes->begin() + i; it < inputBytes->end(); it += keyLength)
-            {
-                // xor with char
-                int decrChar = *it ^ j;
-                
-                if (decrChar < 32 || decrChar > 127)
-                {
-                    decryptedValues.clear();
-                    break;
-                }
-                else
-                {
-                    decryptedValues.push_back(decrChar);
-                }
-            }
+            cout << "\t\tDone\n";
+            cout << "Same ciphertext as before\n\n";
+            METRICS_COUNT("result_cache_hits", 1);
             
-            if (decryptedValues.size() > 0)
-            {
-                decryptedStream.push_back(decryptedValues);
-            }
+            return true;
         }
-        
-        if (decryptedStream.size() == 0)
-        {
-            return "";
-        }
-        
-        decryptedItems.push_back(decryptedStream);
     }
     
-    if(decryptedItems.size() == 0)
+    // keys recovered from other ciphertexts, the best few by fingerprint,
+    // one cheap pass each
+    byteVector fingerprint(keyLength * crackers::FINGERPRINT_GUESSES);
+    const resultEntry *ranked[RANKED_KEYS];
+    int rankedCount = 0;
+    
+    if (Results_Keys(results, RESULT_XOR, keyLength, NULL) != NULL &&
+        crackers::columnFingerprint(*inputBytes, *letterFrequency, keyLength, fingerprint) == crackers::CRACK_OK)
     {
-        return "";
+        rankedCount = Results_Rank(results, RESULT_XOR, keyLength, keyLength, fingerprint.data(),
+                                   crackers::FINGERPRINT_GUESSES, (keyLength + MATCH_SHARE - 1) / MATCH_SHARE,
+                                   ranked, RANKED_KEYS);
     }
     
-    vector<intVector> bestStreams;
-    
-    // run through each possiblity and check against language distribution
-    for (auto itemIt = decryptedItems.begin(); itemIt < decryptedItems.end(); ++itemIt)
+    for (int i = 0; i < rankedCount; i++)
     {
-        double nearestFrequencyDistribution = 0.0;
-        intVector bestStream;
+        const resultEntry *entry = ranked[i];
+        double keyScore;
         
-        for (auto streamIt = itemIt->begin(); streamIt < itemIt->end(); ++streamIt)
+        METRICS_COUNT("known_keys_tried", 1);
+        
+        if (crackers::scoreKey(*inputBytes, *letterFrequency, crackers::byteSpan(entry->key, entry->keyLength),
+                               &keyScore) == crackers::CRACK_OK && keyScore >= VERIFY_SHARE * entry->confidence)
         {
-            intDoubleMap decryptedStreamFrequency;
-            
-            for (auto valueIt = streamIt->begin(); valueIt < streamIt->end(); ++valueIt)
-            {
-                updateFrequencyDistribution(&decryptedStreamFrequency, *valueIt);
-            }
-
-            // calculate distribution
-            calculatePercentileDistribution(&decryptedStreamFrequency);
-            
-            double sumDistribution = 0.0;
+            key->assign(entry->key, entry->key + entry->keyLength);
+            *score = keyScore;
             
-            // compute against language letter frequency
-            for (auto valueIt = decryptedStreamFrequency.begin(); valueIt != decryptedStreamFrequency.end(); ++valueIt)
-            {
-                auto character = letterFrequency->find(valueIt->first);
-                
-                if (character != letterFrequency->end())
-                {
-                    // found
-                    sumDistribution += character->second * valueIt->second;
-                }
-            }
+            cout << "\t\tDone\n";
+            cout << "Key recovered before from another ciphertext\n\n";
+            METRICS_COUNT("result_cache_hits", 1);
             
-            if (sumDistribution > nearestFrequencyDistribution)
-            {
-                bestStream = *streamIt;
-                nearestFrequencyDistribution = sumDistribution;
-            }
+            return true;
         }
-        
-        bestStreams.push_back(bestStream);
     }
     
-    int stillBusy = keyLength;
+    cout << "\t\tDone\n";
+    cout << "No known key fits\n\n";
     
-    stringstream decryptionStream;
+    return false;
+}
+
+string applyKnownKey(byteVector *inputBytes, byteVector *key)
+{
+    string decrypted(inputBytes->size(), '\0');
     
-    size_t index = 0;
-    while (stillBusy > 0)
+    crackers::applyKey(*inputBytes, *key,
+                       crackers::span<uint8_t>(reinterpret_cast<uint8_t *>(&decrypted[0]), decrypted.size()));
+    
+    return decrypted;
+}
+
+string decrypt(byteVector *inputBytes, int keyLength, crackers::languageModel *letterFrequency,
+               byteVector *recoveredKey = nullptr, double *score = nullptr)
+{
+    cout << "Attempting to find cipher key and decrypt text";
+    cout.flush();
+    
+    METRICS_SCOPE("candidate_scoring");
+    
+    if (keyLength <= 0)
     {
-        for (int i = 0; i < keyLength; i++)
-        {
-            intVector keyStream = bestStreams.at(i);
-            
-            if(keyStream.size() > index)
-            {
-                int value = keyStream.at(index);
-                decryptionStream << (char)value;
-            }
-            else
-            {
-                stillBusy--;
-            }
-        }
-        
-        index++;
+        return "";
     }
     
-    decrypted = decryptionStream.str();
+    crackers::options opts = parallelOptions();
+    byteVector key(keyLength);
     
-    if (decrypted.length() != inputBytes->size())
+    // run through each possiblity and check against language distribution
+    if (crackers::recoverKey(*inputBytes, *letterFrequency, key, score, &opts) != crackers::CRACK_OK)
     {
         return "";
     }
     
-    cout.flush();
+    METRICS_COUNT("candidates_scored", 256 * keyLength);
+    
+    string decrypted = applyKnownKey(inputBytes, &key);
+    
+    if (recoveredKey)
+    {
+        recoveredKey->swap(key);
+    }
     
     cout << "\t\tDone\n";
     cout.flush();
@@ -341,35 +315,55 @@ string decrypt(intVector *inputBytes, int keyLength, intDoubleMap *letterFrequen
     return decrypted;
 }
 
-void writeOutFile(string path, string decrypted)
+bool writeOutFile(string path, string decrypted)
 {
     cout << "Writing output file \"" << path << "\"";
     
     // open output file
-    fstream outputFile = openFile(path, ios_base::out);
+    fstream outputFile;
+    
+    if (!openFile(&outputFile, path, ios_base::out))
+    {
+        return false;
+    }
+    
     outputFile << decrypted;
     outputFile.close();
     
     cout << "\t\tDone\n\n";
+    
+    return true;
 }
 
 int main(int argc, char *argv[])
 {
     if (argc < ARGUMENT_COUNT)
     {
-        cerr << "Usage: vigenere input_file output_file language_dictionary\n";
+        cerr << "Usage: vigenere input_file output_file language_dictionary [key_length]\n";
         return EXIT_FAILURE;
     }
     
+    Metrics_Init("vigenere");
+    
     // read input file into string
-    intVector inputBytes = loadInputFile(argv[1]);
+    byteVector inputBytes;
+    
+    if (!loadInputFile(argv[1], &inputBytes))
+    {
+        return EXIT_FAILURE;
+    }
     
     // load the language file into memory
     // dictionary itself is not used in decryption, but could add another level of verification
-    stringVector dictionary = loadLanguageFile(argv[3]);
+    stringVector dictionary;
+    
+    if (!loadLanguageFile(argv[3], &dictionary))
+    {
+        return EXIT_FAILURE;
+    }
     
     // then calculate letter frequency
-    intDoubleMap letterFrequency = calculateLetterFrequency(&dictionary);
+    crackers::languageModel letterFrequency = calculateLetterFrequency(&dictionary);
     
     // now try to determine key length
     /*
@@ -381,10 +375,36 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
      */
-    int keyLength = 31;
+    int keyLength = argc > ARGUMENT_COUNT ? atoi(argv[ARGUMENT_COUNT]) : 31;
+    
+    if (argc > ARGUMENT_COUNT && (keyLength < MIN_KEY_LEN || (size_t)keyLength > inputBytes.size()))
+    {
+        cerr << "Invalid key length " << argv[ARGUMENT_COUNT] << "\n";
+        return EXIT_FAILURE;
+    }
     
-    // attempt to obtain key and decrypt
-    string decrypted = decrypt(&inputBytes, keyLength, &letterFrequency);
+    // try the keys recovered before, then attempt to obtain key and decrypt
+    resultCache *results = openResults();
+    uint64_t inputHash = results ? Results_Hash(inputBytes.data(), inputBytes.size(), 0) : 0;
+    byteVector key;
+    double score = 0.0;
+    string decrypted;
+    
+    if (results && findKnownKey(results, inputHash, &inputBytes, keyLength, &letterFrequency, &key, &score))
+    {
+        decrypted = applyKnownKey(&inputBytes, &key);
+    }
+    else
+    {
+        decrypted = decrypt(&inputBytes, keyLength, &letterFrequency, &key, &score);
+    }
+    
+    if (results && decrypted.length() > 0)
+    {
+        Results_Store(results, RESULT_XOR, inputHash, inputBytes.size(), key.data(), key.size(), score);
+    }
+    
+    Results_Close(results);
     
     if(decrypted.length() == 0)
     {
@@ -392,7 +412,10 @@ int main(int argc, char *argv[])
         cout << "Could not decrypt ciphertext\n";
     }
     
-    writeOutFile(argv[2], decrypted);
+    if (!writeOutFile(argv[2], decrypted))
+    {
+        return EXIT_FAILURE;
+    }
     
     cout << "Decryption complete\n";
     
@@ -6,6 +6,8 @@
 //
 
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -15,242 +17,358 @@
 #include <iomanip>
 #include <math.h>
 
+#include "../common/metrics.h"
+#include "../common/hex.h"
+#include "../common/corpusfile.h"
+#include "../common/crackers.h"
+#include "../common/results.h"
+
 using namespace std;
 
-const int MIN_ARGUMENT_COUNT = 5;
+const int MIN_ARGUMENT_COUNT = 2;
+const int MIN_CIPHERTEXTS = 3;
 
 // added once message known
 const char KNOWN_MESSAGE[] = "I am planning a secret mission.";
 const int KNOWN_MESSAGE_POST = 1;
 
+// a stored pad must know this share of the bytes it decrypts, and the best
+// few of each length by fingerprint are tried, if they match at least one
+// column in MATCH_SHARE
+const double KNOWN_PAD_SHARE = 0.9;
+const int RANKED_PADS = 8;
+const size_t MATCH_SHARE = 4;
+
+
+typedef vector<uint8_t> byteVector;
+typedef vector<byteVector> byteVectorVector;
 
-typedef vector<fstream *> fstreamVector;
-typedef vector<int> intVector;
-typedef vector<intVector> intVectorVector;
+// columns are spread over the shared thread pool
+crackers::options parallelOptions()
+{
+    crackers::options opts;
+    opts.pool = Executor_Default();
+    return opts;
+}
 
-void openFile(fstream *stream, string path, ios_base::openmode mode)
+bool openFile(fstream *stream, string path, ios_base::openmode mode)
 {
     stream->open(path, mode);
     
     if (!stream->is_open())
     {
         cerr << "Could not open file \"" << path << "\"\n";
-        exit(EXIT_FAILURE);
+        return false;
     }
+    
+    return true;
 }
 
-void writeOutFile(string path, string decrypted)
+bool writeOutFile(string path, string decrypted)
 {
     cout << "Writing output file \"" << path << "\"";
     
     // open output file
     fstream outputFile;
-    openFile(&outputFile, path, ios_base::out);
+    
+    if (!openFile(&outputFile, path, ios_base::out))
+    {
+        return false;
+    }
+    
     outputFile << decrypted;
     outputFile.close();
     
     cout << "\t\tDone\n\n";
-}
-
-int hexStringToInt(string hexString)
-{
-    stringstream converter;
     
-    unsigned int temp;
-    converter << hex << hexString;
-    converter >> temp;
-    return temp;
+    return true;
 }
 
-void decrypt(fstreamVector *streams)
+// appends the ciphertext in a hex file, or every record of a packed corpus
+bool loadInputFile(string path, byteVectorVector *cipherTexts)
 {
-    vector <stringstream *> streamBuffers;
+    METRICS_SCOPE("hex_parse");
     
-    for (auto j = streams->begin(); j < streams->end(); ++j)
+    if (CorpusFile_Is(path.c_str()))
     {
-        fstream *stream = *j;
-        stringstream *buffer = new stringstream();
-        *buffer << stream->rdbuf();
-        streamBuffers.push_back(buffer);
+        corpusFile *corpus = CorpusFile_Open(path.c_str());
+        corpusRecord record;
+        
+        if (corpus == NULL)
+        {
+            return false;
+        }
+        
+        for (size_t i = 0; i < CorpusFile_Count(corpus); i++)
+        {
+            if (CorpusFile_Record(corpus, i, &record) == 0)
+            {
+                cipherTexts->push_back(byteVector(record.data, record.data + record.length));
+            }
+        }
+        
+        CorpusFile_Close(corpus);
+        return true;
     }
     
-    intVector currentByte;
-    intVectorVector actualKey;
-    intVectorVector cipherTexts;
+    size_t length;
+    uint8_t *data = Hex_LoadFile(path.c_str(), &length);
     
-    // average number of key possibilities found to be smaller or equal to AVERAGE_MAX_POSSIBLE_KEYS.
-    // Anything higher and we ignore it.
-    size_t totalKeyPossiblities = 0;
+    if (data == NULL)
+    {
+        return false;
+    }
+    
+    cipherTexts->push_back(byteVector(data, data + length));
+    free(data);
     
-    do
+    return true;
+}
+
+// results are cached in the file named by CRYPTO_RESULTS, when it is set
+resultCache *openResults()
+{
+    const char *path = getenv("CRYPTO_RESULTS");
+    
+    return path ? Results_Open(path) : NULL;
+}
+
+// one pass over the ciphertexts, stopping at the first byte that is not
+// printable ASCII under the pad; 0 marks pad bytes that are not known, and a
+// pad that leaves too many of the bytes unknown does not fit
+bool padFits(byteVectorVector *cipherTexts, const uint8_t *pad, size_t padLength)
+{
+    size_t total = 0, known = 0;
+    
+    for (auto cipherText = cipherTexts->begin(); cipherText < cipherTexts->end(); ++cipherText)
     {
-        currentByte.clear();
-        
-        for (auto i = streamBuffers.begin(); i < streamBuffers.end(); ++i)
+        if (cipherText->size() > padLength)
         {
-            stringstream *buffer = *i;
-            string hexVal;
-            *buffer >> setw(2) >> hexVal;
-            
-            if (hexVal.length() == 2)
-            {
-                int byte = hexStringToInt(hexVal);
-                currentByte.push_back(byte);
-            }
-            else
-            {
-                break;
-            }
+            return false;
         }
         
-        if (currentByte.size() > 0)
+        for (size_t bytePos = 0; bytePos < cipherText->size(); bytePos++)
         {
-            intVector possibleKey;
+            int decrypted = (*cipherText)[bytePos] ^ pad[bytePos];
             
-            for (int j = 1; j < 255; j++)
+            if (pad[bytePos] != 0 && (decrypted < 32 || decrypted > 126))
             {
-                bool invalid = false;
-                
-                for (auto k = currentByte.begin(); k < currentByte.end(); ++k)
-                {
-                    int decodedByte = *k ^ j;
-                    
-                    // do some sanity check to ensure output is within appropriate range
-                    if ((decodedByte < 65 && decodedByte != 32) ||
-                        (decodedByte >= 91 && decodedByte <= 96) ||
-                        decodedByte >= 122)
-                    {
-                        invalid = true;
-                        break;
-                    }
-                }
-                
-                if (!invalid)
-                {
-                    possibleKey.push_back(j);
-                }
+                return false;
             }
             
-            size_t possibleKeySize = possibleKey.size();
+            known += pad[bytePos] != 0;
+        }
+        
+        total += cipherText->size();
+    }
+    
+    return known >= KNOWN_PAD_SHARE * total;
+}
+
+bool findKnownPad(resultCache *results, uint64_t inputHash, size_t inputLength,
+                  byteVectorVector *cipherTexts, byteVector *pad)
+{
+    cout << "Looking for a known pad";
+    cout.flush();
+    
+    METRICS_SCOPE("result_cache");
+    
+    const resultEntry *found = Results_Find(results, RESULT_PAD, inputHash, inputLength, NULL);
+    
+    // pads recovered from other ciphertexts, long enough for every one of
+    // these and ranked by how many columns they match
+    vector<crackers::byteSpan> streams(cipherTexts->begin(), cipherTexts->end());
+    size_t columns = 0;
+    
+    for (auto stream = streams.begin(); stream < streams.end(); ++stream)
+    {
+        columns = max(columns, stream->size);
+    }
+    
+    vector<size_t> lengths(found == NULL && columns > 0 ? Results_KeyLengths(results, RESULT_PAD, nullptr, 0) : 0);
+    byteVector fingerprint(lengths.empty() ? 0 : columns * streams.size() * crackers::FINGERPRINT_GUESSES);
+    
+    if (lengths.empty() || crackers::padFingerprint(streams, columns, fingerprint) != crackers::CRACK_OK)
+    {
+        lengths.clear();
+    }
+    else
+    {
+        Results_KeyLengths(results, RESULT_PAD, lengths.data(), lengths.size());
+    }
+    
+    for (auto length = lengths.begin(); found == NULL && length < lengths.end(); ++length)
+    {
+        const resultEntry *ranked[RANKED_PADS];
+        int rankedCount = 0;
+        
+        if (*length >= columns)
+        {
+            rankedCount = Results_Rank(results, RESULT_PAD, *length, columns, fingerprint.data(),
+                                       streams.size() * crackers::FINGERPRINT_GUESSES,
+                                       (columns + MATCH_SHARE - 1) / MATCH_SHARE, ranked, RANKED_PADS);
+        }
+        
+        for (int i = 0; found == NULL && i < rankedCount; i++)
+        {
+            METRICS_COUNT("known_keys_tried", 1);
             
-            if (possibleKeySize > totalKeyPossiblities)
+            if (padFits(cipherTexts, ranked[i]->key, ranked[i]->keyLength))
             {
-                totalKeyPossiblities = possibleKeySize;
+                found = ranked[i];
             }
-            
-            actualKey.push_back(possibleKey);
-            
         }
+    }
+    
+    cout << "\t\tDone\n";
+    
+    if (found == NULL)
+    {
+        cout << "No known pad fits\n\n";
+        return false;
+    }
+    
+    pad->assign(found->key, found->key + found->keyLength);
+    METRICS_COUNT("result_cache_hits", 1);
+    
+    cout << "Pad recovered before\n\n";
+    
+    return true;
+}
+
+void printWithPad(byteVectorVector *cipherTexts, const byteVector &pad)
+{
+    for (auto cipherText = cipherTexts->begin(); cipherText < cipherTexts->end(); ++cipherText)
+    {
+        string line;
+        
+        for (size_t bytePos = 0; bytePos < cipherText->size() && bytePos < pad.size(); bytePos++)
+        {
+            line += static_cast<char>(pad[bytePos] ^ (*cipherText)[bytePos]);
+        }
+        
+        cout << line << "\n";
+    }
+}
+
+// pad is set when the known message gave it, with 0 for the bytes it did not
+// give, or when every column has a single candidate
+bool decrypt(byteVectorVector *cipherTexts, byteVector *pad = nullptr)
+{
+    // average number of key possibilities found to be smaller or equal to AVERAGE_MAX_POSSIBLE_KEYS.
+    // Anything higher and we ignore it.
+    size_t totalKeyPossiblities = 0;
+    
+    metricsTimer columnTimer = METRICS_BEGIN("column_solving");
+    
+    crackers::options opts = parallelOptions();
+    vector<crackers::byteSpan> streams(cipherTexts->begin(), cipherTexts->end());
+    vector<crackers::padColumn> columns(streams.empty() ? 0 : streams[0].size);
+    size_t columnCount = 0;
+    
+    if (crackers::solvePad(streams, columns, &columnCount, &opts) != crackers::CRACK_OK)
+    {
+        cerr << "No ciphertexts to decrypt\n";
+        return false;
+    }
+    
+    for (size_t bytePos = 0; bytePos < columnCount; bytePos++)
+    {
+        const crackers::padColumn &column = columns[bytePos];
         
-    } while (currentByte.size() > 0);
+        if (column.count > totalKeyPossiblities)
+        {
+            totalKeyPossiblities = column.count;
+        }
+    }
+    
+    for (auto stream = streams.begin(); stream < streams.end(); ++stream)
+    {
+        METRICS_COUNT("bytes_processed", stream->size);
+    }
+    
+    METRICS_COUNT("candidates_scored", 254 * columnCount);
+    
+    METRICS_END(columnTimer);
+    
+    metricsTimer outputTimer = METRICS_BEGIN("candidate_output");
     
     int streamCounter = 1;
+    size_t knownLength = strlen(KNOWN_MESSAGE);
     
     // key if we already know what one of the messages is
-    int key[31] = {0};
+    byteVector key(columnCount, 0);
     
     // try to decrypt based on the key possibilities
     // this will output some semblence of english text, then it's up to human pattern matching
-    for (auto j = streams->begin(); j < streams->end(); ++j)
+    for (auto cipherText = cipherTexts->begin(); cipherText < cipherTexts->end(); ++cipherText)
     {
         cout << "Ciphertext " << streamCounter << "\n";
         
-        fstream *stream = *j;
-        
         for (size_t j = 0; j < totalKeyPossiblities; j++)
         {
-            stream->seekg(0);
-            stringstream *buffer = new stringstream();
-            *buffer << stream->rdbuf();
-            
-            string hexVal;
+            string line;
             
-            int bytePos = 0;
-            
-            while (*buffer >> setw(2) >> hexVal)
+            for (size_t bytePos = 0; bytePos < cipherText->size(); bytePos++)
             {
-                int byte = hexStringToInt(hexVal);
-                
-                intVector keyVector = actualKey[bytePos];
+                int byte = (*cipherText)[bytePos];
                 
-                int keyByte = 0;
-                
-                if (keyVector.size() > 0)
+                if (bytePos < columnCount && columns[bytePos].count > 0)
                 {
-                    if (keyVector.size() > j)
-                    {
-                        keyByte = keyVector[j];
-                    }
-                    else
-                    {
-                        keyByte = keyVector[keyVector.size() - 1];
-                    }
+                    const crackers::padColumn &column = columns[bytePos];
+                    uint8_t keyByte = column.candidates[min<size_t>(j, column.count - 1)];
                     
-                    int outByte = keyByte ^ byte;
+                    char outByteChar = static_cast<char>(keyByte ^ byte);
                     
-                    char outByteChar = static_cast<char>(outByte);
-                    
-                    if (strlen(KNOWN_MESSAGE) > 0)
+                    if (streamCounter == KNOWN_MESSAGE_POST && bytePos < knownLength &&
+                        KNOWN_MESSAGE[bytePos] == outByteChar)
                     {
-                        if (streamCounter == KNOWN_MESSAGE_POST && KNOWN_MESSAGE[bytePos] == outByteChar)
-                        {
-                            key[bytePos] = keyByte;
-                        }
+                        key[bytePos] = keyByte;
                     }
                     
-                    cout << outByteChar;
+                    line += outByteChar;
                 }
                 else
                 {
                     // don't know what it is
-                    cout << "_";
+                    line += '_';
                 }
-                
-                bytePos++;
             }
             
-            cout << "\n";
+            cout << line << "\n";
         }
         
         cout << "\n";
         ++streamCounter;
     }
     
+    METRICS_END(outputTimer);
+    
     // if we've already found the key we can just decrypt them all
-    if(key[0] != 0)
+    if (key.size() > 0 && key[0] != 0)
     {
+        printWithPad(cipherTexts, key);
+    }
+    
+    if (pad)
+    {
+        pad->clear();
         
-        streamCounter = 1;
-        
-        for (auto j = streams->begin(); j < streams->end(); ++j)
+        if (key.size() > 0 && key[0] != 0)
         {
-            fstream *stream = *j;
-            
-            stream->seekg(0);
-            stringstream *buffer = new stringstream();
-            *buffer << stream->rdbuf();
-            
-            string hexVal;
-            
-            int bytePos = 0;
-            
-            while (*buffer >> setw(2) >> hexVal)
+            pad->swap(key);
+        }
+        else if (all_of(columns.begin(), columns.begin() + columnCount,
+                        [](const crackers::padColumn &column) { return column.count == 1; }))
+        {
+            for (size_t bytePos = 0; bytePos < columnCount; bytePos++)
             {
-                int byte = hexStringToInt(hexVal);
-                
-                intVector keyVector = actualKey[bytePos];
-                
-                int keyByte = key[bytePos];
-                int outByte = keyByte ^ byte;
-                char outByteChar = static_cast<char>(outByte);
-                cout << outByteChar;
-                bytePos++;
+                pad->push_back(columns[bytePos].candidates[0]);
             }
-            cout << "\n";
-            
-            ++streamCounter;
         }
     }
+    
+    return true;
 }
 
 int main(int argc, char *argv[])
@@ -262,20 +380,60 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    fstreamVector streams;
+    Metrics_Init("otp");
+
+    byteVectorVector cipherTexts;
     
-    for (int i = 1; i < argc - 1; ++i)
+    for (int i = 1; i < argc; ++i)
     {
         cout << "Loading file " << argv[i] << "\n";
-        fstream *stream = new fstream();
-        openFile(stream, argv[i], ios_base::in);
-        streams.push_back(stream);
+        
+        if (!loadInputFile(argv[i], &cipherTexts))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (cipherTexts.size() < MIN_CIPHERTEXTS)
+    {
+        cerr << "Need at least " << MIN_CIPHERTEXTS << " ciphertexts\n";
+        
+        return EXIT_FAILURE;
     }
     
     cout << "Files loaded\n\n";
     cout << "Decrypting streams\n";
-
-    decrypt(&streams);
+    
+    // a pad recovered before answers without solving the columns
+    resultCache *results = openResults();
+    uint64_t inputHash = 0;
+    size_t inputLength = 0;
+    byteVector pad;
+    
+    for (auto cipherText = cipherTexts.begin(); results && cipherText < cipherTexts.end(); ++cipherText)
+    {
+        inputHash = Results_Hash(cipherText->data(), cipherText->size(), inputHash);
+        inputLength += cipherText->size();
+    }
+    
+    if (results && findKnownPad(results, inputHash, inputLength, &cipherTexts, &pad))
+    {
+        printWithPad(&cipherTexts, pad);
+    }
+    else if (!decrypt(&cipherTexts, &pad))
+    {
+        Results_Close(results);
+        return EXIT_FAILURE;
+    }
+    
+    if (results && !pad.empty())
+    {
+        double known = pad.size() - count(pad.begin(), pad.end(), 0);
+        
+        Results_Store(results, RESULT_PAD, inputHash, inputLength, pad.data(), pad.size(), known / pad.size());
+    }
+    
+    Results_Close(results);
     
     cout << "Decryption complete\n";
     
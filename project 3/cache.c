@@ -0,0 +1,293 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define BLOCK_LENGTH 16
+
+typedef struct cacheEntry
+{
+    unsigned char block[BLOCK_LENGTH];
+    unsigned char intermediate[BLOCK_LENGTH];
+    int used;
+} cacheEntry;
+
+struct intermediateCache
+{
+    FILE *file;
+    cacheEntry *entries;
+    int capacity;
+    int size;
+};
+
+// ciphertext blocks are already uniformly distributed, so a few bytes of the
+// block are as good as any hash
+static unsigned int slotFor(const unsigned char *block, int capacity)
+{
+    uint32_t hash;
+    memcpy(&hash, block, sizeof(hash));
+    return hash & (capacity - 1);
+}
+
+static int insert(intermediateCache *cache, const unsigned char *block, const unsigned char *intermediate);
+
+static int grow(intermediateCache *cache)
+{
+    cacheEntry *old = cache->entries;
+    int oldCapacity = cache->capacity, i;
+
+    cache->capacity = oldCapacity ? oldCapacity * 2 : 256;
+    cache->entries = calloc(cache->capacity, sizeof(cacheEntry));
+    cache->size = 0;
+
+    if (cache->entries == NULL)
+    {
+        cache->entries = old;
+        cache->capacity = oldCapacity;
+        return -1;
+    }
+
+    for (i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].used)
+        {
+            insert(cache, old[i].block, old[i].intermediate);
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+// returns 1 when the block was new
+static int insert(intermediateCache *cache, const unsigned char *block, const unsigned char *intermediate)
+{
+    if ((cache->size + 1) * 2 > cache->capacity && grow(cache) != 0)
+    {
+        return -1;
+    }
+
+    unsigned int slot = slotFor(block, cache->capacity);
+
+    while (cache->entries[slot].used)
+    {
+        if (memcmp(cache->entries[slot].block, block, BLOCK_LENGTH) == 0)
+        {
+            return 0;
+        }
+
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+
+    cache->entries[slot].used = 1;
+    memcpy(cache->entries[slot].block, block, BLOCK_LENGTH);
+    memcpy(cache->entries[slot].intermediate, intermediate, BLOCK_LENGTH);
+    cache->size++;
+
+    return 1;
+}
+
+static int parseHex(const char *hex, unsigned char *out)
+{
+    int i;
+    unsigned int tmp;
+
+    for (i = 0; i < BLOCK_LENGTH; i++)
+    {
+        if (sscanf(hex + i * 2, "%02x", &tmp) != 1)
+        {
+            return -1;
+        }
+
+        out[i] = tmp;
+    }
+
+    return 0;
+}
+
+intermediateCache *Cache_Open(const char *path)
+{
+    intermediateCache *cache = calloc(1, sizeof(intermediateCache));
+    unsigned char block[BLOCK_LENGTH], intermediate[BLOCK_LENGTH];
+    char blockHex[64], intermediateHex[64];
+
+    if (cache == NULL || grow(cache) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    if (path == NULL)
+    {
+        return cache;
+    }
+
+    cache->file = fopen(path, "a+");
+
+    if (cache->file == NULL)
+    {
+        perror(path);
+        Cache_Close(cache);
+        return NULL;
+    }
+
+    rewind(cache->file);
+
+    while (fscanf(cache->file, "%63s %63s", blockHex, intermediateHex) == 2)
+    {
+        if (parseHex(blockHex, block) == 0 && parseHex(intermediateHex, intermediate) == 0)
+        {
+            insert(cache, block, intermediate);
+        }
+    }
+
+    return cache;
+}
+
+void Cache_Close(intermediateCache *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    if (cache->file != NULL)
+    {
+        fclose(cache->file);
+    }
+
+    free(cache->entries);
+    free(cache);
+}
+
+int Cache_Lookup(intermediateCache *cache, const unsigned char *block, unsigned char *intermediate)
+{
+    unsigned int slot = slotFor(block, cache->capacity);
+
+    while (cache->entries[slot].used)
+    {
+        if (memcmp(cache->entries[slot].block, block, BLOCK_LENGTH) == 0)
+        {
+            memcpy(intermediate, cache->entries[slot].intermediate, BLOCK_LENGTH);
+            return 1;
+        }
+
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+
+    return 0;
+}
+
+int Cache_Store(intermediateCache *cache, const unsigned char *block, const unsigned char *intermediate)
+{
+    int i, ret = insert(cache, block, intermediate);
+
+    if (ret != 1 || cache->file == NULL)
+    {
+        return ret < 0 ? -1 : 0;
+    }
+
+    for (i = 0; i < BLOCK_LENGTH; i++)
+    {
+        fprintf(cache->file, "%02X", block[i]);
+    }
+
+    fputc(' ', cache->file);
+
+    for (i = 0; i < BLOCK_LENGTH; i++)
+    {
+        fprintf(cache->file, "%02X", intermediate[i]);
+    }
+
+    fputc('\n', cache->file);
+
+    // a crash later in a long run must not lose thousands of queries
+    fflush(cache->file);
+
+    return 0;
+}
+
+int Cache_Any(intermediateCache *cache, unsigned char *block, unsigned char *intermediate)
+{
+    int i;
+
+    for (i = 0; i < cache->capacity; i++)
+    {
+        if (cache->entries[i].used)
+        {
+            memcpy(block, cache->entries[i].block, BLOCK_LENGTH);
+            memcpy(intermediate, cache->entries[i].intermediate, BLOCK_LENGTH);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int Cache_Size(intermediateCache *cache)
+{
+    return cache->size;
+}
+
+void Intermediate_Begin(intermediateSearch *search, const unsigned char *block)
+{
+    memset(search, 0, sizeof(intermediateSearch));
+    memcpy(search->query + BLOCK_LENGTH, block, BLOCK_LENGTH);
+    search->position = BLOCK_LENGTH - 1;
+    search->padding = 1;
+}
+
+static int nextGuess(intermediateSearch *search)
+{
+    if (++search->guess == 256)
+    {
+        return SEARCH_FAIL;
+    }
+
+    search->query[search->position] = search->guess;
+
+    return SEARCH_MORE;
+}
+
+int Intermediate_Answer(intermediateSearch *search, int valid)
+{
+    int i;
+
+    if (search->checking)
+    {
+        search->query[search->position - 1] ^= 1;
+        search->checking = 0;
+    }
+    else if (valid && search->position == BLOCK_LENGTH - 1)
+    {
+        search->query[search->position - 1] ^= 1;
+        search->checking = 1;
+        return SEARCH_MORE;
+    }
+
+    if (!valid)
+    {
+        return nextGuess(search);
+    }
+
+    search->intermediate[search->position] = search->guess ^ search->padding;
+
+    if (search->position == 0)
+    {
+        return SEARCH_DONE;
+    }
+
+    search->padding++;
+
+    for (i = search->position; i < BLOCK_LENGTH; i++)
+    {
+        search->query[i] = search->padding ^ search->intermediate[i];
+    }
+
+    search->position--;
+    search->guess = 0;
+    search->query[search->position] = 0;
+
+    return SEARCH_MORE;
+}
@@ -0,0 +1,53 @@
+// Persistent cache of recovered block intermediates D(C).
+//
+// Recovering the intermediate of a ciphertext block costs up to 4096 oracle
+// queries, but it only depends on the block and the server's key, so once
+// known it can be reused by every later decryption or forgery. The cache file
+// holds one "<block hex> <intermediate hex>" pair per line and new entries are
+// appended as soon as they are found.
+
+#ifndef CACHE_H
+#define CACHE_H
+
+typedef struct intermediateCache intermediateCache;
+
+// opens (or creates) the cache file, NULL path gives an in-memory cache
+intermediateCache *Cache_Open(const char *path);
+void Cache_Close(intermediateCache *cache);
+
+// returns 1 and fills intermediate when the block is known, 0 otherwise
+int Cache_Lookup(intermediateCache *cache, const unsigned char *block, unsigned char *intermediate);
+int Cache_Store(intermediateCache *cache, const unsigned char *block, const unsigned char *intermediate);
+
+// any known block, used as the free last block of a forgery
+int Cache_Any(intermediateCache *cache, unsigned char *block, unsigned char *intermediate);
+
+int Cache_Size(intermediateCache *cache);
+
+// Byte-at-a-time recovery of D(block) behind a zero previous block, one
+// oracle answer at a time so that it runs as well from a scheduler step as
+// from a loop. batch and forge both recover through it, so every entry in
+// the shared cache was found the same way. A valid answer for the last byte
+// is asked again with the byte before it changed, since a plaintext ending
+// in 02 02 (or longer) passes as well as one ending in 01.
+typedef struct intermediateSearch
+{
+    unsigned char query[32];            // previous block and block: send this next
+    unsigned char intermediate[16];
+    int position;
+    int guess;
+    int padding;
+    int checking;                       // query is the 02 02 check of the last byte
+} intermediateSearch;
+
+#define SEARCH_MORE 0
+#define SEARCH_DONE 1
+#define SEARCH_FAIL -1
+
+void Intermediate_Begin(intermediateSearch *search, const unsigned char *block);
+
+// takes whether query had valid padding, returns SEARCH_MORE with the next
+// query in place, SEARCH_DONE with intermediate filled in, or SEARCH_FAIL
+int Intermediate_Answer(intermediateSearch *search, int valid);
+
+#endif
@@ -0,0 +1,269 @@
+#include "oracle.h"
+#include "../common/metrics.h"
+#include "cache.h"
+#include "../common/hex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Forge CBC ciphertexts for chosen plaintexts using only the padding oracle
+// (CBC-R), or decrypt ciphertexts, reusing every block intermediate D(C) that
+// was recovered before.
+//
+// Forging works backwards from the last block: pick any block C[n] and
+// recover D(C[n]), then C[n-1] = D(C[n]) ^ P[n], and so on down to the IV
+// C[0]. Every step needs the intermediate of a fresh block, so each forged
+// block costs one recovery unless its block is already in the cache. The
+// last block is taken from the cache when possible, making it free.
+//
+// Usage: forge [-k cache_file] -e <plaintext_file>
+//        forge [-k cache_file] -d <ciphertext_file>
+
+static int const blockSize = 16;
+
+// opened on the first query with the quiet client calls, so -e prints
+// nothing but the ciphertext to stdout
+static int oracleFd = -1;
+static int queries = 0;
+
+static int oracle(unsigned char *cipherConcat)
+{
+    if (oracleFd < 0 && (oracleFd = Oracle_Open()) < 0)
+    {
+        return -1;
+    }
+
+    queries++;
+
+    return Oracle_SendFd(oracleFd, cipherConcat, 2);
+}
+
+// byte-at-a-time recovery of D(block) against a zero previous block,
+// consulting the cache first
+static int recoverIntermediate(intermediateCache *cache, const unsigned char *block, unsigned char *intermediate)
+{
+    intermediateSearch search;
+    int ret, state;
+
+    if (Cache_Lookup(cache, block, intermediate))
+    {
+        return 0;
+    }
+
+    Intermediate_Begin(&search, block);
+
+    do
+    {
+        if ((ret = oracle(search.query)) == -1)
+        {
+            fprintf(stderr, "Connection failed\n");
+            return -1;
+        }
+    }
+    while ((state = Intermediate_Answer(&search, ret == 1)) == SEARCH_MORE);
+
+    if (state == SEARCH_FAIL)
+    {
+        fprintf(stderr, "Failed to get intermediate\n");
+        return -1;
+    }
+
+    memcpy(intermediate, search.intermediate, blockSize);
+    Cache_Store(cache, block, intermediate);
+
+    return 0;
+}
+
+static unsigned char *readFile(const char *path, int *length, int hex)
+{
+    FILE *fpIn;
+    int capacity = 64, tmp;
+    unsigned char *data;
+
+    if (hex)
+    {
+        size_t decoded;
+
+        data = Hex_LoadFile(path, &decoded);
+        *length = decoded;
+
+        return data;
+    }
+
+    if ((fpIn = fopen(path, "r")) == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    data = malloc(capacity);
+    *length = 0;
+
+    while ((tmp = fgetc(fpIn)) != EOF)
+    {
+        if (*length == capacity)
+        {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+
+        data[(*length)++] = tmp;
+    }
+
+    fclose(fpIn);
+
+    return data;
+}
+
+static int forge(intermediateCache *cache, const unsigned char *plainText, int length)
+{
+    int padding = blockSize - length % blockSize;
+    int blocks = (length + padding) / blockSize;
+    unsigned char *padded = malloc(length + padding);
+    unsigned char *cipherText = malloc((blocks + 1) * blockSize);
+    unsigned char intermediate[16];
+    int i, block;
+
+    memcpy(padded, plainText, length);
+    memset(padded + length, padding, padding);
+
+    // last block: reuse a known one, otherwise any block will do
+    if (!Cache_Any(cache, cipherText + blocks * blockSize, intermediate))
+    {
+        for (i = 0; i < blockSize; i++)
+        {
+            cipherText[blocks * blockSize + i] = rand();
+        }
+    }
+
+    for (block = blocks; block > 0; block--)
+    {
+        if (recoverIntermediate(cache, cipherText + block * blockSize, intermediate) != 0)
+        {
+            free(padded);
+            free(cipherText);
+            return -1;
+        }
+
+        for (i = 0; i < blockSize; i++)
+        {
+            cipherText[(block - 1) * blockSize + i] = intermediate[i] ^ padded[(block - 1) * blockSize + i];
+        }
+    }
+
+    for (i = 0; i < (blocks + 1) * blockSize; i++)
+    {
+        printf("%02X", cipherText[i]);
+    }
+
+    printf("\n");
+
+    free(padded);
+    free(cipherText);
+
+    return 0;
+}
+
+static int decrypt(intermediateCache *cache, const unsigned char *cipherText, int length)
+{
+    int blocks = length / blockSize;
+    unsigned char *plainText = calloc(length, 1);
+    unsigned char intermediate[16];
+    int i, block, padding;
+
+    if (blocks < 2 || length % blockSize != 0)
+    {
+        printf("Ciphertext must be an IV followed by whole blocks\n");
+        free(plainText);
+        return -1;
+    }
+
+    for (block = 1; block < blocks; block++)
+    {
+        if (recoverIntermediate(cache, cipherText + block * blockSize, intermediate) != 0)
+        {
+            free(plainText);
+            return -1;
+        }
+
+        for (i = 0; i < blockSize; i++)
+        {
+            plainText[(block - 1) * blockSize + i] = intermediate[i] ^ cipherText[(block - 1) * blockSize + i];
+        }
+    }
+
+    length -= blockSize;
+    padding = plainText[length - 1];
+
+    if (padding > 0 && padding <= blockSize)
+    {
+        length -= padding;
+    }
+
+    fwrite(plainText, 1, length, stdout);
+    printf("\n");
+
+    free(plainText);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *cachePath = NULL;
+    const char *path = NULL;
+    int opt, encrypt = -1, length, ret;
+    unsigned char *data;
+
+    Metrics_Init("forge");
+
+    while ((opt = getopt(argc, argv, "k:e:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'k': cachePath = optarg; break;
+            case 'e': encrypt = 1; path = optarg; break;
+            case 'd': encrypt = 0; path = optarg; break;
+            default: encrypt = -1; path = NULL; break;
+        }
+    }
+
+    if (path == NULL)
+    {
+        printf("Usage: forge [-k cache_file] -e <plaintext_file>\n");
+        printf("       forge [-k cache_file] -d <ciphertext_file>\n");
+        return -1;
+    }
+
+    intermediateCache *cache = Cache_Open(cachePath);
+
+    if (cache == NULL)
+    {
+        return -1;
+    }
+
+    data = readFile(path, &length, !encrypt);
+
+    if (data == NULL)
+    {
+        Cache_Close(cache);
+        return -1;
+    }
+
+    srand(getpid());
+
+    ret = encrypt ? forge(cache, data, length) : decrypt(cache, data, length);
+
+    if (oracleFd >= 0)
+    {
+        Oracle_Close(oracleFd);
+    }
+
+    fprintf(stderr, "%d oracle queries, %d cached intermediates\n", queries, Cache_Size(cache));
+
+    free(data);
+    Cache_Close(cache);
+
+    return ret;
+}
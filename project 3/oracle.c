@@ -6,27 +6,57 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "oracle.h"
+#include "../common/metrics.h"
+
 #define NOFLAGS 0
 #define BLOCK_LENGTH 16
 
-extern int sockfd;
+#define DEFAULT_HOST "54.165.60.84"
+#define DEFAULT_PORT 6667
 
-int Oracle_Connect() {
-  struct sockaddr_in servaddr, cliaddr;
-  int rc;
+int sockfd;
+
+// ORACLE_HOST and ORACLE_PORT point the client at another server,
+// e.g. the local stand-in in server/oracle_server.c
+static void oracleAddress(struct sockaddr_in *servaddr) {
+  const char *host = getenv("ORACLE_HOST");
+  const char *port = getenv("ORACLE_PORT");
+
+  bzero(servaddr, sizeof(*servaddr));
+  servaddr->sin_family = AF_INET;
+  servaddr->sin_addr.s_addr=inet_addr(host ? host : DEFAULT_HOST);
+  servaddr->sin_port=htons(port ? atoi(port) : DEFAULT_PORT);
+}
+
+int Oracle_Open() {
+  struct sockaddr_in servaddr;
+  int fd;
 
-  sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  fd = socket(AF_INET, SOCK_STREAM, 0);
 
-  bzero(&servaddr, sizeof(servaddr));
-  servaddr.sin_family = AF_INET;
-  servaddr.sin_addr.s_addr=inet_addr("54.165.60.84");
-  servaddr.sin_port=htons(6667);
+  oracleAddress(&servaddr);
 
-  if(!connect(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr))) {
+  if(fd >= 0 && !connect(fd, (struct sockaddr *)&servaddr, sizeof(servaddr))) {
+    return fd;
+  } else {
+    perror("Failed to connect to oracle");
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+}
+
+int Oracle_Close(int fd) {
+  return close(fd);
+}
+
+int Oracle_Connect() {
+  sockfd = Oracle_Open();
+
+  if(sockfd >= 0) {
     printf("Connected to server successfully.\n");
     return 0;
   } else {
-    perror("Failed to connect to oracle");
     return -1;
   }
 }
@@ -43,6 +73,10 @@ int Oracle_Disconnect() {
 
 // Packet Structure: < num_blocks(1) || ciphertext(16*num_blocks) || null-terminator(1) >
 int Oracle_Send(unsigned char* ctext, int num_blocks) {
+  return Oracle_SendFd(sockfd, ctext, num_blocks);
+}
+
+int Oracle_SendFd(int fd, unsigned char* ctext, int num_blocks) {
   int ctext_len = num_blocks * BLOCK_LENGTH;
   unsigned char message[(ctext_len)+2];
   char recvbit[2];
@@ -51,16 +85,21 @@ int Oracle_Send(unsigned char* ctext, int num_blocks) {
   memcpy((message+1), ctext, ctext_len);
   message[ctext_len+1] = '\0';
 
-  if(!send(sockfd, message, ctext_len+2, NOFLAGS)) {
+  double sent = metricsEnabled ? Metrics_Now() : 0.0;
+
+  if(send(fd, message, ctext_len+2, MSG_NOSIGNAL) != ctext_len+2) {
     perror("[WARNING]: You haven't connected to the server yet");
     return -1;
   }
-  if(!recv(sockfd, recvbit, 2, NOFLAGS)) {
+  if(recv(fd, recvbit, 2, NOFLAGS) <= 0) {
     perror("[ERROR]: Recv failed");
     return -1;
   }
   recvbit[1] = '\0';
 
+  METRICS_COUNT("oracle_queries", 1);
+  METRICS_LATENCY("oracle_rtt", Metrics_Now() - sent);
+
   return atoi(recvbit);
 }
 
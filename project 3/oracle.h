@@ -1,4 +1,9 @@
-int sockfd;
+extern int sockfd;
 int Oracle_Connect();
 int Oracle_Disconnect();
 int Oracle_Send(unsigned char *cipher_text, int block_length);
+
+// connection-per-caller variants, used when several queries run in parallel
+int Oracle_Open();
+int Oracle_Close(int fd);
+int Oracle_SendFd(int fd, unsigned char *cipher_text, int block_length);
@@ -1,7 +1,9 @@
 #include "oracle.h"
+#include "../common/metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 
 // Read a ciphertext from a file, send it to the server, and get back a result.
 // If you run this using the challenge ciphertext (which was generated correctly),
@@ -19,22 +21,27 @@ int main(int argc, char *argv[]) {
     // allocate space for 48 bytes, i.e., 3 blocks
     unsigned char cipherText[blockBytes];
     
-    unsigned char cipherConcat[blockSize * 2] = {0};
+    unsigned char cipherConcat[blockSize * 2];
     int intermediate = 0;
     
     // allocate space for plain text
-    unsigned char plainActual[blockBytes - blockSize] = {0};
+    unsigned char plainActual[blockBytes - blockSize + 1];
     
     int i, j, block, tmp, ret;
     int padding = 0;
     
     FILE *fpIn;
     
+    memset(cipherConcat, 0, sizeof(cipherConcat));
+    memset(plainActual, 0, sizeof(plainActual));
+    
     if (argc != 2) {
         printf("Usage: sample <filename>\n");
         return -1;
     }
     
+    Metrics_Init("sample");
+    
     fpIn = fopen(argv[1], "r");
     
     for(i=0; i< blockBytes; i++) {
@@ -0,0 +1,271 @@
+#include "forge.h"
+#include "oracle.h"
+#include "../common/cbcmac.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// fixed size FIFO of job indices
+typedef struct jobQueue
+{
+    int *items;
+    int capacity;
+    int head;
+    int size;
+} jobQueue;
+
+static int queueInit(jobQueue *queue, int capacity)
+{
+    queue->items = malloc(capacity * sizeof(int));
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->size = 0;
+
+    return queue->items == NULL ? -1 : 0;
+}
+
+static void queuePush(jobQueue *queue, int item)
+{
+    queue->items[(queue->head + queue->size++) % queue->capacity] = item;
+}
+
+static int queuePop(jobQueue *queue)
+{
+    int item = queue->items[queue->head];
+
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+
+    return item;
+}
+
+void Forge_DefaultConfig(forgeConfig *config)
+{
+    config->maxChunk = 2 * FORGE_BLOCK;
+    config->window = 32;
+    config->verify = 1;
+    config->transcript = NULL;
+}
+
+void Forge_Init(forgeJob *job, const unsigned char *message, int mlength)
+{
+    memset(job, 0, sizeof(forgeJob));
+    job->message = message;
+    job->mlength = mlength;
+}
+
+// skips every stretch of the message the transcript already has a tag for
+static void advance(forgeJob *job, transcriptStore *transcript)
+{
+    int matched;
+
+    if (transcript == NULL)
+    {
+        return;
+    }
+
+    while (job->position < job->mlength)
+    {
+        matched = Transcript_Longest(transcript, job->message + job->position, job->mlength - job->position,
+                                     job->position > 0 ? job->tag : NULL, FORGE_BLOCK, job->tag);
+
+        if (matched == 0)
+        {
+            break;
+        }
+
+        job->position += matched;
+    }
+}
+
+// the Mac query for the current chunk, with the chaining value folded in
+static void buildChunk(const forgeJob *job, unsigned char *chunk)
+{
+    int i;
+
+    memcpy(chunk, job->message + job->position, job->chunk);
+
+    if (job->position > 0)
+    {
+        for (i = 0; i < FORGE_BLOCK; i++)
+        {
+            chunk[i] ^= job->tag[i];
+        }
+    }
+}
+
+static int sendMac(forgeJob *job, int maxChunk)
+{
+    unsigned char chunk[FORGE_MAX_MESSAGE];
+
+    job->chunk = CbcMac_NextChunk(job->mlength, job->position, maxChunk);
+
+    if (job->chunk == 0)
+    {
+        return 1;
+    }
+
+    buildChunk(job, chunk);
+
+    job->calls++;
+
+    return Mac_Send(chunk, job->chunk);
+}
+
+int Forge_Run(forgeJob *jobs, int count, const forgeConfig *config)
+{
+    jobQueue ready = {0}, macQueue = {0}, vrfyReady = {0}, vrfyQueue = {0};
+    int i, ret, failed = 0, finished = 0;
+
+    if (queueInit(&ready, count + 1) || queueInit(&macQueue, count + 1) ||
+        queueInit(&vrfyReady, count + 1) || queueInit(&vrfyQueue, count + 1))
+    {
+        free(ready.items);
+        free(macQueue.items);
+        free(vrfyReady.items);
+        free(vrfyQueue.items);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (jobs[i].mlength > FORGE_MAX_MESSAGE || jobs[i].mlength < 2 * FORGE_BLOCK)
+        {
+            jobs[i].status = FORGE_ERROR;
+            finished++;
+            failed++;
+        }
+        else
+        {
+            jobs[i].status = FORGE_PENDING;
+            jobs[i].position = 0;
+            queuePush(&ready, i);
+        }
+    }
+
+    while (finished < count)
+    {
+        // keep both pipelines full
+        while (ready.size > 0 && macQueue.size < config->window)
+        {
+            int job = queuePop(&ready);
+
+            advance(&jobs[job], config->transcript);
+
+            if (jobs[job].position == jobs[job].mlength)
+            {
+                if (config->verify)
+                {
+                    queuePush(&vrfyReady, job);
+                }
+                else
+                {
+                    jobs[job].status = FORGE_FORGED;
+                    finished++;
+                }
+
+                continue;
+            }
+
+            ret = sendMac(&jobs[job], config->maxChunk);
+
+            if (ret < 0)
+            {
+                failed = -1;
+                goto done;
+            }
+
+            if (ret > 0)
+            {
+                jobs[job].status = FORGE_ERROR;
+                finished++;
+                failed++;
+                continue;
+            }
+
+            queuePush(&macQueue, job);
+        }
+
+        while (vrfyReady.size > 0 && vrfyQueue.size < config->window)
+        {
+            int job = queuePop(&vrfyReady);
+
+            if (Vrfy_Send(jobs[job].message, jobs[job].mlength, jobs[job].tag) < 0)
+            {
+                failed = -1;
+                goto done;
+            }
+
+            queuePush(&vrfyQueue, job);
+        }
+
+        if (macQueue.size == 0 && vrfyQueue.size == 0)
+        {
+            continue;
+        }
+
+        struct pollfd fds[2] = {
+            { macfd, macQueue.size > 0 ? POLLIN : 0, 0 },
+            { vrfyfd, vrfyQueue.size > 0 ? POLLIN : 0, 0 }
+        };
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            perror("poll");
+            failed = -1;
+            goto done;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            forgeJob *job = &jobs[queuePop(&macQueue)];
+            unsigned char tag[FORGE_BLOCK];
+
+            if (Mac_Recv(tag) < 0)
+            {
+                failed = -1;
+                goto done;
+            }
+
+            if (config->transcript != NULL)
+            {
+                unsigned char chunk[FORGE_MAX_MESSAGE];
+
+                buildChunk(job, chunk);
+                Transcript_Add(config->transcript, chunk, job->chunk, tag);
+            }
+
+            memcpy(job->tag, tag, FORGE_BLOCK);
+            job->position += job->chunk;
+            job->chunk = 0;
+
+            // back through the ready queue, which also consults the transcript
+            queuePush(&ready, job - jobs);
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            forgeJob *job = &jobs[queuePop(&vrfyQueue)];
+
+            ret = Vrfy_Recv();
+
+            if (ret < 0)
+            {
+                failed = -1;
+                goto done;
+            }
+
+            job->status = ret == 1 ? FORGE_VERIFIED : FORGE_REJECTED;
+            finished++;
+        }
+    }
+
+done:
+    free(ready.items);
+    free(macQueue.items);
+    free(vrfyReady.items);
+    free(vrfyQueue.items);
+
+    return failed;
+}
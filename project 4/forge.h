@@ -0,0 +1,56 @@
+// CBC-MAC forgery engine
+//
+// The tag of a message is the CBC chaining value after its last block, so the
+// tag t of a block-aligned prefix lets the rest be MACed on its own with t
+// xored into its first block. A message is split into as few chunks as the
+// oracle accepts (at least two, the whole message is never sent to Mac), and
+// each chunk costs one Mac call. Chunks of different messages are independent,
+// so the Mac requests of a batch are pipelined on macfd and every finished
+// tag is checked with Vrfy on vrfyfd while other messages are still in flight.
+// With a transcript store, every stretch of a message that can be chained from
+// earlier Mac answers is skipped, and only the remainder is sent to the oracle.
+
+#ifndef FORGE_H
+#define FORGE_H
+
+#include "transcript.h"
+
+#define FORGE_BLOCK 16
+#define FORGE_MAX_MESSAGE 255   // the wire format sends mlength in one byte
+
+#define FORGE_PENDING   0
+#define FORGE_VERIFIED  1
+#define FORGE_REJECTED  2
+#define FORGE_FORGED    3   // tag computed, verification not requested
+#define FORGE_ERROR    -1
+
+typedef struct forgeJob
+{
+    const unsigned char *message;
+    int mlength;
+    unsigned char tag[FORGE_BLOCK];
+    int status;
+    int calls;              // Mac calls spent on this message
+
+    // engine state
+    int position;           // bytes of the message covered by tag
+    int chunk;              // length of the chunk waiting for its tag
+} forgeJob;
+
+typedef struct forgeConfig
+{
+    int maxChunk;           // longest message the Mac oracle accepts
+    int window;             // requests in flight per connection
+    int verify;             // check every forged tag with Vrfy
+    transcriptStore *transcript;    // earlier Mac answers, may be NULL
+} forgeConfig;
+
+void Forge_DefaultConfig(forgeConfig *config);
+
+void Forge_Init(forgeJob *job, const unsigned char *message, int mlength);
+
+// forges tags for all jobs, returns the number of jobs that ended in FORGE_ERROR
+// or -1 when the connection to the oracle failed
+int Forge_Run(forgeJob *jobs, int count, const forgeConfig *config);
+
+#endif
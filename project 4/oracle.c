@@ -6,26 +6,69 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "oracle.h"
+#include "../common/metrics.h"
+
 #define NOFLAGS 0
 #define BLOCK_LENGTH 16
 
-extern int macfd, vrfyfd;
+#define DEFAULT_HOST "54.165.60.84"
+#define DEFAULT_MAC_PORT 6668
+#define DEFAULT_VRFY_PORT 6669
+
+// send times of the requests in flight, answered in order
+#define MAX_PENDING 256
+
+typedef struct pendingTimes {
+  double sent[MAX_PENDING];
+  int head;
+  int size;
+} pendingTimes;
+
+int macfd, vrfyfd;
+
+static pendingTimes macPending, vrfyPending;
+
+static void requestSent(pendingTimes *pending) {
+  if (metricsEnabled && pending->size < MAX_PENDING) {
+    pending->sent[(pending->head + pending->size++) % MAX_PENDING] = Metrics_Now();
+  }
+}
+
+static double answerReceived(pendingTimes *pending) {
+  double sent;
+
+  if (pending->size == 0) {
+    return 0.0;
+  }
+
+  sent = pending->sent[pending->head];
+  pending->head = (pending->head + 1) % MAX_PENDING;
+  pending->size--;
+
+  return Metrics_Now() - sent;
+}
+
+// ORACLE_HOST, ORACLE_MAC_PORT and ORACLE_VRFY_PORT point the client at
+// another server, e.g. the local stand-in in server/oracle_server.c
+static void oracleAddress(struct sockaddr_in *servaddr, const char *portVariable, int defaultPort) {
+  const char *host = getenv("ORACLE_HOST");
+  const char *port = getenv(portVariable);
+
+  bzero(servaddr, sizeof(*servaddr));
+  servaddr->sin_family = AF_INET;
+  servaddr->sin_addr.s_addr=inet_addr(host ? host : DEFAULT_HOST);
+  servaddr->sin_port=htons(port ? atoi(port) : defaultPort);
+}
 
 int Oracle_Connect() {
-  struct sockaddr_in mac_servaddr, mac_cliaddr, vrfy_servaddr, vrfy_cliaddr;
+  struct sockaddr_in mac_servaddr, vrfy_servaddr;
 
   macfd = socket(AF_INET, SOCK_STREAM, 0);
   vrfyfd = socket(AF_INET, SOCK_STREAM, 0);
 
-  bzero(&mac_servaddr, sizeof(mac_servaddr));
-  bzero(&vrfy_servaddr, sizeof(vrfy_servaddr));
-
-  mac_servaddr.sin_family = AF_INET;
-  vrfy_servaddr.sin_family = AF_INET;
-  mac_servaddr.sin_addr.s_addr=inet_addr("54.165.60.84");
-  vrfy_servaddr.sin_addr.s_addr=inet_addr("54.165.60.84");
-  mac_servaddr.sin_port=htons(6668);
-  vrfy_servaddr.sin_port=htons(6669);
+  oracleAddress(&mac_servaddr, "ORACLE_MAC_PORT", DEFAULT_MAC_PORT);
+  oracleAddress(&vrfy_servaddr, "ORACLE_VRFY_PORT", DEFAULT_VRFY_PORT);
 
   if( !connect(macfd, (struct sockaddr *)&mac_servaddr, sizeof(mac_servaddr)) &&
       !connect(vrfyfd, (struct sockaddr *)&vrfy_servaddr, sizeof(vrfy_servaddr)) ) {
@@ -47,50 +90,109 @@ int Oracle_Disconnect() {
   }
 }
 
+static int sendAll(int fd, const unsigned char *data, int length) {
+  int sent = 0, n;
+
+  while (sent < length) {
+    n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return -1;
+    }
+    sent += n;
+  }
+
+  return 0;
+}
+
+static int recvAll(int fd, unsigned char *data, int length) {
+  int received = 0, n;
+
+  while (received < length) {
+    n = recv(fd, data + received, length - received, NOFLAGS);
+    if (n <= 0) {
+      return -1;
+    }
+    received += n;
+  }
+
+  return 0;
+}
+
 // < mlength (1) || message (mlength) || 0 >
-int Mac(unsigned char *message, int mlength, unsigned char *tag) {
+int Mac_Send(const unsigned char *message, int mlength) {
   unsigned char out[mlength+2];
-  unsigned char in[16];
-  int i;
 
   out[0] = mlength;
   memcpy((out+1), message, mlength);
-  message[1+mlength] = '\0';
+  out[1+mlength] = '\0';
 
-  if(!send(macfd, out, (mlength + 2), NOFLAGS)) {
+  if(sendAll(macfd, out, (mlength + 2))) {
     perror("[WARNING]: You haven't connected to the server yet");
     return -1;
   }
-  if(!recv(macfd, in, 16, NOFLAGS)) {
+
+  requestSent(&macPending);
+
+  return 0;
+}
+
+int Mac_Recv(unsigned char *tag) {
+  if(recvAll(macfd, tag, 16)) {
     perror("[ERROR]: Recv failed");
     return -1;
   }
-  for (i=0; i<16; i++) {
-    tag[i] = in[i];
-  }
+
+  METRICS_COUNT("mac_queries", 1);
+  METRICS_LATENCY("mac_rtt", answerReceived(&macPending));
 
   return 0;
 }
 
-int Vrfy(unsigned char *message, int mlength, unsigned char *tag) {
+int Mac(unsigned char *message, int mlength, unsigned char *tag) {
+  if(Mac_Send(message, mlength)) {
+    return -1;
+  }
+
+  return Mac_Recv(tag);
+}
+
+// < mlength (1) || message (mlength) || tag (16) || 0 >
+int Vrfy_Send(const unsigned char *message, int mlength, const unsigned char *tag) {
   unsigned char out[mlength+2+16];
-  char in[2];
-  int i;
 
   out[0] = mlength;
   memcpy((out+1), message, mlength);
   memcpy((out+1+mlength), tag, 16);
-  message[1+mlength+16] = '\0';
+  out[1+mlength+16] = '\0';
 
-  if(!send(vrfyfd, out, (mlength + 2 + 16), NOFLAGS)) {
+  if(sendAll(vrfyfd, out, (mlength + 2 + 16))) {
     perror("[WARNING]: You haven't connected to the server yet");
     return -1;
   }
-  if(!recv(vrfyfd, in, 2, NOFLAGS)) {
+
+  requestSent(&vrfyPending);
+
+  return 0;
+}
+
+int Vrfy_Recv() {
+  unsigned char in[3] = {0};
+
+  if(recvAll(vrfyfd, in, 2)) {
     perror("[ERROR]: Recv failed");
     return -1;
   }
 
-  return atoi(in);
+  METRICS_COUNT("vrfy_queries", 1);
+  METRICS_LATENCY("vrfy_rtt", answerReceived(&vrfyPending));
+
+  return atoi((char *)in);
 }
 
+int Vrfy(unsigned char *message, int mlength, unsigned char *tag) {
+  if(Vrfy_Send(message, mlength, tag)) {
+    return -1;
+  }
+
+  return Vrfy_Recv();
+}
@@ -1,7 +1,13 @@
-int macfd, vrfyfd;
+extern int macfd, vrfyfd;
 int Oracle_Connect();
 int Oracle_Disconnect();
 
 int Mac(unsigned char *message, int mlength, unsigned char *tag);
 int Vrfy(unsigned char *message, int mlength, unsigned char *tag);
 
+// split halves of Mac and Vrfy, so several requests can be in flight on the
+// same connection; answers come back in the order the requests were sent
+int Mac_Send(const unsigned char *message, int mlength);
+int Mac_Recv(unsigned char *tag);
+int Vrfy_Send(const unsigned char *message, int mlength, const unsigned char *tag);
+int Vrfy_Recv();
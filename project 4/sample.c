@@ -1,74 +1,188 @@
 #include "oracle.h"
+#include "../common/metrics.h"
+#include "forge.h"
+#include "../common/aes.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 
-#define MAX_LENGTH 512
+// Forge CBC-MAC tags for the messages in the given files and verify them.
+// Messages are read as raw bytes, so they may contain NULs, and all of them
+// are forged in one pipelined batch. With -t, Mac answers are remembered in a
+// transcript file and reused by later runs. When the key is known (-K, hex),
+// tags are checked locally instead of through Vrfy.
+//
+// Usage: sample [-m max_mac_length] [-w window] [-n] [-t transcript_file] [-K key] <filename>...
 
-char *xor( char *message,  char *tag)
+static unsigned char *readMessage(const char *path, int *mlength)
 {
-    static  char messageXored[16];
-    
-    int i;
-    for (i = 0; i < 16; i++)
+    unsigned char *message = malloc(FORGE_MAX_MESSAGE + 1);
+    FILE *fpIn = fopen(path, "rb");
+
+    if (fpIn == NULL || message == NULL)
     {
-        messageXored[i] = tag[i] ^ message[i];
+        perror(path);
+        free(message);
+        return NULL;
     }
-    
-    return messageXored;
+
+    *mlength = fread(message, 1, FORGE_MAX_MESSAGE + 1, fpIn);
+    fclose(fpIn);
+
+    if (*mlength > FORGE_MAX_MESSAGE)
+    {
+        printf("%s: messages are limited to %d bytes\n", path, FORGE_MAX_MESSAGE);
+        free(message);
+        return NULL;
+    }
+
+    return message;
 }
 
 int main(int argc, char *argv[]) {
-     unsigned char message[64] = {0};
-     unsigned char message1[33] = {0};
-     unsigned char message2[33] = {0};
-     unsigned char message3[65] = {0};
-    
-     unsigned char tag1[16] = {0};
-     unsigned char tag2[16] = {0};
-    unsigned char tag3[16] = {0};
-    
-    int i, mlength, ret;
-    FILE *fpIn;
-
-    if (argc != 2) {
-        printf("Usage: sample <filename>\n");
+    forgeConfig config;
+    const char *transcriptPath = NULL;
+    const char *keyHex = NULL;
+    int opt, i, j, count, ret, calls = 0;
+
+    Metrics_Init("forge_mac");
+
+    Forge_DefaultConfig(&config);
+
+    while ((opt = getopt(argc, argv, "m:w:nt:K:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm': config.maxChunk = atoi(optarg); break;
+            case 'w': config.window = atoi(optarg); break;
+            case 'n': config.verify = 0; break;
+            case 't': transcriptPath = optarg; break;
+            case 'K': keyHex = optarg; break;
+            default:
+                printf("Usage: sample [-m max_mac_length] [-w window] [-n] [-t transcript_file] [-K key] <filename>...\n");
+                return -1;
+        }
+    }
+
+    count = argc - optind;
+
+    if (count < 1 || config.maxChunk < FORGE_BLOCK || config.window < 1)
+    {
+        printf("Usage: sample [-m max_mac_length] [-w window] [-n] [-t transcript_file] [-K key] <filename>...\n");
         return -1;
     }
 
-    fpIn = fopen(argv[1], "r");
-    for(i=0; i<MAX_LENGTH; i++) {
-      if (fscanf(fpIn, "%c", &message[i]) == EOF) break;
+    aesKey key;
+
+    if (keyHex != NULL)
+    {
+        unsigned char keyBytes[AES_BLOCK];
+        unsigned int tmp;
+
+        if (strlen(keyHex) != 2 * AES_BLOCK)
+        {
+            printf("Key must be %d hex bytes\n", AES_BLOCK);
+            return -1;
+        }
+
+        for (i = 0; i < AES_BLOCK; i++)
+        {
+            if (sscanf(keyHex + i * 2, "%02x", &tmp) != 1)
+            {
+                printf("Key must be %d hex bytes\n", AES_BLOCK);
+                return -1;
+            }
+
+            keyBytes[i] = tmp;
+        }
+
+        AES_SetKey(&key, keyBytes);
+        config.verify = 0;
+    }
+
+    if (transcriptPath != NULL && (config.transcript = Transcript_Open(transcriptPath)) == NULL)
+    {
+        return -1;
     }
-    fclose(fpIn);
 
-    mlength = i;
-
-    Oracle_Connect();
-    
-    strncpy(message1, strndup(message, 32), 32);
-    Mac(message1, 32, tag1);
-    
-    strncat(message2, xor(strndup(message + 32, 16), tag1), 16);
-    Mac(message2, 16, tag2);
-    
-    strncat(message3, xor(strndup(message + 48, 16), tag2), 16);
-    Mac(message3, 16, tag3);
-    
-    ret = Vrfy(message, 64, tag3);
-    
-    if (ret) {
-        printf("Message verified successfully!\n");
-        
-        for(i = 0; i < 16; i++)
+    forgeJob *jobs = calloc(count, sizeof(forgeJob));
+
+    for (i = 0; i < count; i++)
+    {
+        int mlength;
+        unsigned char *message = readMessage(argv[optind + i], &mlength);
+
+        if (message == NULL)
         {
-            printf("%02x ", tag3[i]);
+            return -1;
         }
-        printf("\n");
-    } else {
-        printf("Message verficiation failed.\n");
+
+        Forge_Init(&jobs[i], message, mlength);
     }
 
+    if (Oracle_Connect() != 0)
+    {
+        return -1;
+    }
+
+    ret = Forge_Run(jobs, count, &config);
+
     Oracle_Disconnect();
+
+    if (ret < 0)
+    {
+        printf("Connection failed\n");
+        return -1;
+    }
+
+    if (keyHex != NULL)
+    {
+        for (i = 0; i < count; i++)
+        {
+            unsigned char tag[AES_BLOCK];
+
+            if (jobs[i].status == FORGE_FORGED)
+            {
+                AES_CbcMac(&key, jobs[i].message, jobs[i].mlength, tag);
+                jobs[i].status = memcmp(tag, jobs[i].tag, AES_BLOCK) == 0 ? FORGE_VERIFIED : FORGE_REJECTED;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        printf("%s: ", argv[optind + i]);
+
+        switch (jobs[i].status)
+        {
+            case FORGE_VERIFIED: printf("Message verified successfully!\n"); break;
+            case FORGE_FORGED: printf("Tag forged\n"); break;
+            case FORGE_REJECTED: printf("Message verficiation failed.\n"); break;
+            default: printf("Message cannot be split into Mac queries\n"); break;
+        }
+
+        if (jobs[i].status == FORGE_VERIFIED || jobs[i].status == FORGE_FORGED)
+        {
+            for (j = 0; j < FORGE_BLOCK; j++)
+            {
+                printf("%02x ", jobs[i].tag[j]);
+            }
+            printf("\n");
+        }
+
+        calls += jobs[i].calls;
+        free((void *)jobs[i].message);
+    }
+
+    printf("%d Mac calls for %d messages\n", calls, count);
+
+    free(jobs);
+
+    if (config.transcript != NULL)
+    {
+        Transcript_Close(config.transcript);
+    }
+
+    return ret == 0 ? 0 : -1;
 }
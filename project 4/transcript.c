@@ -0,0 +1,334 @@
+#include "transcript.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define BLOCK_LENGTH 16
+#define MAX_MESSAGE 255
+#define NO_NODE 0xffffffffu
+
+typedef struct trieNode
+{
+    unsigned char tag[BLOCK_LENGTH];
+    int hasTag;
+} trieNode;
+
+// edge (parent, block) -> child, kept in one open-addressing table
+typedef struct trieEdge
+{
+    uint32_t parent;
+    uint32_t child;
+    unsigned char block[BLOCK_LENGTH];
+} trieEdge;
+
+struct transcriptStore
+{
+    FILE *file;
+
+    trieNode *nodes;
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+
+    trieEdge *edges;
+    uint32_t edgeCount;
+    uint32_t edgeCapacity;
+
+    int size;
+};
+
+static uint32_t edgeHash(uint32_t parent, const unsigned char *block)
+{
+    uint64_t hash = 14695981039346656037ull ^ parent;
+    int i;
+
+    for (i = 0; i < BLOCK_LENGTH; i++)
+    {
+        hash = (hash ^ block[i]) * 1099511628211ull;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static uint32_t findEdge(const transcriptStore *store, uint32_t parent, const unsigned char *block)
+{
+    uint32_t slot = edgeHash(parent, block) & (store->edgeCapacity - 1);
+
+    while (store->edges[slot].child != NO_NODE)
+    {
+        if (store->edges[slot].parent == parent &&
+            memcmp(store->edges[slot].block, block, BLOCK_LENGTH) == 0)
+        {
+            return store->edges[slot].child;
+        }
+
+        slot = (slot + 1) & (store->edgeCapacity - 1);
+    }
+
+    return NO_NODE;
+}
+
+static void placeEdge(trieEdge *edges, uint32_t capacity, const trieEdge *edge)
+{
+    uint32_t slot = edgeHash(edge->parent, edge->block) & (capacity - 1);
+
+    while (edges[slot].child != NO_NODE)
+    {
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    edges[slot] = *edge;
+}
+
+static int growEdges(transcriptStore *store)
+{
+    uint32_t capacity = store->edgeCapacity ? store->edgeCapacity * 2 : 1024, i;
+    trieEdge *edges = malloc(capacity * sizeof(trieEdge));
+
+    if (edges == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < capacity; i++)
+    {
+        edges[i].child = NO_NODE;
+    }
+
+    for (i = 0; i < store->edgeCapacity; i++)
+    {
+        if (store->edges[i].child != NO_NODE)
+        {
+            placeEdge(edges, capacity, &store->edges[i]);
+        }
+    }
+
+    free(store->edges);
+    store->edges = edges;
+    store->edgeCapacity = capacity;
+
+    return 0;
+}
+
+static uint32_t newNode(transcriptStore *store)
+{
+    if (store->nodeCount == store->nodeCapacity)
+    {
+        uint32_t capacity = store->nodeCapacity ? store->nodeCapacity * 2 : 1024;
+        trieNode *nodes = realloc(store->nodes, capacity * sizeof(trieNode));
+
+        if (nodes == NULL)
+        {
+            return NO_NODE;
+        }
+
+        store->nodes = nodes;
+        store->nodeCapacity = capacity;
+    }
+
+    memset(&store->nodes[store->nodeCount], 0, sizeof(trieNode));
+
+    return store->nodeCount++;
+}
+
+// returns 1 when the message was new
+static int insert(transcriptStore *store, const unsigned char *message, int mlength, const unsigned char *tag)
+{
+    uint32_t node = 0;
+    int i;
+
+    for (i = 0; i < mlength; i += BLOCK_LENGTH)
+    {
+        uint32_t child = findEdge(store, node, message + i);
+
+        if (child == NO_NODE)
+        {
+            trieEdge edge;
+
+            if ((store->edgeCount + 1) * 2 > store->edgeCapacity && growEdges(store) != 0)
+            {
+                return -1;
+            }
+
+            if ((child = newNode(store)) == NO_NODE)
+            {
+                return -1;
+            }
+
+            edge.parent = node;
+            edge.child = child;
+            memcpy(edge.block, message + i, BLOCK_LENGTH);
+            placeEdge(store->edges, store->edgeCapacity, &edge);
+            store->edgeCount++;
+        }
+
+        node = child;
+    }
+
+    if (store->nodes[node].hasTag)
+    {
+        return 0;
+    }
+
+    store->nodes[node].hasTag = 1;
+    memcpy(store->nodes[node].tag, tag, BLOCK_LENGTH);
+    store->size++;
+
+    return 1;
+}
+
+static int parseHex(const char *hex, unsigned char *out, int maxLength)
+{
+    int length = 0;
+    unsigned int tmp;
+
+    while (hex[0] != '\0' && hex[1] != '\0' && length < maxLength)
+    {
+        if (sscanf(hex, "%02x", &tmp) != 1)
+        {
+            return -1;
+        }
+
+        out[length++] = tmp;
+        hex += 2;
+    }
+
+    return length;
+}
+
+transcriptStore *Transcript_Open(const char *path)
+{
+    transcriptStore *store = calloc(1, sizeof(transcriptStore));
+    unsigned char message[MAX_MESSAGE], tag[BLOCK_LENGTH];
+    char messageHex[2 * MAX_MESSAGE + 2], tagHex[2 * BLOCK_LENGTH + 2];
+    int mlength;
+
+    if (store == NULL || growEdges(store) != 0 || newNode(store) == NO_NODE)
+    {
+        Transcript_Close(store);
+        return NULL;
+    }
+
+    if (path == NULL)
+    {
+        return store;
+    }
+
+    store->file = fopen(path, "a+");
+
+    if (store->file == NULL)
+    {
+        perror(path);
+        Transcript_Close(store);
+        return NULL;
+    }
+
+    rewind(store->file);
+
+    while (fscanf(store->file, "%511s %33s", messageHex, tagHex) == 2)
+    {
+        mlength = parseHex(messageHex, message, MAX_MESSAGE);
+
+        if (mlength > 0 && mlength % BLOCK_LENGTH == 0 &&
+            parseHex(tagHex, tag, BLOCK_LENGTH) == BLOCK_LENGTH)
+        {
+            insert(store, message, mlength, tag);
+        }
+    }
+
+    return store;
+}
+
+void Transcript_Close(transcriptStore *store)
+{
+    if (store == NULL)
+    {
+        return;
+    }
+
+    if (store->file != NULL)
+    {
+        fclose(store->file);
+    }
+
+    free(store->nodes);
+    free(store->edges);
+    free(store);
+}
+
+int Transcript_Add(transcriptStore *store, const unsigned char *message, int mlength, const unsigned char *tag)
+{
+    int i, ret;
+
+    if (mlength <= 0 || mlength > MAX_MESSAGE || mlength % BLOCK_LENGTH != 0)
+    {
+        return 0;
+    }
+
+    ret = insert(store, message, mlength, tag);
+
+    if (ret != 1 || store->file == NULL)
+    {
+        return ret < 0 ? -1 : 0;
+    }
+
+    for (i = 0; i < mlength; i++)
+    {
+        fprintf(store->file, "%02x", message[i]);
+    }
+
+    fputc(' ', store->file);
+
+    for (i = 0; i < BLOCK_LENGTH; i++)
+    {
+        fprintf(store->file, "%02x", tag[i]);
+    }
+
+    fputc('\n', store->file);
+    fflush(store->file);
+
+    return 0;
+}
+
+int Transcript_Longest(transcriptStore *store, const unsigned char *data, int length,
+                       const unsigned char *chain, int minRest, unsigned char *tag)
+{
+    unsigned char block[BLOCK_LENGTH];
+    uint32_t node = 0;
+    int i, j, best = 0;
+
+    for (i = 0; i + BLOCK_LENGTH <= length; i += BLOCK_LENGTH)
+    {
+        memcpy(block, data + i, BLOCK_LENGTH);
+
+        if (i == 0 && chain != NULL)
+        {
+            for (j = 0; j < BLOCK_LENGTH; j++)
+            {
+                block[j] ^= chain[j];
+            }
+        }
+
+        node = findEdge(store, node, block);
+
+        if (node == NO_NODE)
+        {
+            break;
+        }
+
+        int rest = length - (i + BLOCK_LENGTH);
+
+        if (store->nodes[node].hasTag && (rest == 0 || rest >= minRest))
+        {
+            best = i + BLOCK_LENGTH;
+            memcpy(tag, store->nodes[node].tag, BLOCK_LENGTH);
+        }
+    }
+
+    return best;
+}
+
+int Transcript_Size(transcriptStore *store)
+{
+    return store->size;
+}
@@ -0,0 +1,32 @@
+// Persistent transcript of Mac oracle answers
+//
+// Every block-aligned (message, tag) pair the oracle returned is kept in a
+// trie over 16-byte blocks, so the tag of any stored message can be found
+// while walking a new message block by block. Because the tag of a prefix
+// is the CBC chaining value, a stored message also matches the rest of a
+// message once the current chaining value is xored into its first block.
+// The transcript file holds one "<message hex> <tag hex>" pair per line and
+// new answers are appended as they arrive.
+
+#ifndef TRANSCRIPT_H
+#define TRANSCRIPT_H
+
+typedef struct transcriptStore transcriptStore;
+
+// opens (or creates) the transcript file, NULL path gives an in-memory store
+transcriptStore *Transcript_Open(const char *path);
+void Transcript_Close(transcriptStore *store);
+
+// only whole-block messages are stored, other lengths are ignored
+int Transcript_Add(transcriptStore *store, const unsigned char *message, int mlength, const unsigned char *tag);
+
+// finds the longest stored message that is a prefix of data, with chain
+// (when not NULL) xored into its first block. Matches that leave between 1
+// and minRest - 1 bytes of data unmatched are skipped. Returns the matched
+// length and its tag, or 0 when nothing matches.
+int Transcript_Longest(transcriptStore *store, const unsigned char *data, int length,
+                       const unsigned char *chain, int minRest, unsigned char *tag);
+
+int Transcript_Size(transcriptStore *store);
+
+#endif
@@ -0,0 +1,407 @@
+//
+//  crackctl.c
+//
+//  Client for the cracking daemon (crackd)
+//
+//  Sends one job per hex file (all files form one job for otp), pipelined
+//  over a single connection with up to window jobs in flight, and prints the
+//  answers. With -n the jobs are sent that many times and the job rate and
+//  latency are reported, the answers only once.
+//
+
+#include "crackd.h"
+#include "../common/hex.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// crackers::errorCode
+static const char *statusNames[] = { "success", "invalid argument", "output buffer too small", "no solution found",
+                                     "out of memory", "oracle could not be asked", "cancelled" };
+
+typedef struct request
+{
+    const char *name;
+    uint8_t *frame;
+    size_t length;
+} request;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage()
+{
+    printf("Usage: crackctl [-s socket] [-w window] [-n repeat] [-m model] [-k min_key[,max_key]]\n");
+    printf("                ping|vigenere|otp|padding <filename>...\n");
+}
+
+static uint8_t *newFrame(int type, size_t length)
+{
+    uint8_t *frame = malloc(CRACKD_HEADER + length);
+
+    Crackd_Header(frame, length, 0, type);
+
+    return frame;
+}
+
+static void printHex(const uint8_t *data, size_t length)
+{
+    char *hex = malloc(length * 2 + 1);
+
+    Hex_Encode(data, length, hex);
+    hex[length * 2] = '\0';
+    printf("%s", hex);
+    free(hex);
+}
+
+static void printAnswer(int type, const request *req, int status, const uint8_t *body, size_t length)
+{
+    size_t i;
+
+    if (status != 0)
+    {
+        printf("%s: %s\n", req->name, status < 7 ? statusNames[status] : "unknown error");
+        return;
+    }
+
+    switch (type)
+    {
+        case CRACKD_VIGENERE:
+        {
+            int keyLength = Crackd_Get16(body);
+
+            printf("%s: key length %d, score %.6f\nkey: ", req->name, keyLength, Crackd_Get32(body + 4) / 1e6);
+            printHex(body + 8, keyLength);
+            printf("\n%.*s\n", (int)(length - 8 - keyLength), body + 8 + keyLength);
+            break;
+        }
+        case CRACKD_OTP:
+        {
+            size_t columns = Crackd_Get32(body), offset = 4, most = 0, solved = 0;
+
+            // one candidate pad byte per column, '?' where none fits
+            printf("%s: %zu columns\npad: ", req->name, columns);
+
+            for (i = 0; i < columns; i++)
+            {
+                most = body[offset] > most ? body[offset] : most;
+                solved += body[offset] == 1;
+
+                if (body[offset] > 0)
+                {
+                    printf("%02X", body[offset + 1]);
+                }
+                else
+                {
+                    printf("??");
+                }
+
+                offset += 1 + body[offset];
+            }
+
+            printf("\n%zu columns with a single candidate, at most %zu candidates\n", solved, most);
+            break;
+        }
+        case CRACKD_PADDING:
+            printf("%s: %.*s\n", req->name, (int)length, body);
+            break;
+        default:
+            printf("%s: %zu bytes echoed\n", req->name, length);
+            break;
+    }
+}
+
+static int connectTo(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror(path);
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    // partial sends are resumed when poll says so
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    return fd;
+}
+
+// sends every request repeat times with at most window in flight and prints
+// the first answer to each, returns the number of failed jobs or -1
+static int run(int fd, int type, request *requests, int count, int repeat, int window)
+{
+    int total = count * repeat, sent = 0, answered = 0, failed = 0;
+    size_t offset = 0, received = 0, capacity = 1 << 16;
+    uint8_t *in = malloc(capacity);
+    double *started = malloc(total * sizeof(double));
+    double began = now(), latency = 0.0;
+
+    while (answered < total)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        if (sent < total && sent - answered < window)
+        {
+            pfd.events |= POLLOUT;
+        }
+
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("poll");
+            break;
+        }
+
+        if (pfd.revents & POLLOUT)
+        {
+            request *req = &requests[sent % count];
+            ssize_t n;
+
+            if (offset == 0)
+            {
+                Crackd_Put32(req->frame + 4, sent);
+                started[sent] = now();
+            }
+
+            n = send(fd, req->frame + offset, req->length - offset, MSG_NOSIGNAL);
+
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                perror("send");
+                break;
+            }
+
+            if (n > 0 && (offset += n) == req->length)
+            {
+                offset = 0;
+                sent++;
+            }
+        }
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ssize_t n;
+
+            if (received == capacity)
+            {
+                capacity *= 2;
+                in = realloc(in, capacity);
+            }
+
+            n = recv(fd, in + received, capacity - received, 0);
+
+            if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            {
+                continue;
+            }
+
+            if (n <= 0)
+            {
+                fprintf(stderr, "Connection closed by the daemon\n");
+                break;
+            }
+
+            received += n;
+
+            // every complete response in the buffer
+            while (received >= CRACKD_HEADER && received - CRACKD_HEADER >= Crackd_Get32(in))
+            {
+                size_t length = Crackd_Get32(in);
+                uint32_t id = Crackd_Get32(in + 4);
+
+                if (id < (uint32_t)total)
+                {
+                    latency += now() - started[id];
+                }
+
+                if (id < (uint32_t)count)
+                {
+                    printAnswer(type, &requests[id], in[8], in + CRACKD_HEADER, length);
+                }
+
+                failed += in[8] != 0;
+                answered++;
+
+                memmove(in, in + CRACKD_HEADER + length, received - CRACKD_HEADER - length);
+                received -= CRACKD_HEADER + length;
+            }
+        }
+    }
+
+    if (repeat > 1 && answered > 0)
+    {
+        double elapsed = now() - began;
+
+        printf("%d jobs in %.3f s, %.0f jobs/s, %.3f ms mean latency\n", answered, elapsed, answered / elapsed,
+               latency / answered * 1e3);
+    }
+
+    free(in);
+    free(started);
+
+    return answered < total ? -1 : failed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socketPath = CRACKD_SOCKET;
+    int opt, type, count = 0, repeat = 1, window = CRACKD_WINDOW, model = 0, minKey = 0, maxKey = 0, fd, ret, i;
+    request *requests;
+
+    while ((opt = getopt(argc, argv, "s:w:n:m:k:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': socketPath = optarg; break;
+            case 'w': window = atoi(optarg); break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'm': model = atoi(optarg); break;
+            case 'k':
+                if (sscanf(optarg, "%d,%d", &minKey, &maxKey) == 1)
+                {
+                    maxKey = minKey;
+                }
+                break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (argc - optind < 1 || repeat < 1 || window < 1)
+    {
+        usage();
+        return -1;
+    }
+
+    if (strcmp(argv[optind], "ping") == 0) type = CRACKD_PING;
+    else if (strcmp(argv[optind], "vigenere") == 0) type = CRACKD_VIGENERE;
+    else if (strcmp(argv[optind], "otp") == 0) type = CRACKD_OTP;
+    else if (strcmp(argv[optind], "padding") == 0) type = CRACKD_PADDING;
+    else
+    {
+        usage();
+        return -1;
+    }
+
+    optind++;
+    requests = calloc(argc - optind + 1, sizeof(request));
+
+    if (type == CRACKD_OTP)
+    {
+        // count || lengths || ciphertexts
+        size_t files = argc - optind, length = 4 + 4 * files, offset;
+        uint8_t **data = calloc(files, sizeof(uint8_t *));
+        size_t *lengths = calloc(files, sizeof(size_t));
+
+        for (i = 0; i < (int)files; i++)
+        {
+            if ((data[i] = Hex_LoadFile(argv[optind + i], &lengths[i])) == NULL)
+            {
+                return -1;
+            }
+
+            length += lengths[i];
+        }
+
+        requests[0].name = "otp";
+        requests[0].frame = newFrame(type, length);
+        requests[0].length = CRACKD_HEADER + length;
+        Crackd_Put32(requests[0].frame + CRACKD_HEADER, files);
+        offset = CRACKD_HEADER + 4 + 4 * files;
+
+        for (i = 0; i < (int)files; i++)
+        {
+            Crackd_Put32(requests[0].frame + CRACKD_HEADER + 4 + 4 * i, lengths[i]);
+            memcpy(requests[0].frame + offset, data[i], lengths[i]);
+            offset += lengths[i];
+            free(data[i]);
+        }
+
+        free(data);
+        free(lengths);
+        count = 1;
+    }
+    else if (type == CRACKD_PING && optind == argc)
+    {
+        requests[0].name = "ping";
+        requests[0].frame = newFrame(type, 0);
+        requests[0].length = CRACKD_HEADER;
+        count = 1;
+    }
+    else
+    {
+        for (i = optind; i < argc; i++, count++)
+        {
+            size_t length, prefix = type == CRACKD_VIGENERE ? 8 : 0;
+            uint8_t *data = Hex_LoadFile(argv[i], &length);
+
+            if (data == NULL)
+            {
+                return -1;
+            }
+
+            requests[count].name = argv[i];
+            requests[count].frame = newFrame(type, prefix + length);
+            requests[count].length = CRACKD_HEADER + prefix + length;
+
+            if (prefix)
+            {
+                uint8_t *body = requests[count].frame + CRACKD_HEADER;
+
+                memset(body, 0, prefix);
+                body[0] = model;
+                Crackd_Put16(body + 2, minKey);
+                Crackd_Put16(body + 4, maxKey);
+            }
+
+            memcpy(requests[count].frame + CRACKD_HEADER + prefix, data, length);
+            free(data);
+        }
+    }
+
+    if ((fd = connectTo(socketPath)) < 0)
+    {
+        return -1;
+    }
+
+    ret = run(fd, type, requests, count, repeat, window);
+    close(fd);
+
+    for (i = 0; i < count; i++)
+    {
+        free(requests[i].frame);
+    }
+
+    free(requests);
+
+    return ret == 0 ? 0 : -1;
+}
@@ -0,0 +1,951 @@
+//
+//  crackd.cpp
+//
+//  Cracking daemon: serves vigenere, otp and padding oracle jobs over a Unix
+//  socket (protocol in crackd.h)
+//
+//  The dictionaries are turned into language models once at startup, the
+//  worker threads are started once, and each worker keeps its padding oracle
+//  connection open between jobs, so a job costs only its own compute. The
+//  main thread multiplexes all clients with poll: it reads requests into a
+//  shared job queue and writes back the responses the workers finish. A
+//  connection is not read while it has CRACKD_WINDOW jobs unanswered, and no
+//  connection is read while the queue is full, which pushes back on clients
+//  through their socket buffers instead of growing memory.
+//
+//  The working memory of a job comes from its worker's arena, which is
+//  reset after every job, so a job allocates nothing from the heap once the
+//  arena has grown to fit. The arena's budget bounds that memory: an otp
+//  job whose pad does not fit is solved a window of columns at a time, and
+//  the most any job used is reported as the job_memory_bytes peak.
+//
+
+#include "crackd.h"
+#include "../common/arena.h"
+#include "../common/crackers.h"
+#include "../common/metrics.h"
+#include "../common/results.h"
+#include "../project 3/oracle.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+typedef vector<uint8_t> byteVector;
+
+const size_t PARALLEL_BYTES = 64 << 10;
+
+// a known key is taken when it scores at least this share of what it scored
+// on the ciphertext it was recovered from
+const double VERIFY_SHARE = 0.9;
+
+// known keys of each length scored after ranking them by fingerprint, and
+// the share of columns a key must match to be scored at all
+const int RANKED_KEYS = 8;
+const size_t MATCH_SHARE = 4;
+
+struct daemonConfig
+{
+    const char *socketPath;
+    int workers;
+    size_t queueDepth;      // jobs waiting over all connections
+    int window;             // unanswered jobs per connection
+    const char *resultsPath;
+    size_t jobMemory;       // arena budget of each worker, in bytes
+};
+
+struct job
+{
+    uint64_t client;
+    uint32_t id;
+    uint8_t type;
+    byteVector body;
+    double received;
+};
+
+struct completion
+{
+    uint64_t client;
+    byteVector frame;
+};
+
+struct client
+{
+    int fd;
+    byteVector in;
+    byteVector out;
+    size_t sent;            // bytes of out already written
+    int unanswered;
+};
+
+struct worker
+{
+    pthread_t thread;
+    int oracleFd;           // kept open between padding oracle jobs
+    arena *memory;          // working memory of the current job
+    crackers::allocator allocator;
+};
+
+static daemonConfig config;
+static vector<crackers::languageModel> models;
+
+// recovered vigenere keys, shared by the workers under resultsLock
+static resultCache *results;
+static pthread_mutex_t resultsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+static deque<job> jobs;
+static deque<completion> completions;
+static bool stopping = false;
+
+// workers write a byte here to wake the poll loop
+static int wakePipe[2];
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static bool loadModel(const char *path)
+{
+    ifstream file(path);
+    crackers::languageModel model;
+    string line;
+
+    if (!file.is_open())
+    {
+        fprintf(stderr, "Could not open file \"%s\"\n", path);
+        return false;
+    }
+
+    while (getline(file, line))
+    {
+        crackers::addLanguageSample(&model, line);
+    }
+
+    if (crackers::finishLanguageModel(&model) != crackers::CRACK_OK)
+    {
+        fprintf(stderr, "%s: no characters\n", path);
+        return false;
+    }
+
+    models.push_back(model);
+
+    return true;
+}
+
+// small jobs run on their worker alone, the workers already keep the cores
+// busy; big ones also spread their columns over the shared pool
+static crackers::options jobOptions(worker *self, size_t bytes)
+{
+    crackers::options opts;
+
+    opts.memory = &self->allocator;
+
+    if (bytes >= PARALLEL_BYTES)
+    {
+        opts.pool = Executor_Default();
+    }
+
+    return opts;
+}
+
+// key lengths that are multiples of the real one score about as well as it,
+// so the shortest length close to the best score is taken; the search stops
+// at the first confident length, which leaves most multiples unscored
+static size_t chooseKeyLength(worker *self, crackers::byteSpan cipherText, size_t minLength, size_t maxLength,
+                              const crackers::options *opts)
+{
+    size_t lengths = maxLength - minLength + 1, count = 0, length = 0;
+    crackers::keyLengthScore *scores =
+        (crackers::keyLengthScore *)Arena_Alloc(self->memory, lengths * sizeof(crackers::keyLengthScore));
+
+    if (scores == NULL ||
+        crackers::findKeyLengths(cipherText, minLength, maxLength, crackers::span<crackers::keyLengthScore>(scores, lengths),
+                                 &count, crackers::CONFIDENT_KEY_LENGTH, opts) != crackers::CRACK_OK || count == 0)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (scores[i].score >= 0.9 * scores[0].score && (length == 0 || scores[i].length < length))
+        {
+            length = scores[i].length;
+        }
+    }
+
+    return length;
+}
+
+// a known key copied out of the cache into the job's arena
+struct knownKey
+{
+    uint8_t *key;
+    size_t length;
+    double confidence;
+    knownKey *next;
+};
+
+static knownKey *copyKnownKey(arena *memory, const resultEntry *entry)
+{
+    knownKey *copy = (knownKey *)Arena_Alloc(memory, sizeof(knownKey));
+
+    if (copy == NULL || (copy->key = (uint8_t *)Arena_Alloc(memory, entry->keyLength)) == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(copy->key, entry->key, entry->keyLength);
+    copy->length = entry->keyLength;
+    copy->confidence = entry->confidence;
+    copy->next = NULL;
+
+    return copy;
+}
+
+// the first candidate that decrypts the ciphertext about as well as the one
+// it was recovered from
+static knownKey *checkKnownKeys(knownKey *candidates, crackers::byteSpan cipherText,
+                                const crackers::languageModel &model)
+{
+    for (knownKey *it = candidates; it != NULL; it = it->next)
+    {
+        double score;
+
+        METRICS_COUNT("known_keys_tried", 1);
+
+        if (crackers::scoreKey(cipherText, model, crackers::byteSpan(it->key, it->length), &score) == crackers::CRACK_OK &&
+            score >= VERIFY_SHARE * it->confidence)
+        {
+            it->confidence = score;
+
+            METRICS_COUNT("result_cache_hits", 1);
+            return it;
+        }
+    }
+
+    return NULL;
+}
+
+// an earlier result for the same ciphertext, or else a key recovered from
+// another one that decrypts this one about as well; only the best few keys
+// of each length by column fingerprint are tried, copied out of the cache so
+// they are checked without holding the lock
+static knownKey *findKnownKey(worker *self, crackers::byteSpan cipherText, uint64_t inputHash, size_t minLength,
+                              size_t maxLength, const crackers::languageModel &model, bool *repeat)
+{
+    knownKey *candidates = NULL, **last = &candidates;
+
+    pthread_mutex_lock(&resultsLock);
+
+    for (const resultEntry *entry = Results_Find(results, RESULT_XOR, inputHash, cipherText.size, NULL);
+         entry != NULL; entry = Results_Find(results, RESULT_XOR, inputHash, cipherText.size, entry))
+    {
+        if (entry->keyLength >= minLength && entry->keyLength <= maxLength)
+        {
+            knownKey *found = copyKnownKey(self->memory, entry);
+
+            pthread_mutex_unlock(&resultsLock);
+
+            if (found != NULL)
+            {
+                *repeat = true;
+
+                METRICS_COUNT("result_cache_hits", 1);
+            }
+
+            return found;
+        }
+    }
+
+    for (size_t length = minLength; length <= maxLength; length++)
+    {
+        while (length <= maxLength && Results_Keys(results, RESULT_XOR, length, NULL) == NULL)
+        {
+            length++;
+        }
+
+        pthread_mutex_unlock(&resultsLock);
+
+        if (length > maxLength)
+        {
+            return checkKnownKeys(candidates, cipherText, model);
+        }
+
+        uint8_t *fingerprint = (uint8_t *)Arena_Alloc(self->memory, length * crackers::FINGERPRINT_GUESSES);
+
+        if (fingerprint == NULL ||
+            crackers::columnFingerprint(cipherText, model, length,
+                                        crackers::span<uint8_t>(fingerprint, length * crackers::FINGERPRINT_GUESSES)) !=
+                crackers::CRACK_OK)
+        {
+            return checkKnownKeys(candidates, cipherText, model);
+        }
+
+        const resultEntry *ranked[RANKED_KEYS];
+
+        pthread_mutex_lock(&resultsLock);
+
+        int count = Results_Rank(results, RESULT_XOR, length, length, fingerprint, crackers::FINGERPRINT_GUESSES,
+                                 (length + MATCH_SHARE - 1) / MATCH_SHARE, ranked, RANKED_KEYS);
+
+        for (int i = 0; i < count && (*last = copyKnownKey(self->memory, ranked[i])) != NULL; i++)
+        {
+            last = &(*last)->next;
+        }
+    }
+
+    pthread_mutex_unlock(&resultsLock);
+
+    return checkKnownKeys(candidates, cipherText, model);
+}
+
+static void storeResult(crackers::byteSpan cipherText, uint64_t inputHash, crackers::byteSpan key, double score)
+{
+    pthread_mutex_lock(&resultsLock);
+    Results_Store(results, RESULT_XOR, inputHash, cipherText.size, key.data, key.size, score);
+    pthread_mutex_unlock(&resultsLock);
+}
+
+static crackers::errorCode runVigenere(worker *self, const byteVector &body, byteVector *out)
+{
+    if (body.size() < 8 || body[0] >= models.size())
+    {
+        return crackers::CRACK_INVALID_ARGUMENT;
+    }
+
+    crackers::byteSpan cipherText(body.data() + 8, body.size() - 8);
+    size_t minLength = Crackd_Get16(&body[2]), maxLength = Crackd_Get16(&body[4]);
+
+    minLength = minLength ? minLength : CRACKD_MIN_KEY;
+    maxLength = min<size_t>(maxLength ? maxLength : CRACKD_MAX_KEY, cipherText.size);
+
+    if (cipherText.size == 0 || minLength > maxLength)
+    {
+        return crackers::CRACK_INVALID_ARGUMENT;
+    }
+
+    const crackers::languageModel &model = models[body[0]];
+    uint64_t inputHash = results ? Results_Hash(cipherText.data, cipherText.size, 0) : 0;
+    knownKey *known = NULL;
+    crackers::span<uint8_t> key;
+    double score;
+    bool repeat = false;
+
+    if (results != NULL && (known = findKnownKey(self, cipherText, inputHash, minLength, maxLength, model, &repeat)) != NULL)
+    {
+        key = crackers::span<uint8_t>(known->key, known->length);
+        score = known->confidence;
+    }
+    else
+    {
+        crackers::options opts = jobOptions(self, body.size());
+        size_t keyLength = minLength == maxLength ? minLength : chooseKeyLength(self, cipherText, minLength, maxLength, &opts);
+
+        if (keyLength == 0)
+        {
+            return crackers::CRACK_NO_SOLUTION;
+        }
+
+        key = crackers::span<uint8_t>((uint8_t *)Arena_Alloc(self->memory, keyLength), keyLength);
+
+        if (key.data == NULL)
+        {
+            return crackers::CRACK_OUT_OF_MEMORY;
+        }
+
+        crackers::errorCode error = crackers::recoverKey(cipherText, model, key, &score, &opts);
+
+        if (error != crackers::CRACK_OK)
+        {
+            return error;
+        }
+    }
+
+    if (results && !repeat)
+    {
+        storeResult(cipherText, inputHash, key, score);
+    }
+
+    out->resize(8 + key.size + cipherText.size);
+
+    Crackd_Put16(out->data(), key.size);
+    Crackd_Put16(out->data() + 2, 0);
+    Crackd_Put32(out->data() + 4, (uint32_t)(score * 1e6));
+    copy(key.begin(), key.end(), out->begin() + 8);
+
+    return crackers::applyKey(cipherText, key, crackers::span<uint8_t>(out->data() + 8 + key.size, cipherText.size));
+}
+
+static void putColumns(const crackers::padColumn *columns, size_t count, byteVector *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out->push_back(columns[i].count);
+        out->insert(out->end(), columns[i].candidates, columns[i].candidates + columns[i].count);
+    }
+}
+
+// the columns of the whole pad when they fit in the arena, or else as many
+// at a time as do; the response is the same either way
+static crackers::errorCode runOtp(worker *self, const byteVector &body, byteVector *out)
+{
+    if (body.size() < 4)
+    {
+        return crackers::CRACK_INVALID_ARGUMENT;
+    }
+
+    size_t count = Crackd_Get32(body.data());
+
+    if (count == 0 || count > (body.size() - 4) / 4)
+    {
+        return crackers::CRACK_INVALID_ARGUMENT;
+    }
+
+    // the ciphertexts, then the part of each that falls in the current window
+    crackers::byteSpan *cipherTexts = (crackers::byteSpan *)Arena_Alloc(self->memory, 2 * count * sizeof(crackers::byteSpan));
+    crackers::byteSpan *slices = cipherTexts + count;
+    size_t offset = 4 + 4 * count;
+
+    if (cipherTexts == NULL)
+    {
+        return crackers::CRACK_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = Crackd_Get32(&body[4 + 4 * i]);
+
+        if (length > body.size() - offset)
+        {
+            return crackers::CRACK_INVALID_ARGUMENT;
+        }
+
+        cipherTexts[i] = crackers::byteSpan(body.data() + offset, length);
+        offset += length;
+    }
+
+    crackers::options opts = jobOptions(self, body.size());
+    size_t length = cipherTexts[0].size, columnCount = 0;
+
+    // allocations are rounded up to 16 bytes
+    size_t window = min(length, Arena_Available(self->memory) / 16 * 16 / sizeof(crackers::padColumn));
+    crackers::padColumn *columns = (crackers::padColumn *)Arena_Alloc(self->memory, window * sizeof(crackers::padColumn));
+
+    if (length > 0 && columns == NULL)
+    {
+        return crackers::CRACK_OUT_OF_MEMORY;
+    }
+
+    if (window < length)
+    {
+        METRICS_COUNT("jobs_streamed", 1);
+    }
+
+    out->resize(4);
+
+    for (size_t first = 0; first < length; first += window)
+    {
+        // a ciphertext that ends before the window is empty in it, and still
+        // stops the columns where it did
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t start = min(first, cipherTexts[i].size);
+
+            slices[i] = crackers::byteSpan(cipherTexts[i].data + start, min(window, cipherTexts[i].size - start));
+        }
+
+        size_t solved;
+        crackers::errorCode error = crackers::solvePad(crackers::span<const crackers::byteSpan>(slices, count),
+                                                       crackers::span<crackers::padColumn>(columns, window), &solved, &opts);
+
+        if (error != crackers::CRACK_OK)
+        {
+            return error;
+        }
+
+        putColumns(columns, solved, out);
+        columnCount += solved;
+    }
+
+    Crackd_Put32(out->data(), columnCount);
+
+    return crackers::CRACK_OK;
+}
+
+static int askPaddingOracle(void *context, const uint8_t *cipherText, size_t blocks)
+{
+    worker *self = (worker *)context;
+
+    if (self->oracleFd < 0 && (self->oracleFd = Oracle_Open()) < 0)
+    {
+        return -1;
+    }
+
+    int ret = Oracle_SendFd(self->oracleFd, (unsigned char *)cipherText, blocks);
+
+    if (ret < 0)
+    {
+        // reconnect on the next job
+        Oracle_Close(self->oracleFd);
+        self->oracleFd = -1;
+    }
+
+    return ret;
+}
+
+static crackers::errorCode runPadding(worker *self, const byteVector &body, byteVector *out)
+{
+    size_t plainLength;
+
+    out->resize(body.size());
+
+    crackers::options opts = jobOptions(self, 0);
+    crackers::errorCode error = crackers::paddingOracleDecrypt(body, askPaddingOracle, self, *out, &plainLength, &opts);
+
+    if (error == crackers::CRACK_OK)
+    {
+        out->resize(plainLength);
+    }
+
+    return error;
+}
+
+static void *work(void *arg)
+{
+    worker *self = (worker *)arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queueLock);
+
+        while (jobs.empty() && !stopping)
+        {
+            pthread_cond_wait(&queueReady, &queueLock);
+        }
+
+        if (stopping)
+        {
+            pthread_mutex_unlock(&queueLock);
+            break;
+        }
+
+        job current = move(jobs.front());
+        jobs.pop_front();
+        pthread_mutex_unlock(&queueLock);
+
+        byteVector body;
+        crackers::errorCode error;
+
+        switch (current.type)
+        {
+            case CRACKD_PING: body = current.body; error = crackers::CRACK_OK; break;
+            case CRACKD_VIGENERE: error = runVigenere(self, current.body, &body); break;
+            case CRACKD_OTP: error = runOtp(self, current.body, &body); break;
+            case CRACKD_PADDING: error = runPadding(self, current.body, &body); break;
+            default: error = crackers::CRACK_INVALID_ARGUMENT; break;
+        }
+
+        if (error != crackers::CRACK_OK)
+        {
+            body.clear();
+        }
+
+        completion done;
+        done.client = current.client;
+        done.frame.resize(CRACKD_HEADER);
+        Crackd_Header(done.frame.data(), body.size(), current.id, error);
+        done.frame.insert(done.frame.end(), body.begin(), body.end());
+
+        METRICS_COUNT("jobs", 1);
+        METRICS_COUNT("bytes_processed", current.body.size());
+        METRICS_LATENCY("job_latency", Metrics_Now() - current.received);
+        METRICS_PEAK("job_memory_bytes", Arena_Peak(self->memory));
+
+        Arena_Reset(self->memory);
+
+        pthread_mutex_lock(&queueLock);
+        completions.push_back(move(done));
+        pthread_mutex_unlock(&queueLock);
+
+        char wake = 0;
+        (void)!write(wakePipe[1], &wake, 1);
+    }
+
+    if (self->oracleFd >= 0)
+    {
+        Oracle_Close(self->oracleFd);
+    }
+
+    Arena_Destroy(self->memory);
+
+    return NULL;
+}
+
+// queues the complete requests in the client's input buffer, as far as its
+// window allows; false when the stream is not a valid request
+static bool takeRequests(uint64_t id, client *conn)
+{
+    size_t offset = 0;
+    bool valid = true;
+    double received = Metrics_Now();
+
+    pthread_mutex_lock(&queueLock);
+
+    while (conn->unanswered < config.window && conn->in.size() - offset >= CRACKD_HEADER)
+    {
+        const uint8_t *header = conn->in.data() + offset;
+        uint32_t length = Crackd_Get32(header);
+
+        if (length > CRACKD_MAX_BODY)
+        {
+            valid = false;
+            break;
+        }
+
+        if (conn->in.size() - offset - CRACKD_HEADER < length)
+        {
+            break;
+        }
+
+        job request;
+        request.client = id;
+        request.id = Crackd_Get32(header + 4);
+        request.type = header[8];
+        request.body.assign(header + CRACKD_HEADER, header + CRACKD_HEADER + length);
+        request.received = received;
+
+        jobs.push_back(move(request));
+        conn->unanswered++;
+        offset += CRACKD_HEADER + length;
+    }
+
+    if (offset > 0)
+    {
+        pthread_cond_broadcast(&queueReady);
+    }
+
+    pthread_mutex_unlock(&queueLock);
+
+    conn->in.erase(conn->in.begin(), conn->in.begin() + offset);
+
+    return valid;
+}
+
+// false when the connection is finished
+static bool readClient(uint64_t id, client *conn)
+{
+    uint8_t buffer[65536];
+    ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        return false;
+    }
+
+    if (n > 0)
+    {
+        conn->in.insert(conn->in.end(), buffer, buffer + n);
+    }
+
+    return takeRequests(id, conn);
+}
+
+static bool writeClient(client *conn)
+{
+    ssize_t n = send(conn->fd, conn->out.data() + conn->sent, conn->out.size() - conn->sent, MSG_NOSIGNAL);
+
+    if (n < 0)
+    {
+        return errno == EAGAIN || errno == EINTR;
+    }
+
+    conn->sent += n;
+
+    if (conn->sent == conn->out.size())
+    {
+        conn->out.clear();
+        conn->sent = 0;
+    }
+
+    return true;
+}
+
+static int listenOn(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        close(fd);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void serve(int listener)
+{
+    unordered_map<uint64_t, client> clients;
+    vector<struct pollfd> fds;
+    vector<uint64_t> owners;
+    uint64_t nextClient = 1;
+
+    while (!interrupted)
+    {
+        pthread_mutex_lock(&queueLock);
+        bool queueFull = jobs.size() >= config.queueDepth;
+        pthread_mutex_unlock(&queueLock);
+
+        fds.clear();
+        owners.clear();
+        fds.push_back({ listener, POLLIN, 0 });
+        fds.push_back({ wakePipe[0], POLLIN, 0 });
+
+        for (auto it = clients.begin(); it != clients.end(); ++it)
+        {
+            short events = 0;
+
+            if (!queueFull && it->second.unanswered < config.window)
+            {
+                events |= POLLIN;
+            }
+
+            if (!it->second.out.empty())
+            {
+                events |= POLLOUT;
+            }
+
+            fds.push_back({ it->second.fd, events, 0 });
+            owners.push_back(it->first);
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+
+            while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                client conn;
+                conn.fd = fd;
+                conn.sent = 0;
+                conn.unanswered = 0;
+                clients[nextClient++] = conn;
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[256];
+            deque<completion> finished;
+
+            (void)!read(wakePipe[0], drain, sizeof(drain));
+
+            pthread_mutex_lock(&queueLock);
+            finished.swap(completions);
+            pthread_mutex_unlock(&queueLock);
+
+            for (auto it = finished.begin(); it != finished.end(); ++it)
+            {
+                auto conn = clients.find(it->client);
+
+                // answers for connections that have gone away are dropped
+                if (conn != clients.end())
+                {
+                    conn->second.out.insert(conn->second.out.end(), it->frame.begin(), it->frame.end());
+                    conn->second.unanswered--;
+
+                    // requests held back by the window
+                    if (!takeRequests(it->client, &conn->second))
+                    {
+                        close(conn->second.fd);
+                        clients.erase(conn);
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 2; i < fds.size(); i++)
+        {
+            auto conn = clients.find(owners[i - 2]);
+            bool open = true;
+
+            if (conn == clients.end() || fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                open = readClient(conn->first, &conn->second);
+            }
+
+            if (open && (fds[i].revents & POLLOUT))
+            {
+                open = writeClient(&conn->second);
+            }
+
+            if (!open)
+            {
+                close(conn->second.fd);
+                clients.erase(conn);
+            }
+        }
+    }
+
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        close(it->second.fd);
+    }
+}
+
+static void usage()
+{
+    printf("Usage: crackd [-s socket] [-w workers] [-q queue_depth] [-W window] [-k results_file] [-m job_megabytes] dictionary...\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, listener;
+
+    config.socketPath = CRACKD_SOCKET;
+    config.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    config.queueDepth = 4096;
+    config.window = CRACKD_WINDOW;
+    config.jobMemory = 64 << 20;
+
+    while ((opt = getopt(argc, argv, "s:w:q:W:k:m:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': config.socketPath = optarg; break;
+            case 'w': config.workers = atoi(optarg); break;
+            case 'q': config.queueDepth = atol(optarg); break;
+            case 'W': config.window = atoi(optarg); break;
+            case 'k': config.resultsPath = optarg; break;
+            case 'm': config.jobMemory = (size_t)atol(optarg) << 20; break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (optind == argc || config.workers < 1 || config.queueDepth < 1 || config.window < 1 || config.jobMemory < 1)
+    {
+        usage();
+        return -1;
+    }
+
+    Metrics_Init("crackd");
+
+    for (int i = optind; i < argc; i++)
+    {
+        if (!loadModel(argv[i]))
+        {
+            return -1;
+        }
+    }
+
+    if (config.resultsPath != NULL && (results = Results_Open(config.resultsPath)) == NULL)
+    {
+        return -1;
+    }
+
+    if (pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    if ((listener = listenOn(config.socketPath)) < 0)
+    {
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    vector<worker> workers(config.workers);
+
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        it->oracleFd = -1;
+        it->memory = Arena_Create(config.jobMemory);
+        it->allocator = crackers::arenaAllocator(it->memory);
+        pthread_create(&it->thread, NULL, work, &*it);
+    }
+
+    printf("Serving %zu language models with %d workers on %s\n", models.size(), config.workers, config.socketPath);
+    fflush(stdout);
+
+    serve(listener);
+
+    pthread_mutex_lock(&queueLock);
+    stopping = true;
+    pthread_cond_broadcast(&queueReady);
+    pthread_mutex_unlock(&queueLock);
+
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        pthread_join(it->thread, NULL);
+    }
+
+    close(listener);
+    unlink(config.socketPath);
+    Results_Close(results);
+
+    return 0;
+}
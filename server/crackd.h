@@ -0,0 +1,84 @@
+//
+//  crackd.h
+//
+//  Wire protocol of the cracking daemon
+//
+//  A client connects to the daemon's Unix socket and sends frames, each a
+//  12-byte header and a body, all integers little-endian:
+//    request   length(4) || id(4) || type(1) || 0(3) || body(length)
+//    response  length(4) || id(4) || status(1) || 0(3) || body(length)
+//  Requests may be pipelined: a client sends as many as it likes without
+//  waiting, and every request gets exactly one response carrying its id, in
+//  the order the jobs finish rather than the order they were sent. status is
+//  a crackers::errorCode (0 for success) and the body is empty unless it is 0.
+//  The daemon stops reading from a connection while CRACKD_WINDOW of its
+//  requests are unanswered, so a client that keeps at most that many in
+//  flight is never blocked, and a faster one is held back by the socket.
+//
+//  Bodies:
+//    CRACKD_PING      any bytes  ->  the same bytes
+//    CRACKD_VIGENERE  model(1) || 0(1) || min_key(2) || max_key(2) || 0(2) || ciphertext
+//                     ->  key_length(2) || 0(2) || score(4) || key || plaintext
+//                     model picks one of the daemon's dictionaries, in the order
+//                     they were given; 0 for min_key or max_key is the default
+//                     range, equal ones fix the key length; score is the mean
+//                     language match of the key's columns in millionths
+//    CRACKD_OTP       count(4) || length(4) * count || ciphertexts
+//                     ->  columns(4) || for each column count(1) || pad bytes(count)
+//    CRACKD_PADDING   IV-prefixed CBC ciphertext  ->  plaintext without padding
+//                     asked of the padding oracle at ORACLE_HOST/ORACLE_PORT
+//
+
+#ifndef CRACKD_H
+#define CRACKD_H
+
+#include <stdint.h>
+
+#define CRACKD_SOCKET "/tmp/crackd.sock"
+
+#define CRACKD_HEADER 12
+#define CRACKD_MAX_BODY (64 << 20)
+#define CRACKD_WINDOW 64
+
+#define CRACKD_PING 0
+#define CRACKD_VIGENERE 1
+#define CRACKD_OTP 2
+#define CRACKD_PADDING 3
+
+#define CRACKD_MIN_KEY 1
+#define CRACKD_MAX_KEY 32
+
+static inline void Crackd_Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void Crackd_Put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t Crackd_Get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static inline uint32_t Crackd_Get32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// the 12-byte header of a request or response
+static inline void Crackd_Header(uint8_t *header, uint32_t length, uint32_t id, uint8_t typeOrStatus)
+{
+    Crackd_Put32(header, length);
+    Crackd_Put32(header + 4, id);
+    header[8] = typeOrStatus;
+    header[9] = header[10] = header[11] = 0;
+}
+
+#endif
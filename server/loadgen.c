@@ -0,0 +1,384 @@
+//
+//  loadgen.c
+//
+//  Load generator for the oracle servers
+//
+//  Opens a number of connections to one oracle, keeps a window of random
+//  queries in flight on each for a fixed time and reports the query rate
+//  and round-trip latency percentiles. With -e it instead runs an attack
+//  command several times and reports its end-to-end time.
+//
+//  The server address comes from ORACLE_HOST (default 127.0.0.1) and the
+//  usual default ports, or -p.
+//
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK_LENGTH 16
+#define MAX_WINDOW 64
+
+// latency histogram: bucket b holds round trips in [2^(b/4), 2^((b+1)/4)) us
+#define BUCKETS 128
+
+typedef struct loadConfig
+{
+    const char *host;
+    int port;
+    int oracle;             // 0 padding, 1 Mac, 2 Vrfy
+    int connections;
+    int window;
+    int blocks;             // query size, in blocks
+    double seconds;
+} loadConfig;
+
+typedef struct workerStats
+{
+    unsigned long queries;
+    unsigned long errors;
+    unsigned long histogram[BUCKETS];
+} workerStats;
+
+static loadConfig config;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bucketFor(double seconds)
+{
+    double us = seconds * 1e6;
+    int bucket = 0;
+
+    while (us >= 1.189207 && bucket < BUCKETS - 1)   // 2^(1/4)
+    {
+        us /= 1.189207;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static double bucketUpper(int bucket)
+{
+    double us = 1.0;
+    int i;
+
+    for (i = 0; i <= bucket; i++)
+    {
+        us *= 1.189207;
+    }
+
+    return us / 1000.0;
+}
+
+static int recvAll(int fd, unsigned char *data, int length)
+{
+    int received = 0, n;
+
+    while (received < length)
+    {
+        n = recv(fd, data + received, length - received, 0);
+
+        if (n <= 0)
+        {
+            return -1;
+        }
+
+        received += n;
+    }
+
+    return 0;
+}
+
+static int connectOracle()
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(config.host);
+    addr.sin_port = htons(config.port);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+// one random query in the oracle's framing, returns its length
+static int buildQuery(unsigned char *query, unsigned int *seed, int *answerLength)
+{
+    int length = config.blocks * BLOCK_LENGTH, i, total;
+
+    switch (config.oracle)
+    {
+        case 0:
+            query[0] = config.blocks;
+            total = length + 2;
+            *answerLength = 2;
+            break;
+        case 1:
+            query[0] = length;
+            total = length + 2;
+            *answerLength = BLOCK_LENGTH;
+            break;
+        default:
+            query[0] = length;
+            total = length + BLOCK_LENGTH + 2;
+            *answerLength = 2;
+            break;
+    }
+
+    for (i = 1; i < total - 1; i++)
+    {
+        query[i] = rand_r(seed);
+    }
+
+    query[total - 1] = '\0';
+
+    return total;
+}
+
+static void *worker(void *arg)
+{
+    workerStats *stats = arg;
+    unsigned char query[2 + 255 + BLOCK_LENGTH], answer[BLOCK_LENGTH];
+    double sent[MAX_WINDOW];
+    unsigned int seed = (unsigned int)(size_t)arg ^ (unsigned int)time(NULL);
+    int fd = -1, inflight = 0, head = 0, length, answerLength = 2;
+    double end = now() + config.seconds;
+
+    while (now() < end || inflight > 0)
+    {
+        if (fd < 0)
+        {
+            if ((fd = connectOracle()) < 0)
+            {
+                stats->errors++;
+                usleep(10000);
+                continue;
+            }
+
+            inflight = 0;
+        }
+
+        // keep the window full until the time is up
+        while (inflight < config.window && now() < end)
+        {
+            length = buildQuery(query, &seed, &answerLength);
+
+            if (send(fd, query, length, MSG_NOSIGNAL) != length)
+            {
+                break;
+            }
+
+            sent[(head + inflight) % MAX_WINDOW] = now();
+            inflight++;
+        }
+
+        if (inflight == 0 || recvAll(fd, answer, answerLength) != 0)
+        {
+            // dropped by the server, start over on a new connection
+            stats->errors++;
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        stats->histogram[bucketFor(now() - sent[head])]++;
+        stats->queries++;
+        head = (head + 1) % MAX_WINDOW;
+        inflight--;
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int runLoad()
+{
+    pthread_t *threads = calloc(config.connections, sizeof(pthread_t));
+    workerStats *stats = calloc(config.connections, sizeof(workerStats));
+    workerStats total;
+    double started = now(), elapsed;
+    int i, b;
+
+    memset(&total, 0, sizeof(total));
+
+    for (i = 0; i < config.connections; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, &stats[i]);
+    }
+
+    for (i = 0; i < config.connections; i++)
+    {
+        pthread_join(threads[i], NULL);
+
+        total.queries += stats[i].queries;
+        total.errors += stats[i].errors;
+
+        for (b = 0; b < BUCKETS; b++)
+        {
+            total.histogram[b] += stats[i].histogram[b];
+        }
+    }
+
+    elapsed = now() - started;
+
+    printf("%lu queries in %.2f s: %.1f queries/s, %lu errors\n",
+           total.queries, elapsed, total.queries / elapsed, total.errors);
+
+    if (total.queries > 0)
+    {
+        double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+        unsigned long seen = 0;
+        int p = 0;
+
+        printf("latency");
+
+        for (b = 0; b < BUCKETS && p < 4; b++)
+        {
+            seen += total.histogram[b];
+
+            while (p < 4 && seen >= percentiles[p] * total.queries)
+            {
+                printf("  p%g <= %.3f ms", percentiles[p] * 100, bucketUpper(b));
+                p++;
+            }
+        }
+
+        printf("\n");
+    }
+
+    free(threads);
+    free(stats);
+
+    return 0;
+}
+
+static int runCommand(const char *command, int runs)
+{
+    double best = 0.0, worst = 0.0, sum = 0.0;
+    int i, failed = 0;
+
+    for (i = 0; i < runs; i++)
+    {
+        double started = now();
+        int status = system(command);
+        double elapsed = now() - started;
+
+        if (status != 0)
+        {
+            failed++;
+        }
+
+        if (i == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+
+        if (elapsed > worst)
+        {
+            worst = elapsed;
+        }
+
+        sum += elapsed;
+    }
+
+    printf("%d runs, %d failed: min %.3f s, avg %.3f s, max %.3f s\n",
+           runs, failed, best, sum / runs, worst);
+
+    return failed ? -1 : 0;
+}
+
+static void usage()
+{
+    printf("Usage: loadgen [-o padding|mac|vrfy] [-c connections] [-w window] [-s blocks] [-t seconds] [-p port]\n");
+    printf("       loadgen -e <command> [-n runs]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *command = NULL;
+    int defaultPorts[] = { 6667, 6668, 6669 };
+    int opt, runs = 1;
+
+    config.host = getenv("ORACLE_HOST") ? getenv("ORACLE_HOST") : "127.0.0.1";
+    config.connections = 8;
+    config.window = 1;
+    config.blocks = 2;
+    config.seconds = 5.0;
+
+    while ((opt = getopt(argc, argv, "o:c:w:s:t:p:e:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                if (strcmp(optarg, "padding") == 0) config.oracle = 0;
+                else if (strcmp(optarg, "mac") == 0) config.oracle = 1;
+                else if (strcmp(optarg, "vrfy") == 0) config.oracle = 2;
+                else
+                {
+                    usage();
+                    return -1;
+                }
+                break;
+            case 'c': config.connections = atoi(optarg); break;
+            case 'w': config.window = atoi(optarg); break;
+            case 's': config.blocks = atoi(optarg); break;
+            case 't': config.seconds = atof(optarg); break;
+            case 'p': config.port = atoi(optarg); break;
+            case 'e': command = optarg; break;
+            case 'n': runs = atoi(optarg); break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (command != NULL)
+    {
+        return runCommand(command, runs < 1 ? 1 : runs);
+    }
+
+    if (config.connections < 1 || config.window < 1 || config.window > MAX_WINDOW ||
+        config.blocks < 1 || config.blocks > 15)
+    {
+        usage();
+        return -1;
+    }
+
+    if (config.port == 0)
+    {
+        config.port = defaultPorts[config.oracle];
+    }
+
+    return runLoad();
+}
@@ -0,0 +1,577 @@
+//
+//  oracle_server.c
+//
+//  Local stand-in for the remote padding, Mac and Vrfy oracles
+//
+//  Speaks the same wire protocols as the course server:
+//    padding (6667): < num_blocks(1) || ciphertext(16*num_blocks) || 0 >  ->  "1" / "0"
+//    Mac     (6668): < mlength(1) || message(mlength) || 0 >              ->  tag(16)
+//    Vrfy    (6669): < mlength(1) || message(mlength) || tag(16) || 0 >   ->  "1" / "0"
+//  The padding oracle decrypts with AES-128-CBC (first block is the IV) and
+//  checks PKCS#7 padding; Mac is CBC-MAC with a zero IV and zero padding.
+//  Every connection gets its own thread, and answers can be delayed, jittered,
+//  rate limited and dropped to imitate a remote, throttled server. The delay
+//  is latency, not service time: a second thread per connection sends each
+//  answer once it is due while the first goes on reading, so pipelined
+//  requests overlap as they would over a slow link.
+//
+//  Point the clients at it with ORACLE_HOST=127.0.0.1.
+//
+
+#include "../common/aes.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PADDING_ORACLE 0
+#define MAC_ORACLE 1
+#define VRFY_ORACLE 2
+
+#define QUEUE_DEPTH 256     // answers waiting to be sent on one connection
+
+typedef struct serverConfig
+{
+    aesKey key;
+    int ports[3];
+    double delay;           // seconds added to every answer
+    double jitter;          // up to this many extra seconds
+    double rate;            // answers per second over all connections, 0 for unlimited
+    double burst;
+    double dropRate;        // chance of closing the connection instead of answering
+    int maxMac;             // longest message Mac answers, longer ones get a zero tag
+} serverConfig;
+
+// an answer held back until its due time
+typedef struct pendingAnswer
+{
+    unsigned char out[AES_BLOCK];
+    int length;
+    int drop;               // close the connection instead of sending it
+    double due;
+} pendingAnswer;
+
+typedef struct connection
+{
+    int fd;
+    int oracle;
+    unsigned int seed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pendingAnswer queue[QUEUE_DEPTH];
+    int head;
+    int count;
+    int reading;            // cleared when the client stops sending
+    int sending;            // cleared when the sender gives up on the connection
+} connection;
+
+static serverConfig config;
+
+static pthread_mutex_t bucketLock = PTHREAD_MUTEX_INITIALIZER;
+static double tokens;
+static double lastRefill;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepFor(double seconds)
+{
+    struct timespec ts;
+
+    if (seconds <= 0.0)
+    {
+        return;
+    }
+
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+// the server-side throttle: queries beyond the rate wait for a token
+static void throttle()
+{
+    if (config.rate <= 0.0)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&bucketLock);
+
+        double t = now();
+        tokens += (t - lastRefill) * config.rate;
+        lastRefill = t;
+
+        if (tokens > config.burst)
+        {
+            tokens = config.burst;
+        }
+
+        if (tokens >= 1.0)
+        {
+            tokens -= 1.0;
+            pthread_mutex_unlock(&bucketLock);
+            return;
+        }
+
+        double wait = (1.0 - tokens) / config.rate;
+        pthread_mutex_unlock(&bucketLock);
+
+        sleepFor(wait);
+    }
+}
+
+static int recvAll(int fd, unsigned char *data, int length)
+{
+    int received = 0, n;
+
+    while (received < length)
+    {
+        n = recv(fd, data + received, length - received, 0);
+
+        if (n <= 0)
+        {
+            return -1;
+        }
+
+        received += n;
+    }
+
+    return 0;
+}
+
+static int sendAll(int fd, const unsigned char *data, int length)
+{
+    int sent = 0, n;
+
+    while (sent < length)
+    {
+        n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+
+        if (n <= 0)
+        {
+            return -1;
+        }
+
+        sent += n;
+    }
+
+    return 0;
+}
+
+// reads one request and fills in the answer, returns the answer length
+static int answer(connection *conn, unsigned char *out)
+{
+    unsigned char in[1 + 255 * AES_BLOCK + AES_BLOCK + 1];
+    int length;
+
+    if (recvAll(conn->fd, in, 1) != 0)
+    {
+        return -1;
+    }
+
+    switch (conn->oracle)
+    {
+        case PADDING_ORACLE:
+            length = in[0] * AES_BLOCK;
+
+            if (recvAll(conn->fd, in + 1, length + 1) != 0)
+            {
+                return -1;
+            }
+
+            out[0] = '0' + AES_PaddingCheck(&config.key, in + 1, in[0]);
+            out[1] = '\0';
+            return 2;
+
+        case MAC_ORACLE:
+            length = in[0];
+
+            if (recvAll(conn->fd, in + 1, length + 1) != 0)
+            {
+                return -1;
+            }
+
+            if (length > config.maxMac)
+            {
+                memset(out, 0, AES_BLOCK);
+            }
+            else
+            {
+                AES_CbcMac(&config.key, in + 1, length, out);
+            }
+
+            return AES_BLOCK;
+
+        default:
+        {
+            unsigned char tag[AES_BLOCK];
+
+            length = in[0];
+
+            if (recvAll(conn->fd, in + 1, length + AES_BLOCK + 1) != 0)
+            {
+                return -1;
+            }
+
+            AES_CbcMac(&config.key, in + 1, length, tag);
+
+            out[0] = memcmp(tag, in + 1 + length, AES_BLOCK) == 0 ? '1' : '0';
+            out[1] = '\0';
+            return 2;
+        }
+    }
+}
+
+// sends the queued answers in order, each no earlier than its due time
+static void *sendAnswers(void *arg)
+{
+    connection *conn = arg;
+    pendingAnswer item;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&conn->lock);
+
+        while (conn->count == 0 && conn->reading)
+        {
+            pthread_cond_wait(&conn->changed, &conn->lock);
+        }
+
+        if (conn->count == 0)
+        {
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        }
+
+        // only the reader appends, so the head stays put while unlocked
+        item = conn->queue[conn->head];
+        pthread_mutex_unlock(&conn->lock);
+
+        sleepFor(item.due - now());
+        throttle();
+
+        if (item.drop || sendAll(conn->fd, item.out, item.length) != 0)
+        {
+            break;
+        }
+
+        pthread_mutex_lock(&conn->lock);
+        conn->head = (conn->head + 1) % QUEUE_DEPTH;
+        conn->count--;
+        pthread_cond_signal(&conn->changed);
+        pthread_mutex_unlock(&conn->lock);
+    }
+
+    // wakes the reader out of recv or a full queue
+    pthread_mutex_lock(&conn->lock);
+    conn->sending = 0;
+    pthread_cond_signal(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    shutdown(conn->fd, SHUT_RDWR);
+
+    return NULL;
+}
+
+// reads requests and queues their answers, stamped with when they are due
+static void *serve(void *arg)
+{
+    connection *conn = arg;
+    pendingAnswer item;
+    pthread_t sender;
+    double last = 0.0;
+
+    if (pthread_create(&sender, NULL, sendAnswers, conn) != 0)
+    {
+        pthread_mutex_destroy(&conn->lock);
+        pthread_cond_destroy(&conn->changed);
+        close(conn->fd);
+        free(conn);
+        return NULL;
+    }
+
+    while ((item.length = answer(conn, item.out)) > 0)
+    {
+        // answers leave in order, so a short jitter waits behind a long one
+        item.due = now() + config.delay + config.jitter * rand_r(&conn->seed) / RAND_MAX;
+        item.due = item.due > last ? item.due : last;
+        item.drop = config.dropRate > 0.0 && (double)rand_r(&conn->seed) / RAND_MAX < config.dropRate;
+        last = item.due;
+
+        pthread_mutex_lock(&conn->lock);
+
+        while (conn->count == QUEUE_DEPTH && conn->sending)
+        {
+            pthread_cond_wait(&conn->changed, &conn->lock);
+        }
+
+        if (!conn->sending)
+        {
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        }
+
+        conn->queue[(conn->head + conn->count) % QUEUE_DEPTH] = item;
+        conn->count++;
+        pthread_cond_signal(&conn->changed);
+        pthread_mutex_unlock(&conn->lock);
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    conn->reading = 0;
+    pthread_cond_signal(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+
+    pthread_join(sender, NULL);
+
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->changed);
+    close(conn->fd);
+    free(conn);
+
+    return NULL;
+}
+
+static int listenOn(int port)
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int parseKey(const char *hex, unsigned char *key)
+{
+    unsigned int tmp;
+    int i;
+
+    if (strlen(hex) != 2 * AES_BLOCK)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < AES_BLOCK; i++)
+    {
+        if (sscanf(hex + i * 2, "%02x", &tmp) != 1)
+        {
+            return -1;
+        }
+
+        key[i] = tmp;
+    }
+
+    return 0;
+}
+
+// encrypts a plaintext file under the server key with a random IV and prints
+// the IV-prefixed ciphertext as hex, for making challenge ciphertexts
+static int encryptFile(const char *path)
+{
+    unsigned char buffer[4096 + 2 * AES_BLOCK];
+    FILE *fpIn = fopen(path, "rb");
+    int length, padding, i;
+
+    if (fpIn == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    length = fread(buffer + AES_BLOCK, 1, 4096, fpIn);
+    fclose(fpIn);
+
+    padding = AES_BLOCK - length % AES_BLOCK;
+    memset(buffer + AES_BLOCK + length, padding, padding);
+    length += padding;
+
+    for (i = 0; i < AES_BLOCK; i++)
+    {
+        buffer[i] = rand();
+    }
+
+    AES_CbcEncrypt(&config.key, buffer, buffer + AES_BLOCK, buffer + AES_BLOCK, length / AES_BLOCK);
+
+    for (i = 0; i < length + AES_BLOCK; i++)
+    {
+        printf("%02X", buffer[i]);
+    }
+
+    printf("\n");
+
+    return 0;
+}
+
+static void usage()
+{
+    printf("Usage: oracle_server [-k key] [-p port,mac_port,vrfy_port] [-d delay_ms] [-j jitter_ms]\n");
+    printf("                     [-r answers/sec] [-b burst] [-x drop_rate] [-m max_mac_length]\n");
+    printf("       oracle_server [-k key] -e <plaintext_file>\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char key[AES_BLOCK] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                     0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+    const char *encryptPath = NULL;
+    int listeners[3];
+    int opt, i;
+
+    config.ports[PADDING_ORACLE] = 6667;
+    config.ports[MAC_ORACLE] = 6668;
+    config.ports[VRFY_ORACLE] = 6669;
+    config.burst = 1.0;
+    config.maxMac = 255;
+
+    while ((opt = getopt(argc, argv, "k:p:d:j:r:b:x:m:e:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'k':
+                if (parseKey(optarg, key) != 0)
+                {
+                    printf("Key must be %d hex bytes\n", AES_BLOCK);
+                    return -1;
+                }
+                break;
+            case 'p':
+                if (sscanf(optarg, "%d,%d,%d", &config.ports[0], &config.ports[1], &config.ports[2]) != 3)
+                {
+                    usage();
+                    return -1;
+                }
+                break;
+            case 'd': config.delay = atof(optarg) / 1000.0; break;
+            case 'j': config.jitter = atof(optarg) / 1000.0; break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'b': config.burst = atof(optarg); break;
+            case 'x': config.dropRate = atof(optarg); break;
+            case 'm': config.maxMac = atoi(optarg); break;
+            case 'e': encryptPath = optarg; break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    AES_SetKey(&config.key, key);
+    srand(time(NULL) ^ getpid());
+
+    if (encryptPath != NULL)
+    {
+        return encryptFile(encryptPath);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    tokens = config.burst;
+    lastRefill = now();
+
+    for (i = 0; i < 3; i++)
+    {
+        if ((listeners[i] = listenOn(config.ports[i])) < 0)
+        {
+            return -1;
+        }
+    }
+
+    printf("Listening on %d (padding), %d (Mac), %d (Vrfy), AES-NI %s\n",
+           config.ports[0], config.ports[1], config.ports[2], AES_HasHardware() ? "on" : "off");
+    fflush(stdout);
+
+    struct pollfd fds[3];
+
+    for (i = 0; i < 3; i++)
+    {
+        fds[i].fd = listeners[i];
+        fds[i].events = POLLIN;
+    }
+
+    for (;;)
+    {
+        if (poll(fds, 3, -1) < 0)
+        {
+            continue;
+        }
+
+        for (i = 0; i < 3; i++)
+        {
+            if (!(fds[i].revents & POLLIN))
+            {
+                continue;
+            }
+
+            int fd = accept(listeners[i], NULL, NULL), on = 1;
+
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            connection *conn = calloc(1, sizeof(connection));
+            pthread_t thread;
+
+            if (conn == NULL)
+            {
+                close(fd);
+                continue;
+            }
+
+            conn->fd = fd;
+            conn->oracle = i;
+            conn->seed = rand();
+            conn->reading = 1;
+            conn->sending = 1;
+            pthread_mutex_init(&conn->lock, NULL);
+            pthread_cond_init(&conn->changed, NULL);
+
+            if (pthread_create(&thread, NULL, serve, conn) != 0)
+            {
+                pthread_mutex_destroy(&conn->lock);
+                pthread_cond_destroy(&conn->changed);
+                close(fd);
+                free(conn);
+                continue;
+            }
+
+            pthread_detach(thread);
+        }
+    }
+}
@@ -0,0 +1,232 @@
+//
+//  corpus.c
+//
+//  Packs ciphertext files into an indexed corpus file and reads them back
+//
+//  Hex input files are decoded once when packing (binary ones with -b), and
+//  each record keeps its source file name as metadata. vigenere, otp and
+//  batch accept the packed file wherever they take a ciphertext file.
+//
+
+#include "../common/corpusfile.h"
+#include "../common/hex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *typeNames[] = { "unknown", "xor", "otp", "cbc", "mac" };
+
+static void usage()
+{
+    printf("Usage: corpus pack [-t xor|otp|cbc|mac] [-b] <corpus_file> <filename>...\n");
+    printf("       corpus list <corpus_file>\n");
+    printf("       corpus get [-b] <corpus_file> <index>\n");
+}
+
+static uint8_t *loadBinary(const char *path, size_t *length)
+{
+    FILE *fpIn = fopen(path, "rb");
+    uint8_t *data;
+    long size;
+
+    if (fpIn == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(fpIn, 0, SEEK_END);
+    size = ftell(fpIn);
+    fseek(fpIn, 0, SEEK_SET);
+
+    data = malloc(size + 1);
+    *length = fread(data, 1, size, fpIn);
+    fclose(fpIn);
+
+    return data;
+}
+
+static int pack(int argc, char *argv[])
+{
+    corpusWriter *writer;
+    int opt, type = CORPUS_UNKNOWN, binary = 0, i, t;
+
+    while ((opt = getopt(argc, argv, "t:b")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                for (t = 1; t <= CORPUS_MAC && strcmp(optarg, typeNames[t]) != 0; t++);
+
+                if (t > CORPUS_MAC)
+                {
+                    usage();
+                    return -1;
+                }
+
+                type = t;
+                break;
+            case 'b': binary = 1; break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (argc - optind < 2)
+    {
+        usage();
+        return -1;
+    }
+
+    if ((writer = CorpusFile_Create(argv[optind])) == NULL)
+    {
+        return -1;
+    }
+
+    for (i = optind + 1; i < argc; i++)
+    {
+        size_t length;
+        uint8_t *data = binary ? loadBinary(argv[i], &length) : Hex_LoadFile(argv[i], &length);
+
+        if (data == NULL)
+        {
+            CorpusFile_Finish(writer);
+            return -1;
+        }
+
+        if (CorpusFile_Append(writer, data, length, type, argv[i], strlen(argv[i])) != 0)
+        {
+            free(data);
+            CorpusFile_Finish(writer);
+            return -1;
+        }
+
+        free(data);
+    }
+
+    if (CorpusFile_Finish(writer) != 0)
+    {
+        return -1;
+    }
+
+    printf("%d records written to %s\n", argc - optind - 1, argv[optind]);
+
+    return 0;
+}
+
+static int list(int argc, char *argv[])
+{
+    corpusFile *file;
+    corpusRecord record;
+    size_t i;
+
+    if (argc != 3 || (file = CorpusFile_Open(argv[2])) == NULL)
+    {
+        if (argc != 3)
+        {
+            usage();
+        }
+
+        return -1;
+    }
+
+    for (i = 0; i < CorpusFile_Count(file); i++)
+    {
+        if (CorpusFile_Record(file, i, &record) != 0)
+        {
+            printf("%zu: damaged entry\n", i);
+            continue;
+        }
+
+        printf("%zu\t%s\t%zu bytes\t%.*s\n", i, typeNames[record.type <= CORPUS_MAC ? record.type : 0],
+               record.length, (int)record.metadataLength, record.metadata);
+    }
+
+    CorpusFile_Close(file);
+
+    return 0;
+}
+
+static int get(int argc, char *argv[])
+{
+    corpusFile *file;
+    corpusRecord record;
+    int opt, binary = 0, ret = 0;
+
+    while ((opt = getopt(argc, argv, "b")) != -1)
+    {
+        if (opt != 'b')
+        {
+            usage();
+            return -1;
+        }
+
+        binary = 1;
+    }
+
+    if (argc - optind != 2)
+    {
+        usage();
+        return -1;
+    }
+
+    if ((file = CorpusFile_Open(argv[optind])) == NULL)
+    {
+        return -1;
+    }
+
+    if (CorpusFile_Record(file, strtoul(argv[optind + 1], NULL, 10), &record) != 0)
+    {
+        printf("No record %s in %s\n", argv[optind + 1], argv[optind]);
+        ret = -1;
+    }
+    else if (binary)
+    {
+        fwrite(record.data, 1, record.length, stdout);
+    }
+    else
+    {
+        char *hex = malloc(record.length * 2 + 1);
+
+        Hex_Encode(record.data, record.length, hex);
+        hex[record.length * 2] = '\n';
+        fwrite(hex, 1, record.length * 2 + 1, stdout);
+        free(hex);
+    }
+
+    CorpusFile_Close(file);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return -1;
+    }
+
+    // the subcommands parse their own options after the command name
+    optind = 2;
+
+    if (strcmp(argv[1], "pack") == 0)
+    {
+        return pack(argc, argv);
+    }
+    else if (strcmp(argv[1], "list") == 0)
+    {
+        return list(argc, argv);
+    }
+    else if (strcmp(argv[1], "get") == 0)
+    {
+        return get(argc, argv);
+    }
+
+    usage();
+
+    return -1;
+}
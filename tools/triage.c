@@ -0,0 +1,609 @@
+//
+//  triage.c
+//
+//  Classifies unlabelled hex ciphertexts and routes each to its cracker
+//
+//  Every file is read once, in chunks, and profiled on the way: byte
+//  histogram (entropy and index of coincidence), coincidences between bytes
+//  1 to MAX_LAG apart (periodicity), length (block alignment) and a prefix
+//  kept for comparing files with each other. Then:
+//    plain   mostly printable ASCII, nothing to crack
+//    xor     coincidences peak at multiples of the key length, for vigenere
+//    otp     the XOR of its prefix with another file's is ASCII, as text
+//            XOR text is; grouped with those files, for otp
+//    cbc     whole 16-byte blocks (IV included) that look random, for batch
+//    random  none of the above
+//  The output is a shell script: a comment with the profile of every input,
+//  then one command per cracker job. -x runs the commands instead.
+//
+
+#include "../common/executor.h"
+#include "../common/hex.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE 65536
+#define MAX_LAG 64              // twice the longest key crackd takes
+#define PREFIX_BYTES 64
+#define MAX_CANDIDATES 4
+#define PATH_LENGTH 4096
+
+#define BLOCK_SIZE 16
+#define PRINTABLE_SHARE 0.95
+#define MIN_PEAK_RATE 0.03      // English pairs up about one time in 15, random bytes one in 256
+#define MIN_PEAK_COINCIDENCES 8
+#define PERIOD_SHARE 0.7          // a divisor of the key length scores about half
+#define MAX_RANDOM_IC 0.012
+#define MIN_OVERLAP 24
+#define MIN_ASCII_SHARE 0.95
+#define MIN_OTP_GROUP 3         // otp needs three ciphertexts
+
+enum { TYPE_INVALID, TYPE_PLAIN, TYPE_XOR, TYPE_OTP, TYPE_CBC, TYPE_RANDOM, TYPE_COUNT };
+
+static const char *typeNames[] = { "invalid", "plain", "xor", "otp", "cbc", "random" };
+
+typedef struct profile
+{
+    const char *path;
+    int valid;
+    size_t length;
+    size_t printable;
+    size_t counts[256];
+    size_t coincidences[MAX_LAG + 1];
+    uint8_t prefix[PREFIX_BYTES];
+
+    double entropy;
+    double ic;
+    int candidates[MAX_CANDIDATES];
+    int candidateCount;
+    int type;
+    int group;                  // index of the first file of its otp group
+} profile;
+
+typedef struct triageContext
+{
+    profile *profiles;
+} triageContext;
+
+static void usage()
+{
+    printf("Usage: triage [-d tool_directory] [-w dictionary] [-x] <filename>...\n");
+}
+
+static int isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// data[-MAX_LAG..0) holds the bytes before it, where there are any
+static void profileBytes(profile *prof, const uint8_t *data, size_t length)
+{
+    size_t i, start;
+    int lag;
+
+    for (i = 0; i < length; i++)
+    {
+        prof->counts[data[i]]++;
+        prof->printable += (data[i] >= 0x20 && data[i] < 0x7F) || data[i] == '\n' || data[i] == '\r' || data[i] == '\t';
+    }
+
+    for (lag = 1; lag <= MAX_LAG; lag++)
+    {
+        size_t same = 0;
+
+        start = prof->length >= (size_t)lag ? 0 : lag - prof->length;
+
+        for (i = start; i < length; i++)
+        {
+            same += data[i] == data[(ptrdiff_t)i - lag];
+        }
+
+        prof->coincidences[lag] += same;
+    }
+
+    for (i = prof->length; i < PREFIX_BYTES && i - prof->length < length; i++)
+    {
+        prof->prefix[i] = data[i - prof->length];
+    }
+
+    prof->length += length;
+}
+
+static int profileFile(profile *prof, char *text, uint8_t *window)
+{
+    uint8_t *bytes = window + MAX_LAG;
+    size_t carried = 0;
+    ssize_t got;
+    int fd = open(prof->path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    while ((got = read(fd, text + carried, CHUNK_SIZE)) > 0)
+    {
+        size_t digits = carried, i;
+        long decoded;
+
+        for (i = carried; i < carried + (size_t)got; i++)
+        {
+            if (!isSpace(text[i]))
+            {
+                text[digits++] = text[i];
+            }
+        }
+
+        // an odd digit waits for its partner in the next chunk
+        carried = digits & 1;
+        decoded = Hex_Decode(text, digits - carried, bytes);
+
+        if (decoded < 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        profileBytes(prof, bytes, decoded);
+        text[0] = text[digits - carried];
+
+        if (decoded >= MAX_LAG)
+        {
+            memcpy(window, bytes + decoded - MAX_LAG, MAX_LAG);
+        }
+        else
+        {
+            memmove(window, window + decoded, MAX_LAG);
+        }
+    }
+
+    close(fd);
+
+    return got < 0 || carried ? -1 : 0;
+}
+
+// a period scores the mean coincidence rate over its multiples up to MAX_LAG,
+// which averages out the noise of single lags; key length candidates are the shortest period
+// among the best, then the other good periods that are not its multiples
+static void findPeriods(profile *prof)
+{
+    double scores[MAX_LAG + 1], best = 0.0;
+    int period, maxLag = (int)(prof->length / 2 < MAX_LAG ? prof->length / 2 : MAX_LAG);
+    int maxPeriod = maxLag / 2;     // at least two lags to average
+
+    prof->candidateCount = 0;
+
+    for (period = 1; period <= maxPeriod; period++)
+    {
+        size_t same = 0, pairs = 0;
+        int lag;
+
+        for (lag = period; lag <= maxLag; lag += period)
+        {
+            same += prof->coincidences[lag];
+            pairs += prof->length - lag;
+        }
+
+        scores[period] = same >= MIN_PEAK_COINCIDENCES ? (double)same / pairs : 0.0;
+        best = scores[period] > best ? scores[period] : best;
+    }
+
+    if (best < MIN_PEAK_RATE)
+    {
+        return;
+    }
+
+    for (period = 1; period <= maxPeriod; period++)
+    {
+        if (scores[period] >= PERIOD_SHARE * best)
+        {
+            prof->candidates[prof->candidateCount++] = period;
+            break;
+        }
+    }
+
+    while (prof->candidateCount < MAX_CANDIDATES)
+    {
+        int next = 0, i, taken;
+
+        for (period = 1; period <= maxPeriod; period++)
+        {
+            for (i = 0, taken = 0; i < prof->candidateCount; i++)
+            {
+                taken |= period % prof->candidates[i] == 0;
+            }
+
+            if (!taken && scores[period] >= PERIOD_SHARE * best &&
+                (next == 0 || scores[period] > scores[next]))
+            {
+                next = period;
+            }
+        }
+
+        if (next == 0)
+        {
+            break;
+        }
+
+        prof->candidates[prof->candidateCount++] = next;
+    }
+}
+
+static void classify(profile *prof)
+{
+    size_t i;
+
+    prof->entropy = 0.0;
+    prof->ic = 0.0;
+
+    for (i = 0; i < 256; i++)
+    {
+        if (prof->counts[i] > 0)
+        {
+            double share = (double)prof->counts[i] / prof->length;
+
+            prof->entropy -= share * log2(share);
+            prof->ic += (double)prof->counts[i] * (prof->counts[i] - 1);
+        }
+    }
+
+    prof->ic = prof->length > 1 ? prof->ic / ((double)prof->length * (prof->length - 1)) : 0.0;
+
+    findPeriods(prof);
+
+    if (!prof->valid || prof->length == 0)
+    {
+        prof->type = TYPE_INVALID;
+    }
+    else if (prof->printable >= PRINTABLE_SHARE * prof->length)
+    {
+        prof->type = TYPE_PLAIN;
+    }
+    else if (prof->candidateCount > 0)
+    {
+        prof->type = TYPE_XOR;
+    }
+    else if (prof->length % BLOCK_SIZE == 0 && prof->length >= 2 * BLOCK_SIZE && prof->ic < MAX_RANDOM_IC)
+    {
+        prof->type = TYPE_CBC;
+    }
+    else
+    {
+        prof->type = TYPE_RANDOM;
+    }
+}
+
+static void profileRange(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    triageContext *triage = (triageContext *)context;
+    char *text = (char *)malloc(CHUNK_SIZE + 1);
+    uint8_t *window = (uint8_t *)malloc(MAX_LAG + CHUNK_SIZE / 2 + 1);
+    size_t i;
+
+    (void)group;
+
+    for (i = begin; i < end; i++)
+    {
+        profile *prof = &triage->profiles[i];
+
+        prof->valid = profileFile(prof, text, window) == 0;
+        classify(prof);
+    }
+
+    free(text);
+    free(window);
+}
+
+// same pad: text XOR text is ASCII, random XOR anything is half the time;
+// copies of one file XOR to zeros and say nothing
+static int samePad(const profile *a, const profile *b)
+{
+    size_t overlap = a->length < b->length ? a->length : b->length, ascii = 0, zeros = 0, i;
+
+    overlap = overlap < PREFIX_BYTES ? overlap : PREFIX_BYTES;
+
+    if (overlap < MIN_OVERLAP)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < overlap; i++)
+    {
+        ascii += ((a->prefix[i] ^ b->prefix[i]) & 0x80) == 0;
+        zeros += a->prefix[i] == b->prefix[i];
+    }
+
+    return ascii >= MIN_ASCII_SHARE * overlap && zeros < overlap / 2;
+}
+
+// each file joins the first group whose first file it matches, so the cost
+// grows with the number of groups rather than of pairs
+static void groupPads(profile *profiles, int count)
+{
+    int *leaders = (int *)malloc(count * sizeof(int));
+    int *members = (int *)calloc(count, sizeof(int));
+    int leaderCount = 0, i, j;
+
+    for (i = 0; i < count; i++)
+    {
+        profile *prof = &profiles[i];
+
+        prof->group = -1;
+
+        if (prof->type != TYPE_RANDOM && prof->type != TYPE_CBC)
+        {
+            continue;
+        }
+
+        for (j = 0; j < leaderCount && !samePad(&profiles[leaders[j]], prof); j++);
+
+        if (j == leaderCount)
+        {
+            leaders[leaderCount++] = i;
+        }
+
+        prof->group = leaders[j];
+        members[leaders[j]]++;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (profiles[i].group >= 0 && members[profiles[i].group] >= MIN_OTP_GROUP)
+        {
+            profiles[i].type = TYPE_OTP;
+        }
+    }
+
+    free(leaders);
+    free(members);
+}
+
+static void printQuoted(const char *word)
+{
+    if (strpbrk(word, " \t\n'\"\\$`*?[]#;&|<>()") == NULL)
+    {
+        fputs(word, stdout);
+        return;
+    }
+
+    putchar('\'');
+
+    for (; *word; word++)
+    {
+        if (*word == '\'')
+        {
+            fputs("'\\''", stdout);
+        }
+        else
+        {
+            putchar(*word);
+        }
+    }
+
+    putchar('\'');
+}
+
+static int runCommand(char **args)
+{
+    int i, status;
+    pid_t pid;
+
+    for (i = 0; args[i] != NULL; i++)
+    {
+        putchar(i ? ' ' : '\n');
+        printQuoted(args[i]);
+    }
+
+    putchar('\n');
+    fflush(stdout);
+
+    if ((pid = fork()) == 0)
+    {
+        execv(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+    {
+        return -1;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int dispatch(char **args, int execute)
+{
+    int i;
+
+    if (execute)
+    {
+        return runCommand(args);
+    }
+
+    for (i = 0; args[i] != NULL; i++)
+    {
+        if (i)
+        {
+            putchar(' ');
+        }
+
+        printQuoted(args[i]);
+    }
+
+    putchar('\n');
+
+    return 0;
+}
+
+static void printProfile(const profile *prof, const profile *profiles)
+{
+    int i;
+
+    printf("# %s: %s", prof->path, typeNames[prof->type]);
+
+    if (prof->type != TYPE_INVALID)
+    {
+        printf(", %zu bytes, entropy %.2f, ic %.4f", prof->length, prof->entropy, prof->ic);
+    }
+
+    if (prof->type == TYPE_XOR)
+    {
+        printf(", key length");
+
+        for (i = 0; i < prof->candidateCount; i++)
+        {
+            printf(" %d", prof->candidates[i]);
+        }
+    }
+
+    if (prof->type == TYPE_CBC)
+    {
+        printf(", %zu blocks after the IV", prof->length / BLOCK_SIZE - 1);
+    }
+
+    if (prof->type == TYPE_OTP)
+    {
+        printf(", same pad as %s", profiles[prof->group].path);
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *toolDirectory = ".", *dictionary = "words.txt";
+    char tool[PATH_LENGTH], keyLength[16], out[PATH_LENGTH];
+    int opt, execute = 0, count, failures = 0, i, j;
+    int totals[TYPE_COUNT] = { 0 };
+    triageContext triage;
+    struct timeval start, end;
+    char **args;
+
+    while ((opt = getopt(argc, argv, "d:w:x")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': toolDirectory = optarg; break;
+            case 'w': dictionary = optarg; break;
+            case 'x': execute = 1; break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    count = argc - optind;
+
+    if (count < 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    gettimeofday(&start, NULL);
+
+    triage.profiles = (profile *)calloc(count, sizeof(profile));
+    args = (char **)malloc((count + 6) * sizeof(char *));
+
+    for (i = 0; i < count; i++)
+    {
+        triage.profiles[i].path = argv[optind + i];
+    }
+
+    Executor_For(Executor_Default(), NULL, 0, count, 16, profileRange, &triage);
+    groupPads(triage.profiles, count);
+
+    gettimeofday(&end, NULL);
+
+    for (i = 0; i < count; i++)
+    {
+        const profile *prof = &triage.profiles[i];
+
+        totals[prof->type]++;
+        printProfile(prof, triage.profiles);
+    }
+
+    // one vigenere run per file, one otp run per pad, one batch for all the CBC
+    for (i = 0; i < count; i++)
+    {
+        const profile *prof = &triage.profiles[i];
+
+        if (prof->type == TYPE_XOR)
+        {
+            snprintf(tool, sizeof(tool), "%s/vigenere", toolDirectory);
+            snprintf(out, sizeof(out), "%s.out", prof->path);
+            snprintf(keyLength, sizeof(keyLength), "%d", prof->candidates[0]);
+            args[0] = tool;
+            args[1] = (char *)prof->path;
+            args[2] = out;
+            args[3] = (char *)dictionary;
+            args[4] = keyLength;
+            args[5] = NULL;
+            failures += dispatch(args, execute) != 0;
+        }
+        else if (prof->type == TYPE_OTP && prof->group == i)
+        {
+            int argCount = 1;
+
+            snprintf(tool, sizeof(tool), "%s/otp", toolDirectory);
+            args[0] = tool;
+
+            for (j = i; j < count; j++)
+            {
+                if (triage.profiles[j].type == TYPE_OTP && triage.profiles[j].group == i)
+                {
+                    args[argCount++] = (char *)triage.profiles[j].path;
+                }
+            }
+
+            args[argCount] = NULL;
+            failures += dispatch(args, execute) != 0;
+        }
+    }
+
+    if (totals[TYPE_CBC] > 0)
+    {
+        int argCount = 1;
+
+        snprintf(tool, sizeof(tool), "%s/batch", toolDirectory);
+        args[0] = tool;
+
+        for (i = 0; i < count; i++)
+        {
+            if (triage.profiles[i].type == TYPE_CBC)
+            {
+                args[argCount++] = (char *)triage.profiles[i].path;
+            }
+        }
+
+        args[argCount] = NULL;
+        failures += dispatch(args, execute) != 0;
+    }
+
+    fprintf(stderr, "%d files in %.3f s:", count,
+            (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+
+    for (i = 0; i < TYPE_COUNT; i++)
+    {
+        if (totals[i] > 0)
+        {
+            fprintf(stderr, " %d %s", totals[i], typeNames[i]);
+        }
+    }
+
+    fprintf(stderr, "\n");
+
+    free(args);
+    free(triage.profiles);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,424 @@
+//
+//  xor.c
+//
+//  Applies a repeating XOR key or a one-time pad to a file or a stream
+//
+//  Encrypting and decrypting are the same operation, so this both makes
+//  inputs for vigenere and otp from plaintexts (-x writes them in hex) and
+//  decrypts their inputs with a recovered key (-X reads hex). The key is
+//  tiled once (keystream.h), then:
+//    binary file to binary file    both are mapped and the key is applied
+//                                  from one mapping straight into the other
+//    hex input                     read whole, decoded and applied in place
+//    anything else (pipes)         read in blocks, applied in place and
+//                                  written out, in hex with -x
+//  Runs of PARALLEL_BYTES or more are split over the shared thread pool in
+//  CHUNK_SIZE pieces, each starting at its own offset into the key.
+//
+
+#include "../common/executor.h"
+#include "../common/hex.h"
+#include "../common/keystream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE (4 << 20)
+#define CHUNK_SIZE (256 << 10)
+#define PARALLEL_BYTES (1 << 20)
+
+typedef struct xorJob
+{
+    const keystream *stream;
+    uint64_t position;          // key offset of in[0]
+    const uint8_t *in;
+    uint8_t *out;
+    size_t length;
+} xorJob;
+
+static void usage()
+{
+    printf("Usage: xor -k key_hex|-K key_file [-p] [-X] [-x] [<in_file>|- [<out_file>|-]]\n");
+}
+
+static void applyRange(taskGroup *group, void *context, size_t begin, size_t end)
+{
+    const xorJob *job = (const xorJob *)context;
+    size_t start = begin * CHUNK_SIZE, stop = end * CHUNK_SIZE;
+
+    (void)group;
+
+    if (stop > job->length)
+    {
+        stop = job->length;
+    }
+
+    Keystream_Apply(job->stream, job->position + start, job->in + start, job->out + start, stop - start);
+}
+
+static void apply(const keystream *stream, uint64_t position, const uint8_t *in, uint8_t *out, size_t length)
+{
+    xorJob job = { stream, position, in, out, length };
+    executor *pool = length >= PARALLEL_BYTES ? Executor_Default() : NULL;
+
+    Executor_For(pool, NULL, 0, (length + CHUNK_SIZE - 1) / CHUNK_SIZE, 1, applyRange, &job);
+}
+
+static int writeAll(int fd, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    while (length > 0)
+    {
+        ssize_t n = write(fd, bytes, length);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            perror("write");
+            return -1;
+        }
+
+        bytes += n;
+        length -= n;
+    }
+
+    return 0;
+}
+
+// reads until the buffer is full or the input ends
+static ssize_t readFull(int fd, uint8_t *buffer, size_t length)
+{
+    size_t done = 0;
+
+    while (done < length)
+    {
+        ssize_t n = read(fd, buffer + done, length - done);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0)
+        {
+            perror("read");
+            return -1;
+        }
+
+        if (n == 0)
+        {
+            break;
+        }
+
+        done += n;
+    }
+
+    return done;
+}
+
+// the whole input, for hex which is decoded before the key is applied
+static uint8_t *readAll(int fd, size_t *length)
+{
+    size_t capacity = BLOCK_SIZE, used = 0;
+    uint8_t *data = (uint8_t *)malloc(capacity);
+    ssize_t n;
+
+    while (data != NULL && (n = readFull(fd, data + used, capacity - used)) > 0)
+    {
+        used += n;
+
+        if (used == capacity)
+        {
+            uint8_t *grown = (uint8_t *)realloc(data, capacity * 2);
+
+            if (grown == NULL)
+            {
+                free(data);
+                return NULL;
+            }
+
+            data = grown;
+            capacity *= 2;
+        }
+    }
+
+    *length = used;
+
+    return data;
+}
+
+static int writeOut(int fd, const uint8_t *data, size_t length, int hexOut, char *hex)
+{
+    size_t done, part;
+
+    if (!hexOut)
+    {
+        return writeAll(fd, data, length);
+    }
+
+    for (done = 0; done < length; done += part)
+    {
+        part = length - done < BLOCK_SIZE ? length - done : BLOCK_SIZE;
+        Hex_Encode(data + done, part, hex);
+
+        if (writeAll(fd, hex, 2 * part) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// both ends are regular files: map them and apply the key between the mappings
+static int mapToMap(const keystream *stream, int inFd, int outFd, size_t length)
+{
+    uint8_t *in = NULL, *out = NULL;
+    int ret = -1;
+
+    if (length == 0)
+    {
+        return ftruncate(outFd, 0);
+    }
+
+    if (ftruncate(outFd, length) != 0)
+    {
+        perror("ftruncate");
+        return -1;
+    }
+
+    in = (uint8_t *)mmap(NULL, length, PROT_READ, MAP_PRIVATE, inFd, 0);
+    out = (uint8_t *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, outFd, 0);
+
+    if (in != MAP_FAILED && out != MAP_FAILED)
+    {
+        madvise(in, length, MADV_SEQUENTIAL);
+        madvise(out, length, MADV_SEQUENTIAL);
+        apply(stream, 0, in, out, length);
+        ret = 0;
+    }
+    else
+    {
+        perror("mmap");
+    }
+
+    if (in != MAP_FAILED)
+    {
+        munmap(in, length);
+    }
+
+    if (out != MAP_FAILED)
+    {
+        munmap(out, length);
+    }
+
+    return ret;
+}
+
+static int streamBlocks(const keystream *stream, int inFd, int outFd, int hexOut, size_t padLength)
+{
+    uint8_t *block = (uint8_t *)malloc(BLOCK_SIZE);
+    char *hex = hexOut ? (char *)malloc(2 * (size_t)BLOCK_SIZE) : NULL;
+    uint64_t position = 0;
+    ssize_t n;
+    int ret = 0;
+
+    if (block == NULL || (hexOut && hex == NULL))
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(block);
+        return -1;
+    }
+
+    while ((n = readFull(inFd, block, BLOCK_SIZE)) > 0)
+    {
+        if (padLength && position + n > padLength)
+        {
+            fprintf(stderr, "The pad is shorter than the input\n");
+            ret = -1;
+            break;
+        }
+
+        apply(stream, position, block, block, n);
+
+        if (writeOut(outFd, block, n, hexOut, hex) != 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        position += n;
+    }
+
+    if (n < 0)
+    {
+        ret = -1;
+    }
+
+    free(block);
+    free(hex);
+
+    return ret;
+}
+
+static int fromHex(const keystream *stream, int inFd, int outFd, int hexOut, size_t padLength)
+{
+    size_t textLength;
+    char *text = (char *)readAll(inFd, &textLength);
+    uint8_t *data = text ? (uint8_t *)malloc(textLength / 2 + 1) : NULL;
+    char *hex = hexOut ? (char *)malloc(2 * (size_t)BLOCK_SIZE) : NULL;
+    long length = 0;
+    int ret = -1;
+
+    if (data == NULL || (hexOut && hex == NULL))
+    {
+        fprintf(stderr, "Out of memory\n");
+    }
+    else if ((length = Hex_DecodeText(text, textLength, data)) < 0)
+    {
+        fprintf(stderr, "The input is not hex\n");
+    }
+    else if (padLength && (size_t)length > padLength)
+    {
+        fprintf(stderr, "The pad is shorter than the input\n");
+    }
+    else
+    {
+        apply(stream, 0, data, data, length);
+        ret = writeOut(outFd, data, length, hexOut, hex);
+    }
+
+    free(hex);
+    free(data);
+    free(text);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *keyHex = NULL, *keyPath = NULL, *inPath = "-", *outPath = "-";
+    int opt, pad = 0, hexIn = 0, hexOut = 0, inFd, outFd, ret;
+    uint8_t *key = NULL;
+    size_t keyLength = 0;
+    long decoded;
+    struct stat inStat, outStat;
+    keystream stream;
+
+    while ((opt = getopt(argc, argv, "k:K:pXx")) != -1)
+    {
+        switch (opt)
+        {
+            case 'k': keyHex = optarg; break;
+            case 'K': keyPath = optarg; break;
+            case 'p': pad = 1; break;
+            case 'X': hexIn = 1; break;
+            case 'x': hexOut = 1; break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if ((keyHex == NULL) == (keyPath == NULL) || argc - optind > 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (optind < argc)
+    {
+        inPath = argv[optind];
+    }
+
+    if (optind + 1 < argc)
+    {
+        outPath = argv[optind + 1];
+    }
+
+    if (keyHex != NULL)
+    {
+        key = (uint8_t *)malloc(strlen(keyHex) / 2 + 1);
+
+        if (key == NULL || (decoded = Hex_Decode(keyHex, strlen(keyHex), key)) <= 0)
+        {
+            fprintf(stderr, "The key is not hex\n");
+            return EXIT_FAILURE;
+        }
+
+        keyLength = decoded;
+    }
+    else if ((key = Hex_LoadFile(keyPath, &keyLength)) == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (Keystream_Init(&stream, key, keyLength) != 0)
+    {
+        fprintf(stderr, "Could not set up the key\n");
+        return EXIT_FAILURE;
+    }
+
+    inFd = strcmp(inPath, "-") == 0 ? STDIN_FILENO : open(inPath, O_RDONLY);
+
+    if (inFd < 0 || fstat(inFd, &inStat) != 0)
+    {
+        perror(inPath);
+        return EXIT_FAILURE;
+    }
+
+    // not truncated yet, in case it is the input
+    outFd = strcmp(outPath, "-") == 0 ? STDOUT_FILENO : open(outPath, O_RDWR | O_CREAT, 0644);
+
+    if (outFd < 0 || fstat(outFd, &outStat) != 0)
+    {
+        perror(outPath);
+        return EXIT_FAILURE;
+    }
+
+    if (inStat.st_dev == outStat.st_dev && inStat.st_ino == outStat.st_ino && S_ISREG(inStat.st_mode))
+    {
+        fprintf(stderr, "%s: the output is the input\n", outPath);
+        return EXIT_FAILURE;
+    }
+
+    if (hexIn || !S_ISREG(inStat.st_mode) || !S_ISREG(outStat.st_mode) || hexOut || outFd == STDOUT_FILENO)
+    {
+        if (outFd != STDOUT_FILENO && S_ISREG(outStat.st_mode) && ftruncate(outFd, 0) != 0)
+        {
+            perror(outPath);
+            return EXIT_FAILURE;
+        }
+
+        ret = hexIn ? fromHex(&stream, inFd, outFd, hexOut, pad ? keyLength : 0)
+                    : streamBlocks(&stream, inFd, outFd, hexOut, pad ? keyLength : 0);
+    }
+    else if (pad && (size_t)inStat.st_size > keyLength)
+    {
+        fprintf(stderr, "The pad is shorter than the input\n");
+        ret = -1;
+    }
+    else
+    {
+        ret = mapToMap(&stream, inFd, outFd, inStat.st_size);
+    }
+
+    Keystream_Free(&stream);
+    free(key);
+    close(inFd);
+    close(outFd);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}